@@ -0,0 +1,101 @@
+#ifndef CRON_BENCH_H
+#define CRON_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "../scheduler.h"
+
+// Defines
+#define BENCH_FORMAT_ENV "BENCH_FORMAT"
+#define BENCH_JSON_NAME "json"
+#define BENCH_ROW_LEN (512)
+#define BENCH_SEPARATOR ","
+
+/*
+ * Result rows of a benchmark. By default they are printed as CSV under a
+ * header line; with BENCH_FORMAT=json every row is a JSON object with the
+ * benchmark name and one field per column, one object per line, so the
+ * results of different releases can be collected and compared.
+ */
+static const char *bench_name;
+static char bench_columns[BENCH_ROW_LEN];
+static int bench_json;
+
+static inline void bench_begin(const char *name, const char *columns) {
+    const char *format = getenv(BENCH_FORMAT_ENV);
+
+    bench_name = name;
+    bench_json = format && strcmp(format, BENCH_JSON_NAME) == 0;
+    snprintf(bench_columns, sizeof(bench_columns), "%s", columns);
+
+    if (!bench_json)
+        printf("%s\n", columns);
+    fflush(stdout);
+}
+
+static inline void bench_json_value(const char *value) {
+    char *end;
+    strtod(value, &end);
+    if (*value && !*end) {
+        printf("%s", value);
+        return;
+    }
+
+    putchar('"');
+    for (; *value; ++value) {
+        if (*value == '"' || *value == '\\')
+            putchar('\\');
+        putchar(*value);
+    }
+    putchar('"');
+}
+
+// format produces the comma-separated values of one row, in the order of the columns
+static inline void bench_row(const char *format, ...) {
+    char row[BENCH_ROW_LEN], columns[BENCH_ROW_LEN];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(row, sizeof(row), format, args);
+    va_end(args);
+
+    if (!bench_json) {
+        printf("%s\n", row);
+        fflush(stdout);
+        return;
+    }
+
+    strcpy(columns, bench_columns);
+    char *column_save, *value_save;
+    char *column = strtok_r(columns, BENCH_SEPARATOR, &column_save);
+    char *value = strtok_r(row, BENCH_SEPARATOR, &value_save);
+
+    printf("{\"bench\":\"%s\"", bench_name);
+    for (; column && value; column = strtok_r(NULL, BENCH_SEPARATOR, &column_save),
+            value = strtok_r(NULL, BENCH_SEPARATOR, &value_save)) {
+        printf(",\"%s\":", column);
+        bench_json_value(value);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+static inline double bench_elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (double) (end->tv_sec - start->tv_sec) * 1e9 + (double) (end->tv_nsec - start->tv_nsec);
+}
+
+// qsort comparator for latency samples
+static inline int bench_compare_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Fire callback for benchmarks that only measure the scheduler itself
+static inline time_t bench_noop_fire(sched_entry_t *entry, time_t now, void *arg) {
+    return 0;
+}
+
+#endif //CRON_BENCH_H
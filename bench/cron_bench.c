@@ -0,0 +1,61 @@
+#include "../cron_utils.h"
+#include "../cron.h"
+#include "bench.h"
+
+#define CALLS (200000)
+
+// No commas in the specs, they would split the CSV column
+static const char *spec_lines[] = {
+        "* * * * * /bin/true",
+        "*/5 * * * * /bin/true",
+        "0 1-5 * * 1-5 /bin/true",
+        "30 */2 15 * * /bin/true",
+        "0 12 13 * 5 /bin/true",
+        "0 0 29 2 * /bin/true"
+};
+
+/*
+ * Every call starts from the previous result, the way a task is re-armed
+ * after it fires, so sparse specs pay for the days and months they skip.
+ */
+static void bench_spec(const char *line) {
+    task_t task;
+
+    if (task_parse_line(line, strlen(line), &task) != 1) {
+        fprintf(stderr, "Incorrect task line: %s\n", line);
+        return;
+    }
+    time_spec_compile(&task.time_spec, &task.cron);
+
+    time_t after = time(NULL);
+    struct timespec start, end;
+    size_t calls = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (; calls < CALLS; ++calls) {
+        time_t next = cron_next(&task.cron, after);
+        if (next <= 0)
+            break;
+        after = next;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (calls < CALLS) {
+        fprintf(stderr, "No run found after %ld for %s\n", (long) after, line);
+        if (calls == 0)
+            return;
+    }
+
+    double ns = bench_elapsed_ns(&start, &end);
+    bench_row("%.*s,%zu,%.1f,%.0f", (int) (strlen(line) - strlen(task.exec_file_path) - 1), line, calls,
+              ns / calls, calls * 1e9 / ns);
+}
+
+int main(void) {
+    bench_begin("next_fire", "spec,calls,ns_per_call,calls_per_s");
+
+    for (size_t i = 0; i < sizeof(spec_lines) / sizeof(spec_lines[0]); ++i)
+        bench_spec(spec_lines[i]);
+
+    return 0;
+}
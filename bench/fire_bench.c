@@ -0,0 +1,80 @@
+#include "../scheduler.h"
+#include "bench.h"
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define PROBES (500)
+#define PROBE_DELAY (2)
+#define WAIT_LIMIT_MS (10000)
+
+static const size_t loaded_counts[] = {1000, 10000, 100000};
+
+typedef struct {
+    sched_entry_t *probes;
+    double lags_us[PROBES];
+    atomic_size_t fired;
+} fire_state_t;
+
+/*
+ * Lag is measured against the wall clock the deadline refers to, so it
+ * covers the timer wake-up plus every entry dispatched before this one.
+ */
+static time_t probe_fire(sched_entry_t *entry, time_t now, void *arg) {
+    fire_state_t *state = (fire_state_t *) arg;
+    struct timespec real;
+
+    clock_gettime(CLOCK_REALTIME, &real);
+    if (entry >= state->probes && entry < state->probes + PROBES) {
+        size_t n = atomic_fetch_add(&state->fired, 1);
+        state->lags_us[n] = (double) (real.tv_sec - entry->deadline) * 1e6 + (double) real.tv_nsec / 1e3;
+    }
+    return 0;
+}
+
+static void bench_fire(sched_backend_t backend, const char *name, size_t loaded) {
+    static fire_state_t state;
+    scheduler_t scheduler;
+    sched_entry_t *entries = calloc(loaded + PROBES, sizeof(sched_entry_t));
+
+    memset(&state, 0, sizeof(state));
+    if (!entries || scheduler_init(&scheduler, backend, probe_fire, &state) == -1) {
+        fprintf(stderr, "Failed to init scheduler.\n");
+        free(entries);
+        return;
+    }
+    state.probes = entries + loaded;
+
+    // The load sits between an hour and a month ahead, the probes all fall due in the same second
+    time_t now = time(NULL);
+    for (size_t i = 0; i < loaded + PROBES; ++i) {
+        scheduler_entry_init(&entries[i]);
+        scheduler_add(&scheduler, &entries[i], i < loaded ? now + 3600 + (time_t) (i * 7919 % 2592000)
+                                                          : now + PROBE_DELAY);
+    }
+
+    for (int waited = 0; atomic_load(&state.fired) < PROBES && waited < WAIT_LIMIT_MS + PROBE_DELAY * 1000;
+         waited += 10)
+        usleep(10000);
+    scheduler_destroy(&scheduler);
+
+    size_t fired = atomic_load(&state.fired);
+    if (fired < PROBES)
+        fprintf(stderr, "Only %zu of %d probes fired.\n", fired, PROBES);
+    if (fired > 0) {
+        qsort(state.lags_us, fired, sizeof(double), bench_compare_double);
+        bench_row("%s,%zu,%zu,%.1f,%.1f,%.1f", name, loaded, fired, state.lags_us[fired / 2],
+                  state.lags_us[fired * 99 / 100], state.lags_us[fired - 1]);
+    }
+    free(entries);
+}
+
+int main(void) {
+    bench_begin("fire_lag", "backend,loaded,fired,p50_us,p99_us,max_us");
+
+    for (size_t i = 0; i < sizeof(loaded_counts) / sizeof(loaded_counts[0]); ++i) {
+        bench_fire(SCHED_HEAP, "heap", loaded_counts[i]);
+        bench_fire(SCHED_WHEEL, "wheel", loaded_counts[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "../journal.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_DIR "/tmp/cron_journal_bench"
+#define BENCH_EXEC "/bin/true"
+
+static const size_t task_counts[] = {10000, 100000};
+
+static void fill_tables(size_t count) {
+    scheduler_t scheduler;
+    task_table_t table;
+    journal_t journal;
+    char fields[][5][TIME_SPEC_FIELD_LEN] = {
+            {"*/5", "*",    "*",  "*", "*"},
+            {"0",   "1-5",  "*",  "*", "1,3,5"},
+            {"30",  "*/2",  "15", "*", "*"},
+            {"10",  "0",    "0",  "0", "0"}
+    };
+    timer_type_t types[] = {I_ABSOLUTE, I_ABSOLUTE, ABSOLUTE, I_RELATIVE};
+
+    scheduler_init(&scheduler, SCHED_HEAP, bench_noop_fire, NULL);
+    task_table_init(&table, &scheduler);
+    journal_open(&journal, BENCH_DIR, &table, count, count * 2);
+    journal_recover(&journal);
+
+    for (size_t i = 0; i < count; ++i) {
+        task_t task;
+        memset(&task, 0, sizeof(task));
+        time_spec_validate(&task.time_spec, fields[i % 4]);
+        task.timer_type = types[i % 4];
+        strcpy(task.exec_file_path, BENCH_EXEC);
+
+        uint64_t id = task_table_add(&table, task);
+        journal_log_task(&journal, JOURNAL_ADD, task_table_find(&table, id));
+    }
+
+    journal_close(&journal);
+    task_table_destroy(&table);
+    scheduler_destroy(&scheduler);
+}
+
+static void bench_restore(const char *source, size_t count) {
+    scheduler_t scheduler;
+    task_table_t table;
+    journal_t journal;
+    struct timespec start, end;
+
+    scheduler_init(&scheduler, SCHED_HEAP, bench_noop_fire, NULL);
+    task_table_init(&table, &scheduler);
+    journal_open(&journal, BENCH_DIR, &table, JOURNAL_DEFAULT_SYNC_EVERY, count * 2);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = journal_recover(&journal);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (result == -1 || task_table_size(&table) != count)
+        fprintf(stderr, "Restored %lu of %lu tasks.\n", task_table_size(&table), count);
+    else
+        bench_row("%s,%lu,%.1f", source, count, bench_elapsed_ns(&start, &end) / 1e6);
+
+    if (strcmp(source, "journal") == 0)
+        journal_compact(&journal);
+    journal_close(&journal);
+    task_table_destroy(&table);
+    scheduler_destroy(&scheduler);
+}
+
+int main(void) {
+    bench_begin("journal", "source,tasks,restore_ms");
+
+    for (size_t i = 0; i < sizeof(task_counts) / sizeof(task_counts[0]); ++i) {
+        size_t count = task_counts[i];
+
+        unlink(BENCH_DIR "/" JOURNAL_FILE_NAME);
+        unlink(BENCH_DIR "/" SNAPSHOT_FILE_NAME);
+        fill_tables(count);
+
+        bench_restore("journal", count);
+        bench_restore("snapshot", count);
+    }
+
+    unlink(BENCH_DIR "/" JOURNAL_FILE_NAME);
+    unlink(BENCH_DIR "/" SNAPSHOT_FILE_NAME);
+    rmdir(BENCH_DIR);
+    return 0;
+}
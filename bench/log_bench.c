@@ -0,0 +1,83 @@
+#include "../logger.h"
+#include "bench.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#define LINES_PER_THREAD (100000)
+#define MAX_THREADS (8)
+#define BENCH_LOG "/tmp/cron_log_bench.log"
+#define BENCH_LOG_FORMATS BENCH_LOG ".fmt"
+
+static const int thread_counts[] = {1, 2, 4, MAX_THREADS};
+
+static const struct {
+    const char *name;
+    log_mode_t mode;
+} modes[] = {{"sync", LOG_SYNC}, {"drop", LOG_ASYNC_DROP}, {"block", LOG_ASYNC_BLOCK}};
+
+static const struct {
+    const char *name;
+    log_format_t format;
+} formats[] = {{"text", LOG_FORMAT_TEXT}, {"binary", LOG_FORMAT_BINARY}};
+
+// A line like the ones the server writes for every run
+static void *log_worker(void *arg) {
+    for (unsigned long i = 0; i < LINES_PER_THREAD; ++i)
+        lprintf(MAX, "Task %lu finished with status %d after %lu us\n", i, 0, i * 3);
+    return NULL;
+}
+
+/*
+ * Time is measured on the calling side only, up to the last lprintf,
+ * which is what a logging thread of the server waits for; the final
+ * flush happens in log_close.
+ */
+static void bench_log(int mode, int format, int threads) {
+    pthread_t workers[MAX_THREADS];
+    log_stats_t before, after;
+
+    unlink(BENCH_LOG);
+    unlink(BENCH_LOG_FORMATS);
+    if (log_set_mode(modes[mode].mode, LOG_DEFAULT_RING_ENTRIES) == -1
+        || log_set_format(formats[format].format) == -1) {
+        fprintf(stderr, "Failed to configure the logger.\n");
+        return;
+    }
+    log_init(BENCH_LOG, NULL, NULL);
+    log_stats(&before);
+
+    struct timespec start, end;
+    int started = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (; started < threads; ++started) {
+        if (pthread_create(&workers[started], NULL, log_worker, NULL) != 0)
+            break;
+    }
+    for (int i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    log_stats(&after);
+    log_close();
+
+    unsigned long lines = (unsigned long) started * LINES_PER_THREAD;
+    double ns = bench_elapsed_ns(&start, &end);
+    bench_row("%s,%s,%d,%lu,%.1f,%.0f,%llu", modes[mode].name, formats[format].name, started, lines,
+              ns / LINES_PER_THREAD, lines * 1e9 / ns, after.dropped - before.dropped);
+
+    unlink(BENCH_LOG);
+    unlink(BENCH_LOG_FORMATS);
+}
+
+int main(void) {
+    bench_begin("lprintf", "mode,format,threads,lines,ns_per_line,lines_per_s,dropped");
+
+    for (int mode = 0; mode < (int) (sizeof(modes) / sizeof(modes[0])); ++mode) {
+        for (int format = 0; format < (int) (sizeof(formats) / sizeof(formats[0])); ++format) {
+            for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); ++i)
+                bench_log(mode, format, thread_counts[i]);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "../spawn_pool.h"
+#include "../reaper.h"
+#include "bench.h"
+#include <unistd.h>
+
+#define JOBS (2000)
+#define BENCH_EXEC "/bin/true"
+#define WAIT_LIMIT_MS (60000)
+
+static const size_t worker_counts[] = {1, 2, 4};
+
+static atomic_size_t exited;
+
+static void count_exit(const reaper_run_t *run, void *arg) {
+    atomic_fetch_add(&exited, 1);
+}
+
+// Jobs go through the same path as fired tasks: queue, spawn worker, reaper
+static void bench_pool(spawner_t *spawner, const char *mode, size_t workers) {
+    reaper_t reaper;
+    spawn_pool_t pool;
+
+    if (reaper_init(&reaper, spawner, count_exit, NULL) == -1) {
+        fprintf(stderr, "Failed to init reaper.\n");
+        return;
+    }
+    if (spawn_pool_init(&pool, spawner, &reaper, NULL, workers, JOBS) == -1) {
+        fprintf(stderr, "Failed to init spawn pool.\n");
+        reaper_destroy(&reaper);
+        return;
+    }
+    atomic_store(&exited, 0);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < JOBS; ++i) {
+        while (spawn_pool_submit(&pool, i + 1, BENCH_EXEC, time(NULL)) == -1)
+            usleep(100);
+    }
+    for (int waited = 0; atomic_load(&exited) < JOBS && waited < WAIT_LIMIT_MS; ++waited)
+        usleep(1000);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    size_t done = atomic_load(&exited);
+    if (done < JOBS)
+        fprintf(stderr, "Only %zu of %d jobs exited.\n", done, JOBS);
+
+    double seconds = bench_elapsed_ns(&start, &end) / 1e9;
+    bench_row("%s,%zu,%zu,%.3f,%.0f", mode, workers, done, seconds, done / seconds);
+
+    spawn_pool_destroy(&pool);
+    reaper_destroy(&reaper);
+}
+
+int main(void) {
+    spawner_t direct, zygote;
+
+    // Like the server, the zygote is forked while the process is still small and single-threaded
+    if (spawner_init(&zygote, SPAWNER_ZYGOTE) == -1 || spawner_init(&direct, SPAWNER_DIRECT) == -1) {
+        fprintf(stderr, "Failed to init spawner.\n");
+        return 1;
+    }
+
+    bench_begin("spawn_throughput", "mode,workers,jobs,seconds,jobs_per_s");
+
+    for (size_t i = 0; i < sizeof(worker_counts) / sizeof(worker_counts[0]); ++i) {
+        bench_pool(&direct, "posix_spawn", worker_counts[i]);
+        bench_pool(&zygote, "zygote", worker_counts[i]);
+    }
+
+    spawner_destroy(&zygote);
+    spawner_destroy(&direct);
+    return 0;
+}
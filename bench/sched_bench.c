@@ -0,0 +1,119 @@
+#include "../scheduler.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+
+// Preloaded tasks fire between one minute and a month from now, churned timers within the next hour
+#define PRELOAD_MIN (60)
+#define PRELOAD_RANGE (60 * 60 * 24 * 30)
+#define CHURN_MIN (120)
+#define CHURN_RANGE (60 * 60)
+#define CHURN_OPS (200000)
+
+static const size_t loaded_counts[] = {1000, 100000, 1000000};
+
+static void bench_scheduler(sched_backend_t backend, size_t loaded) {
+    scheduler_t scheduler;
+    sched_entry_t *entries = calloc(loaded + CHURN_OPS, sizeof(sched_entry_t));
+    if (!entries || scheduler_init(&scheduler, backend, bench_noop_fire, NULL) == -1) {
+        printf("Failed to init scheduler.\n");
+        free(entries);
+        return;
+    }
+
+    time_t now = time(NULL);
+    for (size_t i = 0; i < loaded; ++i) {
+        scheduler_entry_init(&entries[i]);
+        scheduler_add(&scheduler, &entries[i], now + PRELOAD_MIN + rand() % PRELOAD_RANGE);
+    }
+
+    struct timespec start, end;
+    double arm_ns = 0, cancel_ns = 0;
+
+    for (size_t i = 0; i < CHURN_OPS; ++i) {
+        sched_entry_t *entry = &entries[loaded + i];
+        scheduler_entry_init(entry);
+        time_t deadline = now + CHURN_MIN + rand() % CHURN_RANGE;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        scheduler_add(&scheduler, entry, deadline);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        arm_ns += bench_elapsed_ns(&start, &end);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        scheduler_remove(&scheduler, entry);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        cancel_ns += bench_elapsed_ns(&start, &end);
+    }
+
+    bench_row("%s,%zu,%d,%.1f,%.1f", backend == SCHED_WHEEL ? "wheel" : "heap", loaded, CHURN_OPS,
+              arm_ns / CHURN_OPS, cancel_ns / CHURN_OPS);
+
+    scheduler_destroy(&scheduler);
+    free(entries);
+}
+
+// Baseline: one kernel timer per task, as list_push() used to do
+static void bench_posix_timers(size_t loaded) {
+    timer_t *timers = calloc(loaded, sizeof(timer_t));
+    if (!timers)
+        return;
+
+    struct sigevent event = {.sigev_notify = SIGEV_NONE};
+    struct itimerspec value = {0};
+    time_t now = time(NULL);
+    size_t created = 0;
+
+    for (; created < loaded; ++created) {
+        if (timer_create(CLOCK_REALTIME, &event, &timers[created]) == -1) {
+            // Hit the per-process timer limit, leave room for the churned timer
+            if (created > 0)
+                timer_delete(timers[--created]);
+            break;
+        }
+        value.it_value.tv_sec = now + PRELOAD_MIN + rand() % PRELOAD_RANGE;
+        timer_settime(timers[created], TIMER_ABSTIME, &value, NULL);
+    }
+
+    struct timespec start, end;
+    double arm_ns = 0, cancel_ns = 0;
+    size_t ops = 0;
+
+    for (; ops < CHURN_OPS; ++ops) {
+        timer_t timer;
+        value.it_value.tv_sec = now + CHURN_MIN + rand() % CHURN_RANGE;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (timer_create(CLOCK_REALTIME, &event, &timer) == -1)
+            break;
+        timer_settime(timer, TIMER_ABSTIME, &value, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        arm_ns += bench_elapsed_ns(&start, &end);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        timer_delete(timer);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        cancel_ns += bench_elapsed_ns(&start, &end);
+    }
+
+    if (ops > 0)
+        bench_row("posix_timer,%zu,%zu,%.1f,%.1f", created, ops, arm_ns / ops, cancel_ns / ops);
+
+    for (size_t i = 0; i < created; ++i)
+        timer_delete(timers[i]);
+    free(timers);
+}
+
+int main(void) {
+    srand(1);
+    bench_begin("sched", "backend,loaded,ops,arm_ns,cancel_ns");
+
+    for (size_t i = 0; i < sizeof(loaded_counts) / sizeof(loaded_counts[0]); ++i) {
+        bench_scheduler(SCHED_HEAP, loaded_counts[i]);
+        bench_scheduler(SCHED_WHEEL, loaded_counts[i]);
+        bench_posix_timers(loaded_counts[i]);
+    }
+
+    return 0;
+}
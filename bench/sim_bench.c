@@ -0,0 +1,214 @@
+#include "../task_table.h"
+#include "bench.h"
+
+#define SIM_TASKS (100000)
+#define SIM_DAYS (365)
+#define SIM_START (1767225600) // 2026-01-01 00:00:00 UTC
+#define SIM_EXEC "/bin/true"
+#define SIM_LINE_LEN (64)
+#define SIM_SAMPLE_STRIDE (4999)
+#define SECONDS_PER_MINUTE (60)
+#define SECONDS_PER_DAY (60 * 60 * 24)
+
+// Structures
+typedef struct {
+    task_t *task;
+    time_t *runs;
+    size_t count;
+    size_t capacity;
+} sim_trace_t;
+
+/*
+ * Stands in for the spawn pool: instead of starting anything it counts the
+ * runs, checks that each one fires at its deadline and keeps the run times
+ * of a sample of tasks for the next-fire check.
+ */
+typedef struct {
+    uint64_t fired;
+    uint64_t late;
+    uint64_t sample_stride;
+    sim_trace_t *traces;
+    size_t trace_count;
+} sim_recorder_t;
+
+static time_t record_fire(sched_entry_t *entry, time_t now, void *arg) {
+    task_t *task = (task_t *) ((char *) entry - offsetof(task_t, sched));
+    sim_recorder_t *recorder = (sim_recorder_t *) arg;
+
+    recorder->fired++;
+    if (now != entry->deadline)
+        recorder->late++;
+
+    if (task->id % recorder->sample_stride == 0 && task->id / recorder->sample_stride <= recorder->trace_count) {
+        sim_trace_t *trace = &recorder->traces[task->id / recorder->sample_stride - 1];
+        if (trace->count == trace->capacity) {
+            size_t capacity = trace->capacity ? trace->capacity * 2 : 64;
+            time_t *runs = realloc(trace->runs, capacity * sizeof(time_t));
+            if (runs) {
+                trace->runs = runs;
+                trace->capacity = capacity;
+            }
+        }
+        if (trace->count < trace->capacity)
+            trace->runs[trace->count++] = now;
+    }
+
+    return task_rearm_deadline(task, now);
+}
+
+// Hourly, daily, weekly and monthly jobs in proportions a busy host might have, plus some intervals
+static void sim_task_line(unsigned *seed, char *line, timer_type_t *type) {
+    int kind = rand_r(seed) % 100, minute = rand_r(seed) % 60, hour = rand_r(seed) % 24;
+
+    *type = I_ABSOLUTE;
+    if (kind < 2)
+        snprintf(line, SIM_LINE_LEN, "%d * * * * " SIM_EXEC, minute);
+    else if (kind < 45)
+        snprintf(line, SIM_LINE_LEN, "%d %d * * * " SIM_EXEC, minute, hour);
+    else if (kind < 60)
+        snprintf(line, SIM_LINE_LEN, "%d %d * * 1-5 " SIM_EXEC, minute, hour);
+    else if (kind < 75)
+        snprintf(line, SIM_LINE_LEN, "%d %d * * %d " SIM_EXEC, minute, hour, 1 + rand_r(seed) % 7);
+    else if (kind < 88)
+        snprintf(line, SIM_LINE_LEN, "%d %d %d * * " SIM_EXEC, minute, hour, 1 + rand_r(seed) % 31);
+    else if (kind < 93)
+        snprintf(line, SIM_LINE_LEN, "%d %d %d */3 %d " SIM_EXEC, minute, hour, 1 + rand_r(seed) % 31,
+                 1 + rand_r(seed) % 7);
+    else {
+        snprintf(line, SIM_LINE_LEN, "%d %d * * * " SIM_EXEC, minute, 1 + hour % 12);
+        *type = I_RELATIVE;
+    }
+}
+
+static int sim_load(task_table_t *table, size_t count) {
+    unsigned seed = 1;
+    char line[SIM_LINE_LEN];
+    task_t task;
+
+    for (size_t i = 0; i < count; ++i) {
+        timer_type_t type;
+        sim_task_line(&seed, line, &type);
+        if (task_parse_line(line, strlen(line), &task) != 1) {
+            fprintf(stderr, "Incorrect task line: %s\n", line);
+            return -1;
+        }
+        task.timer_type = type;
+        if (!task_table_add(table, task))
+            return -1;
+    }
+    return 0;
+}
+
+static int cron_matches(const cron_expr_t *expr, const struct tm *tm) {
+    if (!(expr->minutes >> tm->tm_min & 1) || !(expr->hours >> tm->tm_hour & 1) || !(expr->months >> tm->tm_mon & 1))
+        return 0;
+
+    int dom = expr->days >> (tm->tm_mday - 1) & 1, dow = expr->weekdays >> tm->tm_wday & 1;
+    if (expr->flags & (CRON_DOM_STAR | CRON_DOW_STAR))
+        return dom && dow;
+    return dom || dow;
+}
+
+/*
+ * Next-fire check: every minute of the simulated span is matched against
+ * the sampled expressions field by field, independently of cron_next(),
+ * and must be exactly the minutes at which the task ran. Interval tasks
+ * must run every time_value() seconds from their first deadline.
+ */
+static size_t sim_verify(sim_recorder_t *recorder, time_t start, time_t end) {
+    size_t mismatches = 0, *matched = calloc(recorder->trace_count, sizeof(size_t));
+    struct tm tm;
+
+    if (!matched)
+        return (size_t) -1;
+
+    for (time_t t = start - start % SECONDS_PER_MINUTE + SECONDS_PER_MINUTE; t <= end; t += SECONDS_PER_MINUTE) {
+        localtime_r(&t, &tm);
+        for (size_t i = 0; i < recorder->trace_count; ++i) {
+            sim_trace_t *trace = &recorder->traces[i];
+            if (!trace->task || trace->task->timer_type != I_ABSOLUTE || !cron_matches(&trace->task->cron, &tm))
+                continue;
+            if (matched[i] >= trace->count || trace->runs[matched[i]] != t)
+                mismatches++;
+            else
+                matched[i]++;
+        }
+    }
+
+    for (size_t i = 0; i < recorder->trace_count; ++i) {
+        sim_trace_t *trace = &recorder->traces[i];
+        if (!trace->task)
+            continue;
+        if (trace->task->timer_type == I_ABSOLUTE) {
+            mismatches += trace->count - matched[i];
+            continue;
+        }
+
+        time_t interval = time_value(&trace->task->time_spec);
+        for (size_t j = 0; j < trace->count; ++j) {
+            if (trace->runs[j] != start + (time_t) (j + 1) * interval)
+                mismatches++;
+        }
+        if (start + (time_t) (trace->count + 1) * interval <= end)
+            mismatches++;
+    }
+
+    free(matched);
+    return mismatches;
+}
+
+static void sim_run(sched_backend_t backend, const char *name, size_t tasks, int days) {
+    sim_recorder_t recorder = {0};
+    scheduler_t scheduler;
+    task_table_t table;
+
+    recorder.sample_stride = SIM_SAMPLE_STRIDE;
+    recorder.trace_count = tasks / SIM_SAMPLE_STRIDE;
+    recorder.traces = calloc(recorder.trace_count ? recorder.trace_count : 1, sizeof(sim_trace_t));
+    if (!recorder.traces || scheduler_init_virtual(&scheduler, backend, record_fire, &recorder, SIM_START) == -1) {
+        fprintf(stderr, "Failed to init scheduler.\n");
+        free(recorder.traces);
+        return;
+    }
+    task_table_init(&table, &scheduler);
+
+    if (sim_load(&table, tasks) == -1) {
+        fprintf(stderr, "Failed to load tasks.\n");
+    } else {
+        for (size_t i = 0; i < recorder.trace_count; ++i)
+            recorder.traces[i].task = task_table_find(&table, (i + 1) * SIM_SAMPLE_STRIDE);
+
+        time_t end = SIM_START + (time_t) days * SECONDS_PER_DAY;
+        struct timespec start_time, end_time;
+
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+        size_t fired = scheduler_advance(&scheduler, end);
+        clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+        double seconds = bench_elapsed_ns(&start_time, &end_time) / 1e9;
+        bench_row("%s,%zu,%d,%zu,%.3f,%.0f,%lu,%zu", name, tasks, days, fired, seconds, fired / seconds,
+                  recorder.late, sim_verify(&recorder, SIM_START, end));
+    }
+
+    task_table_destroy(&table);
+    scheduler_destroy(&scheduler);
+    for (size_t i = 0; i < recorder.trace_count; ++i)
+        free(recorder.traces[i].runs);
+    free(recorder.traces);
+}
+
+int main(int argc, char *argv[]) {
+    size_t tasks = argc > 1 ? strtoul(argv[1], NULL, 10) : SIM_TASKS;
+    int days = argc > 2 ? atoi(argv[2]) : SIM_DAYS;
+
+    // With TZ unset glibc checks /etc/localtime on every mktime, which cron_next calls for each run
+    setenv("TZ", ":/etc/localtime", 0);
+    tzset();
+
+    bench_begin("simulation", "backend,tasks,days,fired,seconds,fires_per_s,late,mismatches");
+
+    sim_run(SCHED_HEAP, "heap", tasks, days);
+    sim_run(SCHED_WHEEL, "wheel", tasks, days);
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "../scheduler.h"
+#include "../spawner.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+
+#define LAUNCHES (2000)
+#define TASK_PAYLOAD (512)
+#define BENCH_EXEC "/bin/true"
+
+static const size_t loaded_counts[] = {1000, 10000, 100000};
+
+typedef struct {
+    sched_entry_t sched;
+    char payload[TASK_PAYLOAD];
+} bench_task_t;
+
+static void bench_launch(spawner_t *spawner, const char *mode, size_t loaded) {
+    static double samples[LAUNCHES];
+    struct timespec start, end;
+
+    for (int i = 0; i < LAUNCHES; ++i) {
+        pid_t pid;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int result = spawner_spawn(spawner, BENCH_EXEC, &pid);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (result == -1) {
+            perror("spawn failed");
+            return;
+        }
+        if (spawner->mode == SPAWNER_DIRECT) {
+            waitpid(pid, NULL, 0);
+        } else {
+            // Nobody else reads the zygote's exit reports here, drain them so it never blocks
+            spawner_exit_t report;
+            while (recv(spawner->exit_sock, &report, sizeof(report), MSG_DONTWAIT) > 0);
+        }
+
+        samples[i] = (double) (end.tv_sec - start.tv_sec) * 1e6 + (double) (end.tv_nsec - start.tv_nsec) / 1e3;
+    }
+
+    qsort(samples, LAUNCHES, sizeof(double), bench_compare_double);
+    bench_row("%s,%zu,%d,%.1f,%.1f", mode, loaded, LAUNCHES, samples[LAUNCHES / 2], samples[LAUNCHES * 99 / 100]);
+}
+
+int main(void) {
+    spawner_t direct, zygote;
+
+    // Like the server, the zygote is forked while the process is still small and single-threaded
+    if (spawner_init(&zygote, SPAWNER_ZYGOTE) == -1 || spawner_init(&direct, SPAWNER_DIRECT) == -1) {
+        printf("Failed to init spawner.\n");
+        return 1;
+    }
+
+    bench_begin("spawn", "mode,loaded,launches,p50_us,p99_us");
+
+    for (size_t i = 0; i < sizeof(loaded_counts) / sizeof(loaded_counts[0]); ++i) {
+        size_t loaded = loaded_counts[i];
+        scheduler_t scheduler;
+        bench_task_t *tasks = calloc(loaded, sizeof(bench_task_t));
+
+        if (!tasks || scheduler_init(&scheduler, SCHED_HEAP, bench_noop_fire, NULL) == -1) {
+            printf("Failed to init scheduler.\n");
+            return 1;
+        }
+
+        time_t now = time(NULL);
+        for (size_t j = 0; j < loaded; ++j) {
+            memset(tasks[j].payload, 'x', TASK_PAYLOAD);
+            scheduler_entry_init(&tasks[j].sched);
+            scheduler_add(&scheduler, &tasks[j].sched, now + 3600 + (time_t) j);
+        }
+
+        bench_launch(&direct, "posix_spawn", loaded);
+        bench_launch(&zygote, "zygote", loaded);
+
+        scheduler_destroy(&scheduler);
+        free(tasks);
+    }
+
+    spawner_destroy(&zygote);
+    spawner_destroy(&direct);
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "../task_table.h"
+#include "bench.h"
+
+static const size_t task_counts[] = {1000, 10000, 100000};
+
+static const char *task_lines[] = {
+        "*/5 * * * * /bin/true",
+        "0 1-5 * * 1-5 /bin/true",
+        "30 */2 15 * * /bin/true",
+        "10 * * * * /bin/true"
+};
+static const timer_type_t task_types[] = {I_ABSOLUTE, I_ABSOLUTE, ABSOLUTE, I_RELATIVE};
+
+#define TASK_TEMPLATES (sizeof(task_lines) / sizeof(task_lines[0]))
+
+static void bench_row_ops(const char *op, size_t count, const struct timespec *start, const struct timespec *end) {
+    double ns = bench_elapsed_ns(start, end);
+    bench_row("%s,%zu,%.1f,%.0f", op, count, ns / count, count * 1e9 / ns);
+}
+
+// Every operation also arms or cancels the task's timer, as it does in the server
+static void bench_store(size_t count, const task_t *templates) {
+    scheduler_t scheduler;
+    task_table_t table;
+    uint64_t *ids = malloc(count * sizeof(uint64_t));
+
+    if (!ids || scheduler_init(&scheduler, SCHED_HEAP, bench_noop_fire, NULL) == -1) {
+        fprintf(stderr, "Failed to init scheduler.\n");
+        free(ids);
+        return;
+    }
+    task_table_init(&table, &scheduler);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; ++i)
+        ids[i] = task_table_add(&table, templates[i % TASK_TEMPLATES]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bench_row_ops("add", count, &start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; ++i)
+        task_table_edit(&table, ids[i], templates[(i + 1) % TASK_TEMPLATES]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bench_row_ops("edit", count, &start, &end);
+
+    // Deleting in a different order than adding leaves the free slots scattered, as churn does
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; ++i)
+        task_table_remove(&table, ids[(i * 7919) % count]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bench_row_ops("delete", count, &start, &end);
+
+    if (task_table_size(&table) != 0)
+        fprintf(stderr, "%lu tasks left after deleting all of them.\n", task_table_size(&table));
+
+    task_table_destroy(&table);
+    scheduler_destroy(&scheduler);
+    free(ids);
+}
+
+int main(void) {
+    task_t templates[TASK_TEMPLATES];
+
+    for (size_t i = 0; i < TASK_TEMPLATES; ++i) {
+        if (task_parse_line(task_lines[i], strlen(task_lines[i]), &templates[i]) != 1) {
+            fprintf(stderr, "Incorrect task line: %s\n", task_lines[i]);
+            return 1;
+        }
+        templates[i].timer_type = task_types[i];
+    }
+
+    bench_begin("task_store", "op,tasks,ns_per_op,ops_per_s");
+
+    for (size_t i = 0; i < sizeof(task_counts) / sizeof(task_counts[0]); ++i)
+        bench_store(task_counts[i], templates);
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include "../server.h"
+#include "../cronclient.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define REQUESTS (16384)
+#define REQUEST_PAYLOAD (256)
+
+static const int client_counts[] = {1, 16, 128};
+static const transport_type_t transport_types[] = {TRANSPORT_MQ, TRANSPORT_SOCKET};
+
+// Replies with the request's payload, so only the transport is measured
+static void echo_handle(server_request_t *request, void *arg) {
+    request->reply_type = RESULTS;
+    request->status = proto_buffer_append(&request->reply, request->payload.data, request->payload.length) == 0 ?
+                      PROTO_OK : PROTO_FAILED;
+    request->reply.count = request->payload.count;
+}
+
+static pid_t server_start(void) {
+    mq_attr_t mq_attr = {.mq_curmsgs = 0, .mq_msgsize = PROTO_MAX_MSG, .mq_maxmsg = MSG_MAX_COUNT, .mq_flags = 0};
+    mqd_t mqd = mq_open(QUEUE_NAME, O_CREAT | O_EXCL | O_RDWR | O_NONBLOCK, 0666, &mq_attr);
+    if (mqd == -1) {
+        printf("Failed to create queue, is the cron server running?\n");
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid != 0) {
+        mq_close(mqd);
+        return pid;
+    }
+
+    transport_t transports[2];
+    server_t server;
+    if (transport_mq_init(&transports[0], mqd) == -1 || transport_socket_listen(&transports[1], SOCKET_NAME) == -1 ||
+        server_init(&server, transports, 2, SERVER_DEFAULT_WORKERS, SERVER_DEFAULT_MAX_PENDING, echo_handle,
+                    NULL) == -1) {
+        printf("Failed to init server.\n");
+        exit(1);
+    }
+
+    server_run(&server);
+    server_destroy(&server);
+    transport_close(&transports[1]);
+    transport_close(&transports[0]);
+    mq_close(mqd);
+    exit(0);
+}
+
+/*
+ * Every client is a process of its own, as the server tells clients apart
+ * by pid. Clients connect once the round starts, the cost of creating and
+ * removing a reply queue is part of the message queue's throughput.
+ */
+static void client_run(transport_type_t transport, int start_fd, double *samples, int requests) {
+    char start;
+    if (read(start_fd, &start, 1) == -1)
+        exit(1);
+
+    cronclient_t client;
+    if (cronclient_connect(&client, transport) == -1)
+        exit(1);
+
+    char payload[REQUEST_PAYLOAD];
+    memset(payload, 'x', sizeof(payload));
+    proto_header_t header;
+    proto_buffer_t reply;
+    proto_buffer_init(&reply);
+
+    for (int i = 0; i < requests; ++i) {
+        struct timespec sent, received;
+
+        clock_gettime(CLOCK_MONOTONIC, &sent);
+        int result = cronclient_call(&client, BATCH, 1, payload, sizeof(payload), &header, &reply);
+        clock_gettime(CLOCK_MONOTONIC, &received);
+
+        if (result == -1 || header.status != PROTO_OK || reply.length != sizeof(payload))
+            exit(1);
+        samples[i] = bench_elapsed_ns(&sent, &received) / 1e3;
+    }
+
+    proto_buffer_free(&reply);
+    cronclient_close(&client);
+    exit(0);
+}
+
+static void bench_round(transport_type_t transport, int clients, double *samples) {
+    int requests = REQUESTS / clients, start_pipe[2], failed = 0;
+    pid_t pids[clients];
+    struct timespec start, end;
+
+    if (pipe(start_pipe) == -1) {
+        perror("pipe failed");
+        return;
+    }
+    fflush(stdout);
+
+    for (int i = 0; i < clients; ++i) {
+        if ((pids[i] = fork()) == 0) {
+            close(start_pipe[1]);
+            client_run(transport, start_pipe[0], samples + (size_t) i * requests, requests);
+        }
+    }
+
+    // Closing the write end releases every client at once
+    close(start_pipe[0]);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    close(start_pipe[1]);
+
+    // The server is a child as well, so clients are waited for one by one
+    for (int i = 0; i < clients; ++i) {
+        int status;
+        if (pids[i] == -1 || waitpid(pids[i], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (failed) {
+        fprintf(stderr, "%s,%d,%d clients failed\n", transport_type_name(transport), clients, failed);
+        return;
+    }
+
+    size_t total = (size_t) requests * clients;
+    qsort(samples, total, sizeof(double), bench_compare_double);
+    bench_row("%s,%d,%zu,%.0f,%.1f,%.1f", transport_type_name(transport), clients, total,
+                 (double) total * 1e9 / bench_elapsed_ns(&start, &end), samples[total / 2], samples[total * 99 / 100]);
+}
+
+int main(void) {
+    double *samples = mmap(NULL, REQUESTS * sizeof(double), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (samples == MAP_FAILED) {
+        perror("mmap failed");
+        return 1;
+    }
+
+    pid_t server_pid = server_start();
+    if (server_pid == -1)
+        return 1;
+
+    // Both transports are ready once the socket accepts connections
+    int probe;
+    for (int i = 0; (probe = transport_socket_connect(SOCKET_NAME)) == -1 && i < CLIENT_OPEN_RETRIES; ++i)
+        usleep(CLIENT_RETRY_PAUSE_US);
+    if (probe == -1) {
+        printf("Server did not start.\n");
+        kill(server_pid, SIGKILL);
+        mq_unlink(QUEUE_NAME);
+        return 1;
+    }
+    close(probe);
+
+    bench_begin("transport", "transport,clients,requests,requests_per_s,p50_us,p99_us");
+
+    for (size_t i = 0; i < sizeof(transport_types) / sizeof(transport_types[0]); ++i)
+        for (size_t j = 0; j < sizeof(client_counts) / sizeof(client_counts[0]); ++j)
+            bench_round(transport_types[i], client_counts[j], samples);
+
+    cronclient_t client;
+    if (cronclient_connect(&client, TRANSPORT_SOCKET) == 0) {
+        cronclient_submit(&client, DESTROY, 0, NULL, 0, NULL, NULL);
+        cronclient_close(&client);
+    }
+    waitpid(server_pid, NULL, 0);
+    mq_unlink(QUEUE_NAME);
+    munmap(samples, REQUESTS * sizeof(double));
+    return 0;
+}
@@ -0,0 +1,235 @@
+#include "cron.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+static int cron_number(const char **text, long *value) {
+    if (!isdigit((unsigned char) **text))
+        return 0;
+
+    char *end;
+    *value = strtol(*text, &end, 10);
+    *text = end;
+    return 1;
+}
+
+int cron_field_parse(const char *text, int min, int max, uint64_t *mask) {
+    uint64_t result = 0;
+    const char *p = text;
+
+    while (1) {
+        long from, to, step = 1;
+
+        if (*p == '*') {
+            from = min;
+            to = max;
+            p++;
+        } else {
+            if (!cron_number(&p, &from))
+                return 0;
+            to = from;
+            if (*p == '-') {
+                p++;
+                if (!cron_number(&p, &to))
+                    return 0;
+            } else if (*p == '/') {
+                // "5/15" means every 15 starting at 5, as in vixie cron
+                to = max;
+            }
+        }
+
+        if (*p == '/') {
+            p++;
+            if (!cron_number(&p, &step) || step < 1)
+                return 0;
+        }
+
+        if (from < min || to > max || from > to)
+            return 0;
+
+        for (long value = from; value <= to; value += step)
+            result |= 1ULL << value;
+
+        if (*p == ',') {
+            p++;
+            continue;
+        }
+        if (*p == '\0')
+            break;
+        return 0;
+    }
+
+    *mask = result;
+    return 1;
+}
+
+void cron_field_format(uint64_t mask, int min, int max, char *buffer, size_t size) {
+    uint64_t full = ((max == 63 ? 0 : 1ULL << (max + 1)) - 1) & ~((1ULL << min) - 1);
+    size_t len = 0;
+
+    buffer[0] = '\0';
+    mask &= full;
+    if (mask == full) {
+        snprintf(buffer, size, "*");
+        return;
+    }
+
+    // Evenly spaced values are written back as a step, "*/5" rather than twelve numbers
+    if (__builtin_popcountll(mask) >= 3) {
+        int first = __builtin_ctzll(mask);
+        int last = 63 - __builtin_clzll(mask);
+        int step = __builtin_ctzll(mask & ~(1ULL << first)) - first;
+        uint64_t expected = 0;
+
+        for (int value = first; value <= last; value += step)
+            expected |= 1ULL << value;
+
+        if (step > 1 && expected == mask) {
+            if (last + step > max && first == min)
+                snprintf(buffer, size, "*/%d", step);
+            else if (last + step > max)
+                snprintf(buffer, size, "%d/%d", first, step);
+            else
+                snprintf(buffer, size, "%d-%d/%d", first, last, step);
+            return;
+        }
+    }
+
+    for (int value = min; value <= max && len < size; ++value) {
+        if (!(mask & (1ULL << value)))
+            continue;
+
+        int end = value;
+        while (end < max && (mask & (1ULL << (end + 1))))
+            end++;
+
+        if (end == value)
+            len += snprintf(buffer + len, size - len, len ? ",%d" : "%d", value);
+        else
+            len += snprintf(buffer + len, size - len, len ? ",%d-%d" : "%d-%d", value, end);
+        value = end;
+    }
+}
+
+static int is_leap_year(int year) {
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static int days_in_month(int year, int month) {
+    static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    return month == 1 && is_leap_year(year) ? 29 : days[month];
+}
+
+// Weekday (0 - sunday) of a date in the proleptic gregorian calendar
+static int weekday_of(int year, int month, int day) {
+    static const int offsets[] = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};
+    if (month < 2)
+        year--;
+    return (year + year / 4 - year / 100 + year / 400 + offsets[month] + day) % 7;
+}
+
+// Mask of the days of the month (bit 0 - day 1) matching the day of month and weekday fields
+static uint64_t cron_month_days(const cron_expr_t *expr, int year, int month) {
+    int count = days_in_month(year, month);
+    uint64_t all = (1ULL << count) - 1;
+
+    // Rotate the weekday mask so that bit 0 is the weekday of the 1st and repeat it for every week
+    int first = weekday_of(year, month, 1);
+    uint64_t week = ((expr->weekdays >> first) | (expr->weekdays << (7 - first))) & 0x7F;
+    uint64_t by_weekday = week | week << 7 | week << 14 | week << 21 | week << 28;
+    uint64_t by_day = expr->days;
+
+    // A field starting with "*" only narrows the other one down, as in vixie cron
+    if (expr->flags & (CRON_DOM_STAR | CRON_DOW_STAR))
+        return by_day & by_weekday & all;
+    return (by_day | by_weekday) & all;
+}
+
+time_t cron_next(const cron_expr_t *expr, time_t after) {
+    if (!expr->minutes || !expr->hours || !expr->months || !expr->days || !expr->weekdays)
+        return 0;
+
+    struct tm tm;
+    time_t start = after - after % 60 + 60;
+    localtime_r(&start, &tm);
+
+    int year = tm.tm_year + 1900;
+    int month = tm.tm_mon;
+    int day = tm.tm_mday;
+    int hour = tm.tm_hour;
+    int minute = tm.tm_min;
+    int last_year = year + CRON_SEARCH_YEARS;
+
+    while (year <= last_year) {
+        uint32_t months = expr->months >> month;
+        if (!months) {
+            year++;
+            month = 0;
+            day = 1;
+            hour = 0;
+            minute = 0;
+            continue;
+        }
+        if (!(months & 1)) {
+            month += __builtin_ctz(months);
+            day = 1;
+            hour = 0;
+            minute = 0;
+        }
+
+        uint64_t days = cron_month_days(expr, year, month) >> (day - 1);
+        if (!days) {
+            month++;
+            day = 1;
+            hour = 0;
+            minute = 0;
+            if (month > 11) {
+                month = 0;
+                year++;
+            }
+            continue;
+        }
+        if (!(days & 1)) {
+            day += __builtin_ctzll(days);
+            hour = 0;
+            minute = 0;
+        }
+
+        uint32_t hours = hour < 24 ? expr->hours >> hour : 0;
+        if (!hours) {
+            day++;
+            hour = 0;
+            minute = 0;
+            continue;
+        }
+        if (!(hours & 1)) {
+            hour += __builtin_ctz(hours);
+            minute = 0;
+        }
+
+        uint64_t minutes = minute < 60 ? expr->minutes >> minute : 0;
+        if (!minutes) {
+            hour++;
+            minute = 0;
+            continue;
+        }
+        minute += __builtin_ctzll(minutes);
+
+        tm = (struct tm) {0};
+        tm.tm_year = year - 1900;
+        tm.tm_mon = month;
+        tm.tm_mday = day;
+        tm.tm_hour = hour;
+        tm.tm_min = minute;
+        tm.tm_isdst = -1;
+
+        time_t result = mktime(&tm);
+        if (result > after)
+            return result;
+
+        // Repeated local time after a DST change, keep looking past it
+        minute++;
+    }
+
+    return 0;
+}
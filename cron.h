@@ -0,0 +1,40 @@
+#ifndef CRON_CRON_H
+#define CRON_CRON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// Defines
+#define CRON_DOM_STAR (1)
+#define CRON_DOW_STAR (2)
+#define CRON_SEARCH_YEARS (28)
+
+// Structures
+
+/*
+ * Compiled schedule. Bit n of minutes/hours is minute/hour n, bit n of days
+ * is day n + 1 of the month, bit n of months is month n + 1 and bit n of
+ * weekdays is struct tm weekday n (0 - sunday). When both the day of month
+ * and the weekday are restricted a day matches if either of them does. As
+ * in vixie cron, a field starting with an asterisk (CRON_DOM_STAR or
+ * CRON_DOW_STAR), a step over the whole range included, does not count as
+ * restricted: a day then has to match both fields.
+ */
+typedef struct {
+    uint64_t minutes;
+    uint32_t hours;
+    uint32_t days;
+    uint16_t months;
+    uint8_t weekdays;
+    uint8_t flags;
+} cron_expr_t;
+
+// Cron methods
+int cron_field_parse(const char *text, int min, int max, uint64_t *mask);
+
+void cron_field_format(uint64_t mask, int min, int max, char *buffer, size_t size);
+
+time_t cron_next(const cron_expr_t *expr, time_t after);
+
+#endif //CRON_CRON_H
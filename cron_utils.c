@@ -1,200 +1,50 @@
+#define LOG_COMPONENT LOG_SCHEDULER
 #include "cron_utils.h"
 
-void *timer_thread(void *arg) {
-    task_t *task = (task_t *) arg;
-    char *argv[] = {task->exec_file_path, NULL};
+time_t task_fire(sched_entry_t *entry, time_t now, void *arg) {
+    task_t *task = (task_t *) ((char *) entry - offsetof(task_t, sched));
+    spawn_pool_t *pool = (spawn_pool_t *) arg;
 
-    if (posix_spawn(&task->pid, task->exec_file_path, NULL, NULL, argv, NULL) != 0) {
-        perror("posix_spawn failed");
+    // The dispatcher only hands the job over, spawning happens on the pool workers.
+    // When the queue is full the run is retried a second later rather than lost.
+    if (spawn_pool_submit(pool, task->id, task->exec_file_path, entry->deadline) == -1) {
+        LPRINTF(LOW, "Spawn queue full, deferring run of %s\n", task->exec_file_path);
+        return now + 1;
     }
-
-    task->active = 0;
-    timer_delete(task->timer_id);
-    return NULL;
+    return task_rearm_deadline(task, now);
 }
 
-void list_init(list_t *list) {
-    list->head = NULL;
-    list->count = 0;
-}
-
-void list_push(list_t *list, task_t task) {
-    if (!list) return;
-
-    node_t *node = calloc(1, sizeof(node_t));
-    if (!node) {
-        perror("calloc failed\n");
-        return;
-    }
-
-    int time = time_value(&task.time_spec);
-
-    struct sigevent timer_event;
-    timer_event.sigev_notify = SIGEV_THREAD;
-    timer_event.sigev_notify_function = (void (*)(__sigval_t)) timer_thread;
-    timer_event.sigev_value.sival_ptr = &node->task;
-    timer_event.sigev_notify_attributes = NULL;
-
-    if (timer_create(CLOCK_REALTIME, &timer_event, &task.timer_id) == -1) {
-        printf("Failed to create timer.\n");
-        free(node);
-        return;
-    }
-
-    struct itimerspec value;
-    struct timespec rt_value;
-
-    if (task.timer_type < 2)
-        clock_gettime(CLOCK_REALTIME, &rt_value);
-    else {
-        rt_value.tv_nsec = 0;
-        rt_value.tv_sec = 0;
-    }
-
-    value.it_value.tv_sec = rt_value.tv_sec + time;
-    value.it_value.tv_nsec = 0;
-
-    if (task.timer_type == I_RELATIVE || task.timer_type == I_ABSOLUTE) {
-        value.it_interval.tv_sec = time;
-        value.it_interval.tv_nsec = 0;
-    }
-
-    int flags;
-    if (task.timer_type == I_RELATIVE || task.timer_type == RELATIVE)
-        flags = 0;
-    else
-        flags = TIMER_ABSTIME;
-
-    if (timer_settime(task.timer_id, flags, &value, NULL) == -1) {
-        perror("timer_settime failed");
-        timer_delete(node->task.timer_id);
-        free(node);
-        return;
-    }
-
-    node->task = task;
-    node->task.active = 1;
-
-    node->next = list->head;
-    list->head = node;
-    list->count++;
-}
-
-void list_clear(list_t *list) {
-    if (!list)
-        return;
-
-    node_t *node = list->head;
-
-    while (node) {
-        node_t *next = node->next;
-        timer_delete(node->task.timer_id);
-        free(node);
-        node = next;
-    }
-
-    list->head = NULL;
-    list->count = 0;
-}
-
-void task_edit(list_t *list, task_t task, int idx) {
-    if (!list || list_is_empty(list))
-        return;
-
-    node_t *node = list->head;
-    for (int i = 0; i < idx; ++i)
-        node = node->next;
-
-    timer_delete(node->task.timer_id);
-    int time = time_value(&task.time_spec);
-
-    struct sigevent timer_event;
-    timer_event.sigev_notify = SIGEV_THREAD;
-    timer_event.sigev_notify_function = (void (*)(__sigval_t)) timer_thread;
-    timer_event.sigev_value.sival_ptr = &node->task;
-    timer_event.sigev_notify_attributes = NULL;
-
-    if (timer_create(CLOCK_REALTIME, &timer_event, &task.timer_id) == -1) {
-        printf("Failed to create timer.\n");
-        free(node);
-        return;
-    }
-
-    struct itimerspec value;
-    struct timespec rt_value;
-
-    if (task.timer_type < 2)
-        clock_gettime(CLOCK_REALTIME, &rt_value);
-    else {
-        rt_value.tv_nsec = 0;
-        rt_value.tv_sec = 0;
-    }
+// Deadline of the next run of a task that has just fired at now, 0 when it does not run again
+time_t task_rearm_deadline(task_t *task, time_t now) {
+    if (task->timer_type == I_ABSOLUTE)
+        return cron_next(&task->cron, now);
 
-    value.it_value.tv_sec = rt_value.tv_sec + time;
-    value.it_value.tv_nsec = 0;
+    if (task->timer_type == I_RELATIVE) {
+        time_t interval = time_value(&task->time_spec);
+        time_t next = task->sched.deadline + interval;
 
-    if (task.timer_type == I_RELATIVE || task.timer_type == I_ABSOLUTE) {
-        value.it_interval.tv_sec = time;
-        value.it_interval.tv_nsec = 0;
+        // Skip the runs missed while the scheduler was late instead of firing them all at once
+        if (next <= now)
+            next += ((now - next) / interval + 1) * interval;
+        return next;
     }
 
-    int flags;
-    if (task.timer_type == I_RELATIVE || task.timer_type == RELATIVE)
-        flags = 0;
-    else
-        flags = TIMER_ABSTIME;
-
-    if (timer_settime(task.timer_id, flags, &value, NULL) == -1) {
-        perror("timer_settime failed");
-        timer_delete(node->task.timer_id);
-        free(node);
-        return;
-    }
-
-    node->task = task;
-    node->task.active = 1;
+    task->active = 0;
+    return 0;
 }
 
 void tasks_display(task_t *tasks, unsigned int n) {
     if (n < 1) {
         printf("No tasks.\n");
     } else {
-        printf("No. | min h d m wd | file name | timer type\n");
+        printf("ID | min h d m wd | file name | timer type\n");
         printf("───────────────────────────────────────────\n");
-        for (int i = 0; i < n; ++i) {
+        for (unsigned int i = 0; i < n; ++i) {
             task_t task = tasks[i];
-            printf("%d. | ", i + 1);
-            if (task.time_spec.minute.is_asterisk) {
-                printf("* ");
-            } else {
-                printf("%d ", task.time_spec.minute.val);
-            }
-
-            if (task.time_spec.hour.is_asterisk) {
-                printf("* ");
-            } else {
-                printf("%d ", task.time_spec.hour.val);
-            }
-
-            if (task.time_spec.day.is_asterisk) {
-                printf("* ");
-            } else {
-                printf("%d ", task.time_spec.day.val);
-            }
-
-            if (task.time_spec.month.is_asterisk) {
-                printf("* ");
-            } else {
-                printf("%d ", task.time_spec.month.val);
-            }
-
-            if (task.time_spec.weekday.is_asterisk) {
-                printf("* |");
-            } else {
-                printf("%d |", task.time_spec.weekday.val);
-            }
-
-            printf(" %s | ", task.exec_file_path);
+            printf("%lu | ", task.id);
+            char time_spec_str[TIME_SPEC_STR_LEN];
+            time_spec_format(&task.time_spec, time_spec_str, TIME_SPEC_STR_LEN);
+            printf("%s | %s | ", time_spec_str, task.exec_file_path);
 
             switch (task.timer_type) {
                 case RELATIVE: {
@@ -207,207 +57,148 @@ void tasks_display(task_t *tasks, unsigned int n) {
                 }
                 case I_ABSOLUTE: {
                     printf("interval absolute\n");
+                    break;
                 }
                 case I_RELATIVE: {
                     printf("interval relative\n");
+                    break;
                 }
             }
         }
     }
 }
 
-void list_print_to_file(list_t *list, FILE *f) {
-    if (list_size(list) < 1) {
-        fprintf(f, "No tasks.\n");
-    } else {
-        fprintf(f, "No. | min h d m wd | file name | timer type\n");
-        fprintf(f, "───────────────────────────────────────────\n");
-        node_t *node = list->head;
-        int idx = 1;
-        while (node) {
-            task_t task = node->task;
-            fprintf(f, "%d. | ", idx);
-            if (task.time_spec.minute.is_asterisk) {
-                fprintf(f, "* ");
-            } else {
-                fprintf(f, "%d ", task.time_spec.minute.val);
-            }
+int time_spec_validate(ctime_spec_t *time_spec, char time_data[5][TIME_SPEC_FIELD_LEN]) {
+    return minute_validate(&time_spec->minute, time_data[0]) && hour_validate(&time_spec->hour, time_data[1]) &&
+           day_validate(&time_spec->day, time_data[2]) && month_validate(&time_spec->month, time_data[3]) &&
+           weekday_validate(&time_spec->weekday, time_data[4]);
+}
 
-            if (task.time_spec.hour.is_asterisk) {
-                fprintf(f, "* ");
-            } else {
-                fprintf(f, "%d ", task.time_spec.hour.val);
-            }
+// Parses one crontab line "min h d m wd path" into an interval absolute task.
+// Returns 1 for a task, 0 for a blank or comment line and -1 for an invalid line.
+int task_parse_line(const char *line, size_t length, task_t *task) {
+    char time_data[5][TIME_SPEC_FIELD_LEN];
+    const char *end = line + length;
 
-            if (task.time_spec.day.is_asterisk) {
-                fprintf(f, "* ");
-            } else {
-                fprintf(f, "%d ", task.time_spec.day.val);
-            }
+    while (line < end && isspace((unsigned char) *line))
+        line++;
+    if (line == end || *line == '#')
+        return 0;
 
-            if (task.time_spec.month.is_asterisk) {
-                fprintf(f, "* ");
-            } else {
-                fprintf(f, "%d ", task.time_spec.month.val);
-            }
+    for (int i = 0; i < 5; ++i) {
+        const char *start = line;
+        while (line < end && !isspace((unsigned char) *line))
+            line++;
+        if (line == start || line - start >= TIME_SPEC_FIELD_LEN)
+            return -1;
+
+        memcpy(time_data[i], start, line - start);
+        time_data[i][line - start] = '\0';
+        while (line < end && isspace((unsigned char) *line))
+            line++;
+    }
 
-            if (task.time_spec.weekday.is_asterisk) {
-                fprintf(f, "* |");
-            } else {
-                fprintf(f, "%d |", task.time_spec.weekday.val);
-            }
+    while (end > line && isspace((unsigned char) end[-1]))
+        end--;
+    if (end == line || end - line >= EXEC_FILE_PATH_LEN)
+        return -1;
 
-            fprintf(f, " %s | ", task.exec_file_path);
+    memset(task, 0, sizeof(task_t));
+    task->timer_type = I_ABSOLUTE;
+    memcpy(task->exec_file_path, line, end - line);
+    task->exec_file_path[end - line] = '\0';
 
-            switch (task.timer_type) {
-                case RELATIVE: {
-                    fprintf(f, "relative\n");
-                    break;
-                }
-                case ABSOLUTE: {
-                    fprintf(f, "absolute\n");
-                    break;
-                }
-                case I_ABSOLUTE: {
-                    fprintf(f, "interval absolute\n");
-                }
-                case I_RELATIVE: {
-                    fprintf(f, "interval relative\n");
-                }
-            }
-            node = node->next;
-        }
-    }
-}
-
-int list_is_empty(list_t *list) {
-    return !list || !list->head || list->count == 0;
+    if (!time_spec_validate(&task->time_spec, time_data) || access(task->exec_file_path, F_OK) == -1)
+        return -1;
+    return 1;
 }
 
-int list_size(list_t *list) {
-    if (!list || list_is_empty(list))
-        return -1;
+static int field_check(const ctime_spec_val_t *time_spec_val, int min, int max) {
+    uint64_t full = ((max == 63 ? 0 : 1ULL << (max + 1)) - 1) & ~((1ULL << min) - 1);
+    uint64_t mask = time_spec_val->mask;
 
-    return list->count;
+    return mask && !(mask & ~full) && time_spec_val->val == __builtin_ctzll(mask) &&
+           (time_spec_val->is_asterisk == 0 || (time_spec_val->is_asterisk == FIELD_ASTERISK && mask == full) ||
+            (time_spec_val->is_asterisk == FIELD_ASTERISK_STEP && (mask & 1ULL << min)));
 }
 
-void list_remove_index(list_t *list, int idx) {
-    if (!list || list_is_empty(list) || list_size(list) < idx)
-        return;
+// Checks a task received as a raw record rather than as text: the same conditions task_parse_line
+// and a BATCH add enforce, on fields that nobody has parsed. Returns 1 for a valid task.
+int task_record_validate(const task_t *task) {
+    const ctime_spec_t *spec = &task->time_spec;
 
-    node_t *prev = NULL;
-    node_t *node = list->head;
-    for (int i = 0; i < idx; ++i) {
-        prev = node;
-        node = node->next;
-    }
+    if ((unsigned) task->timer_type > I_RELATIVE ||
+        !memchr(task->exec_file_path, '\0', EXEC_FILE_PATH_LEN) || !task->exec_file_path[0])
+        return 0;
 
-    if (prev) {
-        prev->next = node->next;
-    } else if (node->next) {
-        list->head = node->next;
-    } else {
-        list->head = NULL;
-    }
+    if (!field_check(&spec->minute, 0, 59) || !field_check(&spec->hour, 0, 23) || !field_check(&spec->day, 1, 31) ||
+        !field_check(&spec->month, 1, 12) || !field_check(&spec->weekday, 1, 7))
+        return 0;
 
-    timer_delete(node->task.timer_id);
-    free(node);
-    list->count--;
+    return access(task->exec_file_path, F_OK) == 0;
 }
 
-void list_destroy(list_t *list) {
-    if (!list)
-        return;
-
-    node_t *node = list->head;
+// Maps a -ta/-tr/-tia/-tir flag to its timer type, -1 for anything else
+int timer_type_parse(const char *flag) {
+    if (strcmp(flag, ABSOLUTE_TIMER_FLAG) == 0)
+        return ABSOLUTE;
+    if (strcmp(flag, RELATIVE_TIMER_FLAG) == 0)
+        return RELATIVE;
+    if (strcmp(flag, I_RELATIVE_TIMER_FLAG) == 0)
+        return I_RELATIVE;
+    if (strcmp(flag, I_ABSOLUTE_TIMER_FLAG) == 0)
+        return I_ABSOLUTE;
+    return -1;
+}
 
-    while (node) {
-        node_t *next = node->next;
-        timer_delete(node->task.timer_id);
-        free(node);
-        node = next;
+const char *timer_type_name(int timer_type) {
+    switch (timer_type) {
+        case RELATIVE:
+            return "relative";
+        case ABSOLUTE:
+            return "absolute";
+        case I_ABSOLUTE:
+            return "interval absolute";
+        case I_RELATIVE:
+            return "interval relative";
     }
+    return "unknown";
 }
 
-int time_spec_validate(ctime_spec_t *time_spec, char time_data[5][10]) {
-    return minute_validate(&time_spec->minute, time_data[0]) && hour_validate(&time_spec->hour, time_data[1]) &&
-           day_validate(&time_spec->day, time_data[2]) && month_validate(&time_spec->month, time_data[3]) &&
-           weekday_validate(&time_spec->weekday, time_data[4]);
+// Accepts "*", single values, ranges "a-b", lists "a,b" and steps "*/n" or "a-b/n"
+static int field_validate(ctime_spec_val_t *time_spec_val, char *text, int min, int max) {
+    uint64_t mask;
+    if (!cron_field_parse(text, min, max, &mask))
+        return 0;
+
+    time_spec_val->mask = mask;
+    time_spec_val->val = (int8_t) __builtin_ctzll(mask);
+    // Like vixie cron, a day or weekday field starting with "*" does not restrict the day on its own
+    if (strcmp(text, "*") == 0)
+        time_spec_val->is_asterisk = FIELD_ASTERISK;
+    else
+        time_spec_val->is_asterisk = text[0] == '*' ? FIELD_ASTERISK_STEP : 0;
+    return 1;
 }
 
 int minute_validate(ctime_spec_val_t *time_spec_minute, char *minute) {
-    int8_t val = atoi(minute);
-    int is_digit = isdigit(*minute);
-    if (*minute == '*') {
-        time_spec_minute->val = val;
-        time_spec_minute->is_asterisk = 1;
-    } else if (val >= 0 && val <= 59 && is_digit) {
-        time_spec_minute->val = val;
-        time_spec_minute->is_asterisk = 0;
-    } else {
-        return 0;
-    }
-    return 1;
+    return field_validate(time_spec_minute, minute, 0, 59);
 }
 
 int hour_validate(ctime_spec_val_t *time_spec_hour, char *hour) {
-    int8_t val = atoi(hour);
-    int is_digit = isdigit(*hour);
-    if (*hour == '*') {
-        time_spec_hour->val = val;
-        time_spec_hour->is_asterisk = 1;
-    } else if (val >= 0 && val <= 23 && is_digit) {
-        time_spec_hour->val = val;
-        time_spec_hour->is_asterisk = 0;
-    } else {
-        return 0;
-    }
-    return 1;
+    return field_validate(time_spec_hour, hour, 0, 23);
 }
 
 int day_validate(ctime_spec_val_t *time_spec_day, char *day) {
-    int8_t val = atoi(day);
-    int is_digit = isdigit(*day);
-    if (*day == '*') {
-        time_spec_day->val = val;
-        time_spec_day->is_asterisk = 1;
-    } else if (val >= 1 && val <= 31 && is_digit) {
-        time_spec_day->val = val;
-        time_spec_day->is_asterisk = 0;
-    } else {
-        return 0;
-    }
-    return 1;
+    return field_validate(time_spec_day, day, 1, 31);
 }
 
 int month_validate(ctime_spec_val_t *time_spec_month, char *month) {
-    int8_t val = atoi(month);
-    int is_digit = isdigit(*month);
-    if (*month == '*') {
-        time_spec_month->val = val;
-        time_spec_month->is_asterisk = 1;
-    } else if (val >= 1 && val <= 12 && is_digit) {
-        time_spec_month->val = val;
-        time_spec_month->is_asterisk = 0;
-    } else {
-        return 0;
-    }
-    return 1;
+    return field_validate(time_spec_month, month, 1, 12);
 }
 
 int weekday_validate(ctime_spec_val_t *time_spec_weekday, char *weekday) {
-    int8_t val = atoi(weekday);
-    int is_digit = isdigit(*weekday);
-    if (*weekday == '*') {
-        time_spec_weekday->val = val;
-        time_spec_weekday->is_asterisk = 1;
-    } else if (val >= 1 && val <= 7 && is_digit) {
-        time_spec_weekday->val = val;
-        time_spec_weekday->is_asterisk = 0;
-    } else {
-        return 0;
-    }
-    return 1;
+    return field_validate(time_spec_weekday, weekday, 1, 7);
 }
 
 void trim(char *str) {
@@ -423,19 +214,19 @@ void trim(char *str) {
 int time_value(ctime_spec_t *time_spec) {
     int time = 0;
 
-    if (!time_spec->minute.is_asterisk)
+    if (time_spec->minute.is_asterisk != FIELD_ASTERISK)
         time += time_spec->minute.val * 60;
 
-    if (!time_spec->hour.is_asterisk)
+    if (time_spec->hour.is_asterisk != FIELD_ASTERISK)
         time += time_spec->hour.val * 60 * 60;
 
-    if (!time_spec->day.is_asterisk)
+    if (time_spec->day.is_asterisk != FIELD_ASTERISK)
         time += time_spec->day.val * 60 * 60 * 24;
 
-    if (!time_spec->month.is_asterisk)
+    if (time_spec->month.is_asterisk != FIELD_ASTERISK)
         time += time_spec->month.val * 60 * 60 * 24 * 31;
 
-    if (!time_spec->weekday.is_asterisk)
+    if (time_spec->weekday.is_asterisk != FIELD_ASTERISK)
         time += time_spec->weekday.val * 60 * 60 * 24;
 
     if (!time)
@@ -443,3 +234,84 @@ int time_value(ctime_spec_t *time_spec) {
 
     return time;
 }
+
+void time_spec_compile(const ctime_spec_t *time_spec, cron_expr_t *expr) {
+    uint64_t weekdays = time_spec->weekday.mask;
+
+    expr->minutes = time_spec->minute.mask;
+    expr->hours = (uint32_t) time_spec->hour.mask;
+    expr->days = (uint32_t) (time_spec->day.mask >> 1);
+    expr->months = (uint16_t) (time_spec->month.mask >> 1);
+    // Weekdays are 1 (monday) - 7 (sunday) here and 0 (sunday) - 6 in struct tm
+    expr->weekdays = (uint8_t) ((weekdays & 0x7E) | ((weekdays >> 7) & 1));
+    expr->flags = 0;
+    if (time_spec->day.is_asterisk)
+        expr->flags |= CRON_DOM_STAR;
+    if (time_spec->weekday.is_asterisk)
+        expr->flags |= CRON_DOW_STAR;
+}
+
+void time_spec_format(const ctime_spec_t *time_spec, char *buffer, size_t size) {
+    char fields[5][TIME_SPEC_FIELD_LEN];
+
+    cron_field_format(time_spec->minute.mask, 0, 59, fields[0], TIME_SPEC_FIELD_LEN);
+    cron_field_format(time_spec->hour.mask, 0, 23, fields[1], TIME_SPEC_FIELD_LEN);
+    cron_field_format(time_spec->day.mask, 1, 31, fields[2], TIME_SPEC_FIELD_LEN);
+    cron_field_format(time_spec->month.mask, 1, 12, fields[3], TIME_SPEC_FIELD_LEN);
+    cron_field_format(time_spec->weekday.mask, 1, 7, fields[4], TIME_SPEC_FIELD_LEN);
+
+    snprintf(buffer, size, "%s %s %s %s %s", fields[0], fields[1], fields[2], fields[3], fields[4]);
+}
+
+// Absolute tasks follow cron semantics, relative ones count time_value() seconds from now
+time_t task_next_deadline(task_t *task, time_t now) {
+    if (task->timer_type == ABSOLUTE || task->timer_type == I_ABSOLUTE)
+        return cron_next(&task->cron, now);
+    return now + time_value(&task->time_spec);
+}
+
+// Deadline of a task restored after a restart. Interval runs stay in phase with the
+// first deadline, one-shot tasks whose deadline passed while the server was down return 0.
+time_t task_resume_deadline(task_t *task, time_t now) {
+    if (task->timer_type == I_ABSOLUTE)
+        return cron_next(&task->cron, now);
+
+    if (task->anchor > now)
+        return task->anchor;
+
+    if (task->timer_type == I_RELATIVE) {
+        time_t interval = time_value(&task->time_spec);
+        if (interval < 1)
+            return 0;
+        return task->anchor + ((now - task->anchor) / interval + 1) * interval;
+    }
+    return 0;
+}
+
+void task_record_run(task_t *task, const reaper_run_t *run) {
+    task_stats_t *stats = &task->stats;
+
+    stats->runs++;
+    if (!WIFEXITED(run->status) || WEXITSTATUS(run->status) != 0)
+        stats->failures++;
+    stats->last_status = run->status;
+    stats->last_wall_us = run->wall_us;
+    stats->last_cpu_us = run->cpu_us;
+    if (run->max_rss_kb > stats->max_rss_kb)
+        stats->max_rss_kb = run->max_rss_kb;
+    stats->total_lag_us += run->lag_us;
+    if (run->lag_us > stats->max_lag_us)
+        stats->max_lag_us = run->lag_us;
+    stats->total_wall_us += run->wall_us;
+    if (run->wall_us > stats->max_wall_us)
+        stats->max_wall_us = run->wall_us;
+}
+
+size_t env_size(const char *name, size_t default_value) {
+    char *value = getenv(name);
+    if (!value || !isdigit((unsigned char) *value))
+        return default_value;
+
+    long result = atol(value);
+    return result > 0 ? (size_t) result : default_value;
+}
@@ -12,10 +12,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <ctype.h>
+#include <errno.h>
 #include <spawn.h>
 #include "logger.h"
+#include "scheduler.h"
+#include "cron.h"
+#include "spawn_pool.h"
 
 // Defines
 #define PROCESS_SIG (SIGRTMIN)
@@ -23,36 +28,76 @@
 #define TRUE (1)
 #define FALSE (0)
 #define MSG_MAX_COUNT (10)
+#define CLIENT_MSG_MAX_COUNT (4)
+#define CLIENT_OPEN_RETRIES (100)
+#define CLIENT_RETRY_PAUSE_US (10000)
+#define CLIENT_RETRY_MAX_PAUSE_US (200000)
+#define CLIENT_QUEUE_WAIT_US (30000000)
+#define CLIENT_BUSY_RETRIES (8)
 #define MAX_TASKS_COUNT (10)
 #define CLIENT_MQ_NAME_LEN (20)
+#define IMPORT_SHM_NAME_LEN (32)
 #define EXEC_FILE_PATH_LEN (255)
+#define TIME_SPEC_FIELD_LEN (64)
+#define FIELD_ASTERISK (1)
+#define FIELD_ASTERISK_STEP (2)
+#define TASK_TEXT_LEN (5 * TIME_SPEC_FIELD_LEN + EXEC_FILE_PATH_LEN)
+#define TIME_SPEC_STR_LEN (5 * TIME_SPEC_FIELD_LEN)
+#define DURATION_STR_LEN (32)
 #define ADD_FLAG "-a"
 #define LIST_FLAG "-l"
 #define EDIT_FLAG "-e"
 #define DELETE_FLAG "-r"
 #define DESTROY_FLAG "-d"
+#define IMPORT_FLAG "-f"
+#define BATCH_FLAG "-b"
+#define STATS_FLAG "-s"
 #define ABSOLUTE_TIMER_FLAG "-ta"
 #define RELATIVE_TIMER_FLAG "-tr"
 #define I_ABSOLUTE_TIMER_FLAG "-tia"
 #define I_RELATIVE_TIMER_FLAG "-tir"
 
+// Environment
+#define SCHEDULER_ENV "CRON_SCHEDULER"
+#define SPAWN_WORKERS_ENV "CRON_SPAWN_WORKERS"
+#define SPAWN_QUEUE_ENV "CRON_SPAWN_QUEUE"
+#define SPAWNER_ENV "CRON_SPAWNER"
+#define STATE_DIR_ENV "CRON_STATE_DIR"
+#define JOURNAL_SYNC_ENV "CRON_JOURNAL_SYNC"
+#define JOURNAL_COMPACT_ENV "CRON_JOURNAL_COMPACT"
+#define SERVER_WORKERS_ENV "CRON_SERVER_WORKERS"
+#define SERVER_PENDING_ENV "CRON_SERVER_PENDING"
+#define TRANSPORT_ENV "CRON_TRANSPORT"
+#define LOG_MODE_ENV "CRON_LOG_MODE"
+#define LOG_RING_ENV "CRON_LOG_RING"
+#define LOG_TIME_ENV "CRON_LOG_TIME"
+#define LOG_FORMAT_ENV "CRON_LOG_FORMAT"
+#define LOG_ROTATE_SIZE_ENV "CRON_LOG_ROTATE_SIZE"
+#define LOG_ROTATE_INTERVAL_ENV "CRON_LOG_ROTATE_INTERVAL"
+#define LOG_SEGMENTS_ENV "CRON_LOG_SEGMENTS"
+#define LOG_LEVELS_ENV "CRON_LOG_LEVELS"
+#define DUMP_FORMAT_ENV "CRON_DUMP_FORMAT"
+#define METRICS_FILE_ENV "CRON_METRICS_FILE"
+#define METRICS_INTERVAL_ENV "CRON_METRICS_INTERVAL"
+
 // Names
-#define SEM_NAME "/sem_name"
 #define QUEUE_NAME "/queue_name"
 #define CLIENT_QUEUE_PREFIX "/queue_"
+#define SOCKET_NAME "cron_server"
+#define IMPORT_SHM_PREFIX "/cron_import_"
+#define VIEW_SHM_NAME "/cron_tasks"
 
 // Typedefs
 typedef struct mq_attr mq_attr_t;
-typedef struct node_t node_t;
 
 // Enums
 typedef enum {
-    ADD,
-    DELETE,
-    EDIT,
+    BATCH = 1,
+    RESULTS,
     LIST,
-    CLOSE_CLIENT,
-    DESTROY
+    DESTROY,
+    IMPORT,
+    STATS
 } mtype_t;
 
 typedef enum {
@@ -63,7 +108,9 @@ typedef enum {
 } timer_type_t;
 
 // Structures
+// is_asterisk is FIELD_ASTERISK for "*" and FIELD_ASTERISK_STEP for a field such as "*/2"
 typedef struct {
+    uint64_t mask;
     int8_t val;
     int8_t is_asterisk;
 } ctime_spec_val_t;
@@ -77,63 +124,42 @@ typedef struct {
 } ctime_spec_t;
 
 typedef struct {
+    uint64_t runs;
+    uint64_t failures;
+    int last_status;
+    uint64_t last_wall_us;
+    uint64_t last_cpu_us;
+    long max_rss_kb;
+    uint64_t total_lag_us;
+    uint64_t max_lag_us;
+    uint64_t total_wall_us;
+    uint64_t max_wall_us;
+} task_stats_t;
+
+typedef struct {
+    uint64_t id;
     ctime_spec_t time_spec;
+    cron_expr_t cron;
     timer_type_t timer_type;
-    timer_t timer_id;
-    pid_t pid;
+    sched_entry_t sched;
+    time_t anchor;
     int8_t active;
+    task_stats_t stats;
     char exec_file_path[EXEC_FILE_PATH_LEN];
 } task_t;
 
-typedef struct {
-    mtype_t mtype;
-    task_t task;
-    pid_t pid;
-    int idx;
-} msgbuf_t;
-
-typedef struct {
-    task_t task;
-    int is_next;
-} response_t;
-
-struct node_t {
-    task_t task;
-    node_t *next;
-};
-
-typedef struct {
-    node_t *head;
-    int count;
-} list_t;
-
-
-// List methods
-void list_init(list_t *list);
-
-void list_push(list_t *list, task_t task);
-
-void list_pop(list_t *list, task_t *result);
-
-void list_clear(list_t *list);
-
-void list_display(list_t *list);
-
-void list_print_to_file(list_t *list, FILE *f);
-
+// Task methods
 void tasks_display(task_t *tasks, unsigned int n);
 
-int list_size(list_t *list);
+int time_spec_validate(ctime_spec_t *time_spec, char time_data[5][TIME_SPEC_FIELD_LEN]);
 
-void task_edit(list_t *list, task_t task,int idx);
+int task_parse_line(const char *line, size_t length, task_t *task);
 
-int list_is_empty(list_t *list);
+int task_record_validate(const task_t *task);
 
-void list_remove_index(list_t *list, int idx);
+int timer_type_parse(const char *flag);
 
-void list_destroy(list_t *list);
-
-int time_spec_validate(ctime_spec_t *time_spec, char time_data[5][10]);
+const char *timer_type_name(int timer_type);
 
 int minute_validate(ctime_spec_val_t *time_spec_minute, char *minute);
 
@@ -147,6 +173,22 @@ int weekday_validate(ctime_spec_val_t *time_spec_weekday, char *weekday);
 
 void trim(char *str);
 
+void time_spec_compile(const ctime_spec_t *time_spec, cron_expr_t *expr);
+
+void time_spec_format(const ctime_spec_t *time_spec, char *buffer, size_t size);
+
 int time_value(ctime_spec_t *time_spec);
 
+time_t task_next_deadline(task_t *task, time_t now);
+
+time_t task_resume_deadline(task_t *task, time_t now);
+
+void task_record_run(task_t *task, const reaper_run_t *run);
+
+size_t env_size(const char *name, size_t default_value);
+
+time_t task_fire(sched_entry_t *entry, time_t now, void *arg);
+
+time_t task_rearm_deadline(task_t *task, time_t now);
+
 #endif //CRON_CRON_UTILS_H
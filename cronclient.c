@@ -0,0 +1,334 @@
+#include "cronclient.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <limits.h>
+#include <time.h>
+
+typedef struct {
+    int done;
+    proto_header_t *header;
+    proto_buffer_t *reply;
+} call_state_t;
+
+/*
+ * Queue memory is limited per user (RLIMIT_MSGQUEUE), so with many clients
+ * running at once creating the reply queue may fail for a while; that is
+ * waited out with a growing pause instead of failing the connection.
+ */
+static mqd_t queue_create(const char *name) {
+    mq_attr_t mq_attr = {.mq_maxmsg = CLIENT_MSG_MAX_COUNT, .mq_msgsize = PROTO_MAX_MSG, .mq_flags = 0, .mq_curmsgs = 0};
+    useconds_t pause = CLIENT_RETRY_PAUSE_US, waited = 0;
+    mqd_t mqd;
+
+    while ((mqd = mq_open(name, O_CREAT | O_EXCL | O_RDONLY | O_NONBLOCK, 0666, &mq_attr)) == -1 &&
+           (errno == EMFILE || errno == ENOSPC || errno == ENOMEM) && waited < CLIENT_QUEUE_WAIT_US) {
+        usleep(pause);
+        waited += pause;
+        if (pause < CLIENT_RETRY_MAX_PAUSE_US)
+            pause *= 2;
+    }
+    return mqd;
+}
+
+// A socket connection carries both directions, the message queue needs a reply queue of its own
+int cronclient_connect(cronclient_t *client, transport_type_t transport) {
+    if (!client)
+        return -1;
+
+    client->transport = transport;
+    client->pid = getpid();
+    client->queue_name[0] = '\0';
+
+    if (transport == TRANSPORT_SOCKET) {
+        client->server_fd = transport_socket_connect(SOCKET_NAME);
+        if (client->server_fd == -1)
+            return -1;
+        client->reply_fd = client->server_fd;
+    } else {
+        client->server_fd = (int) mq_open(QUEUE_NAME, O_WRONLY);
+        if (client->server_fd == -1)
+            return -1;
+
+        sprintf(client->queue_name, "%s%d", CLIENT_QUEUE_PREFIX, client->pid);
+        client->reply_fd = (int) queue_create(client->queue_name);
+        if (client->reply_fd == -1) {
+            int error = errno;
+            mq_close((mqd_t) client->server_fd);
+            errno = error;
+            return -1;
+        }
+    }
+
+    pthread_mutex_init(&client->mutex, NULL);
+    client->next_id = 1;
+    client->in_flight = 0;
+    client->next_expiry_ms = 0;
+    memset(client->pending, 0, sizeof(client->pending));
+    proto_assembler_init(&client->assembler);
+    proto_buffer_init(&client->payload);
+    return 0;
+}
+
+// Readable whenever cronclient_process() has a reply to deliver
+int cronclient_fd(cronclient_t *client) {
+    return client->reply_fd;
+}
+
+static uint64_t monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+// Returns the id of the request or 0 if it could not be sent
+uint32_t cronclient_submit(cronclient_t *client, uint16_t type, uint32_t count, const void *payload, size_t length,
+                           cronclient_callback_t callback, void *arg) {
+    pthread_mutex_lock(&client->mutex);
+
+    if (client->in_flight == CRONCLIENT_MAX_IN_FLIGHT) {
+        pthread_mutex_unlock(&client->mutex);
+        errno = EAGAIN;
+        return 0;
+    }
+
+    // Ids whose slot still holds an older request are skipped, below the limit one of the next slots is free
+    while (client->pending[client->next_id % CRONCLIENT_MAX_IN_FLIGHT].request_id)
+        client->next_id = client->next_id == UINT32_MAX ? 1 : client->next_id + 1;
+
+    uint32_t id = client->next_id;
+    cronclient_pending_t *pending = &client->pending[id % CRONCLIENT_MAX_IN_FLIGHT];
+    client->next_id = id == UINT32_MAX ? 1 : id + 1;
+
+    // Registered before sending, the reply may be processed by another thread before the send returns
+    pending->request_id = id;
+    pending->type = type;
+    pending->deadline_ms = monotonic_ms() + CRONCLIENT_REQUEST_TIMEOUT_MS;
+    pending->callback = callback;
+    pending->arg = arg;
+    client->in_flight++;
+    if (!client->next_expiry_ms || pending->deadline_ms < client->next_expiry_ms)
+        client->next_expiry_ms = pending->deadline_ms;
+
+    proto_header_t header = {
+            .version = PROTO_VERSION,
+            .type = type,
+            .status = PROTO_OK,
+            .pid = client->pid,
+            .count = count,
+            .request_id = id
+    };
+    size_t offset = 0;
+
+    // Parts of one request must not interleave with another one's, the lock keeps them together
+    if (transport_send_from(client->transport, client->server_fd, &header, payload, length, &offset) != 0) {
+        pending->request_id = 0;
+        client->in_flight--;
+        id = 0;
+    }
+
+    pthread_mutex_unlock(&client->mutex);
+    return id;
+}
+
+uint32_t cronclient_batch(cronclient_t *client, const proto_buffer_t *batch, cronclient_callback_t callback,
+                          void *arg) {
+    return cronclient_submit(client, BATCH, batch->count, batch->data, batch->length, callback, arg);
+}
+
+uint32_t cronclient_list(cronclient_t *client, uint64_t cursor, uint32_t limit, cronclient_callback_t callback,
+                         void *arg) {
+    proto_list_request_t list = {.cursor = cursor, .limit = limit};
+    return cronclient_submit(client, LIST, 1, &list, sizeof(list), callback, arg);
+}
+
+// TASK_ID_ALL asks for the server-wide histograms
+uint32_t cronclient_stats(cronclient_t *client, uint64_t task_id, cronclient_callback_t callback, void *arg) {
+    return cronclient_submit(client, STATS, 1, &task_id, sizeof(task_id), callback, arg);
+}
+
+// Shortens timeout_ms so that a wait ends when the oldest pending request expires
+static int expiry_wait(cronclient_t *client, int timeout_ms) {
+    pthread_mutex_lock(&client->mutex);
+    if (client->in_flight && client->next_expiry_ms) {
+        uint64_t now = monotonic_ms();
+        uint64_t remaining = client->next_expiry_ms > now ? client->next_expiry_ms - now : 0;
+        if (remaining > INT_MAX)
+            remaining = INT_MAX;
+        if (timeout_ms < 0 || (int) remaining < timeout_ms)
+            timeout_ms = (int) remaining;
+    }
+    pthread_mutex_unlock(&client->mutex);
+    return timeout_ms;
+}
+
+// Completes the requests whose deadline passed with PROTO_TIMEOUT, a reply arriving later is ignored
+static int expire_pending(cronclient_t *client) {
+    uint64_t now = monotonic_ms(), next = 0;
+    int completed = 0;
+
+    pthread_mutex_lock(&client->mutex);
+    if (!client->in_flight || !client->next_expiry_ms || client->next_expiry_ms > now) {
+        pthread_mutex_unlock(&client->mutex);
+        return 0;
+    }
+
+    client->next_expiry_ms = 0;
+    for (size_t i = 0; i < CRONCLIENT_MAX_IN_FLIGHT; ++i) {
+        cronclient_pending_t *pending = &client->pending[i];
+        if (!pending->request_id)
+            continue;
+        if (pending->deadline_ms > now) {
+            if (!next || pending->deadline_ms < next)
+                next = pending->deadline_ms;
+            continue;
+        }
+
+        cronclient_pending_t expired = *pending;
+        pending->request_id = 0;
+        client->in_flight--;
+        pthread_mutex_unlock(&client->mutex);
+
+        proto_buffer_reset(&client->payload);
+        cronclient_completion_t completion = {
+                .request_id = expired.request_id,
+                .type = expired.type,
+                .status = PROTO_TIMEOUT,
+                .count = 0,
+                .payload = &client->payload
+        };
+        if (expired.callback)
+            expired.callback(client, &completion, expired.arg);
+        completed++;
+
+        pthread_mutex_lock(&client->mutex);
+    }
+
+    // Requests submitted while the callbacks ran have already lowered next_expiry_ms themselves
+    if (next && (!client->next_expiry_ms || next < client->next_expiry_ms))
+        client->next_expiry_ms = next;
+    pthread_mutex_unlock(&client->mutex);
+    return completed;
+}
+
+/*
+ * Delivers the replies that arrived and expires requests that waited too
+ * long, waiting up to timeout_ms (-1 without limit, but never past the
+ * next expiry) for the first one. Returns the number of completed requests.
+ */
+int cronclient_process(cronclient_t *client, int timeout_ms) {
+    if (timeout_ms != 0) {
+        struct pollfd poll_fd = {.fd = cronclient_fd(client), .events = POLLIN};
+        int ready = poll(&poll_fd, 1, expiry_wait(client, timeout_ms));
+        if (ready == -1)
+            return errno == EINTR ? 0 : -1;
+        if (ready == 0)
+            return expire_pending(client);
+    }
+
+    char message[TRANSPORT_MAX_MSG];
+    proto_header_t header;
+    ssize_t length;
+    int completed = 0;
+
+    while ((length = transport_recv(client->transport, client->reply_fd, message, sizeof(message))) != -1) {
+        int assembled = proto_assemble(&client->assembler, message, (size_t) length, &header, &client->payload);
+        if (assembled == 0)
+            continue;
+
+        cronclient_completion_t completion = {
+                .request_id = header.request_id,
+                .type = header.type,
+                .status = header.status,
+                .count = header.count,
+                .payload = &client->payload
+        };
+
+        // A reply that cannot be joined still completes its request, with an empty payload
+        if (assembled == -1) {
+            if (length < (ssize_t) sizeof(proto_header_t))
+                continue;
+            proto_buffer_reset(&client->payload);
+            completion.status = header.version != PROTO_VERSION ? PROTO_UNSUPPORTED : PROTO_INVALID;
+            completion.count = 0;
+        }
+
+        pthread_mutex_lock(&client->mutex);
+        cronclient_pending_t pending = client->pending[header.request_id % CRONCLIENT_MAX_IN_FLIGHT];
+        if (header.request_id && pending.request_id == header.request_id) {
+            client->pending[header.request_id % CRONCLIENT_MAX_IN_FLIGHT].request_id = 0;
+            client->in_flight--;
+        } else {
+            pending.request_id = 0;
+        }
+        pthread_mutex_unlock(&client->mutex);
+
+        if (!pending.request_id)
+            continue;
+        if (pending.callback)
+            pending.callback(client, &completion, pending.arg);
+        completed++;
+    }
+
+    if (errno != EAGAIN)
+        return -1;
+    return completed + expire_pending(client);
+}
+
+static void call_done(cronclient_t *client, const cronclient_completion_t *completion, void *arg) {
+    call_state_t *state = (call_state_t *) arg;
+
+    state->header->version = PROTO_VERSION;
+    state->header->type = completion->type;
+    state->header->status = (uint16_t) completion->status;
+    state->header->pid = client->pid;
+    state->header->count = completion->count;
+    state->header->request_id = completion->request_id;
+
+    proto_buffer_reset(state->reply);
+    state->done = proto_buffer_append(state->reply, completion->payload->data, completion->payload->length) == 0 ? 1 : -1;
+    state->reply->count = completion->count;
+}
+
+/*
+ * Sends a request and waits for its reply, delivering the completions of
+ * other requests that arrive meanwhile. A PROTO_BUSY answer is retried
+ * after a growing pause.
+ */
+int cronclient_call(cronclient_t *client, uint16_t type, uint32_t count, const void *payload, size_t length,
+                    proto_header_t *header, proto_buffer_t *reply) {
+    useconds_t pause = CLIENT_RETRY_PAUSE_US;
+
+    for (int attempt = 0;; ++attempt) {
+        call_state_t state = {.done = 0, .header = header, .reply = reply};
+
+        if (!cronclient_submit(client, type, count, payload, length, call_done, &state))
+            return -1;
+        while (!state.done)
+            if (cronclient_process(client, -1) == -1)
+                return -1;
+
+        if (state.done == -1)
+            return -1;
+        if (header->status != PROTO_BUSY || attempt == CLIENT_BUSY_RETRIES)
+            return 0;
+
+        usleep(pause);
+        pause *= 2;
+    }
+}
+
+void cronclient_close(cronclient_t *client) {
+    if (client->transport == TRANSPORT_SOCKET) {
+        close(client->server_fd);
+    } else {
+        mq_close((mqd_t) client->reply_fd);
+        mq_unlink(client->queue_name);
+        mq_close((mqd_t) client->server_fd);
+    }
+    proto_assembler_destroy(&client->assembler);
+    proto_buffer_free(&client->payload);
+    pthread_mutex_destroy(&client->mutex);
+}
@@ -0,0 +1,90 @@
+#ifndef CRON_CRONCLIENT_H
+#define CRON_CRONCLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "cron_utils.h"
+#include "protocol.h"
+#include "transport.h"
+
+// Defines
+#define CRONCLIENT_MAX_IN_FLIGHT (1024)
+#define CRONCLIENT_REQUEST_TIMEOUT_MS (60000)
+
+// Structures
+typedef struct cronclient cronclient_t;
+
+// A finished request, payload is only valid until the callback returns
+typedef struct {
+    uint32_t request_id;
+    uint16_t type;
+    proto_status_t status;
+    uint32_t count;
+    const proto_buffer_t *payload;
+} cronclient_completion_t;
+
+typedef void (*cronclient_callback_t)(cronclient_t *client, const cronclient_completion_t *completion, void *arg);
+
+typedef struct {
+    uint32_t request_id;
+    uint16_t type;
+    uint64_t deadline_ms;
+    cronclient_callback_t callback;
+    void *arg;
+} cronclient_pending_t;
+
+/*
+ * Persistent connection to the cron server. The reply queue is created
+ * once and kept for the life of the connection, every request is tagged
+ * with an id and any number of them (up to CRONCLIENT_MAX_IN_FLIGHT) may
+ * be in flight at once. Completions are delivered to the request's
+ * callback from cronclient_process(), which callers either run in their
+ * own loop when cronclient_fd() becomes readable or let block on its own.
+ * A request that gets no reply within CRONCLIENT_REQUEST_TIMEOUT_MS (the
+ * server drops replies a client does not read in time) is completed with
+ * PROTO_TIMEOUT, so its slot is not held forever.
+ * Sending is thread-safe, cronclient_process() must not run in two
+ * threads at once. The server joins split messages by pid and request
+ * id, but on the message queue it addresses replies by pid, so a process
+ * has one connection.
+ */
+struct cronclient {
+    transport_type_t transport;
+    int server_fd;
+    int reply_fd;
+    pid_t pid;
+    char queue_name[CLIENT_MQ_NAME_LEN];
+    pthread_mutex_t mutex;
+    uint32_t next_id;
+    size_t in_flight;
+    uint64_t next_expiry_ms;
+    cronclient_pending_t pending[CRONCLIENT_MAX_IN_FLIGHT];
+    proto_assembler_t assembler;
+    proto_buffer_t payload;
+};
+
+// Client methods
+int cronclient_connect(cronclient_t *client, transport_type_t transport);
+
+int cronclient_fd(cronclient_t *client);
+
+uint32_t cronclient_submit(cronclient_t *client, uint16_t type, uint32_t count, const void *payload, size_t length,
+                           cronclient_callback_t callback, void *arg);
+
+uint32_t cronclient_batch(cronclient_t *client, const proto_buffer_t *batch, cronclient_callback_t callback,
+                          void *arg);
+
+uint32_t cronclient_list(cronclient_t *client, uint64_t cursor, uint32_t limit, cronclient_callback_t callback,
+                         void *arg);
+
+uint32_t cronclient_stats(cronclient_t *client, uint64_t task_id, cronclient_callback_t callback, void *arg);
+
+int cronclient_process(cronclient_t *client, int timeout_ms);
+
+int cronclient_call(cronclient_t *client, uint16_t type, uint32_t count, const void *payload, size_t length,
+                    proto_header_t *header, proto_buffer_t *reply);
+
+void cronclient_close(cronclient_t *client);
+
+#endif //CRON_CRONCLIENT_H
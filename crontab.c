@@ -0,0 +1,161 @@
+#include "crontab.h"
+#include <sys/stat.h>
+
+typedef struct {
+    const char *begin;
+    const char *end;
+    task_t *tasks;
+    size_t count;
+    size_t lines;
+    size_t *errors;
+    size_t error_count;
+    int failed;
+} crontab_chunk_t;
+
+static void *crontab_parse_func(void *arg) {
+    crontab_chunk_t *chunk = (crontab_chunk_t *) arg;
+    size_t capacity = 1;
+
+    for (const char *p = chunk->begin; (p = memchr(p, '\n', chunk->end - p)); ++p)
+        capacity++;
+
+    chunk->tasks = malloc(capacity * sizeof(task_t));
+    chunk->errors = malloc(CRONTAB_MAX_REPORTED_ERRORS * sizeof(size_t));
+    if (!chunk->tasks || !chunk->errors) {
+        chunk->failed = 1;
+        return NULL;
+    }
+
+    const char *line = chunk->begin;
+    while (line < chunk->end) {
+        const char *next = memchr(line, '\n', chunk->end - line);
+        if (!next)
+            next = chunk->end;
+
+        int result = task_parse_line(line, next - line, &chunk->tasks[chunk->count]);
+        if (result == 1) {
+            chunk->count++;
+        } else if (result == -1) {
+            if (chunk->error_count < CRONTAB_MAX_REPORTED_ERRORS)
+                chunk->errors[chunk->error_count] = chunk->lines;
+            chunk->error_count++;
+        }
+
+        chunk->lines++;
+        line = next + 1;
+    }
+
+    return NULL;
+}
+
+int crontab_load(crontab_t *crontab, const char *filename, size_t threads) {
+    crontab_chunk_t chunks[CRONTAB_MAX_THREADS];
+    pthread_t workers[CRONTAB_MAX_THREADS];
+    struct stat st;
+
+    crontab->tasks = NULL;
+    crontab->count = 0;
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        printf("Failed to open %s.\n", filename);
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t) st.st_size;
+    if (size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Failed to map %s.\n", filename);
+        return -1;
+    }
+
+    if (threads < 1)
+        threads = 1;
+    if (threads > CRONTAB_MAX_THREADS)
+        threads = CRONTAB_MAX_THREADS;
+    if (threads > size / CRONTAB_MIN_CHUNK + 1)
+        threads = size / CRONTAB_MIN_CHUNK + 1;
+
+    // Chunk borders are moved forward to the next line start so no line is split
+    const char *begin = data, *end = data + size;
+    size_t count = 0;
+    while (begin < end && count < threads) {
+        const char *chunk_end = begin + (size_t) (end - begin) / (threads - count);
+        if (chunk_end < end) {
+            chunk_end = memchr(chunk_end, '\n', end - chunk_end);
+            chunk_end = chunk_end ? chunk_end + 1 : end;
+        }
+        if (count == threads - 1)
+            chunk_end = end;
+
+        chunks[count] = (crontab_chunk_t) {.begin = begin, .end = chunk_end};
+        begin = chunk_end;
+        count++;
+    }
+
+    size_t started = 0;
+    for (size_t i = 1; i < count; ++i, ++started)
+        if (pthread_create(&workers[i], NULL, crontab_parse_func, &chunks[i]) != 0)
+            break;
+    crontab_parse_func(&chunks[0]);
+    for (size_t i = 1; i <= started; ++i)
+        pthread_join(workers[i], NULL);
+    // Chunks whose thread could not be started are parsed here
+    for (size_t i = started + 1; i < count; ++i)
+        crontab_parse_func(&chunks[i]);
+
+    size_t total = 0, errors = 0, line = 1;
+    int result = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (chunks[i].failed)
+            result = -1;
+        for (size_t j = 0; j < chunks[i].error_count; ++j) {
+            if (errors < CRONTAB_MAX_REPORTED_ERRORS && j < CRONTAB_MAX_REPORTED_ERRORS)
+                printf("Incorrect task at line %lu.\n", line + chunks[i].errors[j]);
+            errors++;
+        }
+        total += chunks[i].count;
+        line += chunks[i].lines;
+    }
+
+    if (errors > CRONTAB_MAX_REPORTED_ERRORS)
+        printf("%lu incorrect lines in total.\n", errors);
+    if (errors)
+        result = -1;
+
+    if (result == 0 && total) {
+        crontab->tasks = malloc(total * sizeof(task_t));
+        if (!crontab->tasks) {
+            result = -1;
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                memcpy(crontab->tasks + crontab->count, chunks[i].tasks, chunks[i].count * sizeof(task_t));
+                crontab->count += chunks[i].count;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        free(chunks[i].tasks);
+        free(chunks[i].errors);
+    }
+    munmap((void *) data, size);
+    return result;
+}
+
+void crontab_free(crontab_t *crontab) {
+    if (!crontab)
+        return;
+
+    free(crontab->tasks);
+    crontab->tasks = NULL;
+    crontab->count = 0;
+}
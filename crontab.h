@@ -0,0 +1,28 @@
+#ifndef CRON_CRONTAB_H
+#define CRON_CRONTAB_H
+
+#include "cron_utils.h"
+
+// Defines
+#define CRONTAB_MAX_THREADS (64)
+#define CRONTAB_MIN_CHUNK (64 * 1024)
+#define CRONTAB_MAX_REPORTED_ERRORS (20)
+
+// Structures
+typedef struct {
+    task_t *tasks;
+    size_t count;
+} crontab_t;
+
+/*
+ * Loads a crontab-style file ("min h d m wd path" per line, '#' comments)
+ * into interval absolute tasks. The file is mmapped and split into chunks
+ * on line boundaries which are parsed on separate threads, then joined in
+ * file order. Invalid lines are reported with their line numbers and make
+ * the whole load fail.
+ */
+int crontab_load(crontab_t *crontab, const char *filename, size_t threads);
+
+void crontab_free(crontab_t *crontab);
+
+#endif //CRON_CRONTAB_H
@@ -0,0 +1,469 @@
+#include "journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+// Word-at-a-time multiplicative hash, only meant to catch torn or partially written records
+static uint32_t journal_checksum(const void *data, size_t size, uint32_t seed) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    uint64_t hash = 0xCBF29CE484222325ull ^ seed;
+    uint64_t word;
+
+    for (; size >= sizeof(word); size -= sizeof(word), bytes += sizeof(word)) {
+        memcpy(&word, bytes, sizeof(word));
+        hash = (hash ^ word) * 0x100000001B3ull;
+        hash ^= hash >> 29;
+    }
+    for (; size; --size, ++bytes)
+        hash = (hash ^ *bytes) * 0x100000001B3ull;
+
+    return (uint32_t) (hash ^ (hash >> 32));
+}
+
+static void task_to_record(const task_t *task, journal_task_t *record) {
+    memset(record, 0, sizeof(journal_task_t));
+    record->id = task->id;
+    record->anchor = task->anchor;
+    record->timer_type = task->timer_type;
+    record->time_spec = task->time_spec;
+    memcpy(record->exec_file_path, task->exec_file_path, strnlen(task->exec_file_path, EXEC_FILE_PATH_LEN - 1));
+}
+
+static void record_to_task(const journal_task_t *record, task_t *task) {
+    memset(task, 0, sizeof(task_t));
+    task->id = record->id;
+    task->anchor = record->anchor;
+    task->timer_type = (timer_type_t) record->timer_type;
+    task->time_spec = record->time_spec;
+    memcpy(task->exec_file_path, record->exec_file_path, EXEC_FILE_PATH_LEN);
+    task->exec_file_path[EXEC_FILE_PATH_LEN - 1] = '\0';
+}
+
+static int journal_path(journal_t *journal, const char *name, char *path) {
+    if (snprintf(path, JOURNAL_PATH_LEN, "%s/%s", journal->dir, name) >= JOURNAL_PATH_LEN) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+// Maps a whole file read-only, *size is 0 and NULL returned when it is missing or empty
+static void *journal_map(journal_t *journal, const char *name, size_t *size) {
+    char path[JOURNAL_PATH_LEN];
+    struct stat st;
+
+    *size = 0;
+    if (journal_path(journal, name, path) == -1)
+        return NULL;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    madvise(data, (size_t) st.st_size, MADV_SEQUENTIAL);
+    *size = (size_t) st.st_size;
+    return data;
+}
+
+static void recover_snapshot(journal_t *journal) {
+    size_t size;
+    const char *data = journal_map(journal, SNAPSHOT_FILE_NAME, &size);
+    if (!data)
+        return;
+
+    const snapshot_header_t *header = (const snapshot_header_t *) data;
+    const journal_task_t *records = (const journal_task_t *) (data + sizeof(snapshot_header_t));
+
+    if (size < sizeof(snapshot_header_t) || header->magic != SNAPSHOT_MAGIC || header->version != JOURNAL_VERSION ||
+        header->count > (size - sizeof(snapshot_header_t)) / sizeof(journal_task_t) ||
+        journal_checksum(records, header->count * sizeof(journal_task_t), SNAPSHOT_MAGIC) != header->checksum) {
+        printf("Snapshot is damaged, ignoring it.\n");
+    } else {
+        task_t task;
+        task_table_reserve(journal->table, task_table_size(journal->table) + header->count);
+        for (uint64_t i = 0; i < header->count; ++i) {
+            record_to_task(&records[i], &task);
+            task_table_restore(journal->table, &task);
+        }
+        if (header->next_id > journal->table->next_id)
+            journal->table->next_id = header->next_id;
+    }
+
+    munmap((void *) data, size);
+}
+
+// A batch is replayed only if every one of its operations can be, a single unknown one means it is damaged
+static int batch_record_check(const journal_batch_record_t *records, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        if (records[i].op != JOURNAL_ADD && records[i].op != JOURNAL_EDIT && records[i].op != JOURNAL_DELETE)
+            return 0;
+    return count > 0;
+}
+
+// Replays the journal on top of the snapshot and returns the length of its valid prefix
+static size_t recover_journal(journal_t *journal) {
+    size_t size;
+    const char *data = journal_map(journal, JOURNAL_FILE_NAME, &size);
+    if (!data)
+        return 0;
+
+    size_t offset = 0;
+    task_t task;
+
+    while (size - offset >= sizeof(journal_header_t)) {
+        const journal_header_t *header = (const journal_header_t *) (data + offset);
+        const char *payload = data + offset + sizeof(journal_header_t);
+
+        if (header->magic != JOURNAL_MAGIC || header->version != JOURNAL_VERSION ||
+            header->length > size - offset - sizeof(journal_header_t) ||
+            journal_checksum(payload, header->length, header->op) != header->checksum)
+            break;
+
+        if ((header->op == JOURNAL_ADD || header->op == JOURNAL_EDIT) && header->length == sizeof(journal_task_t)) {
+            record_to_task((const journal_task_t *) payload, &task);
+            task_table_restore(journal->table, &task);
+        } else if (header->op == JOURNAL_IMPORT && header->length % sizeof(journal_task_t) == 0) {
+            const journal_task_t *records = (const journal_task_t *) payload;
+            size_t count = header->length / sizeof(journal_task_t);
+
+            task_table_reserve(journal->table, task_table_size(journal->table) + count);
+            for (size_t i = 0; i < count; ++i) {
+                record_to_task(&records[i], &task);
+                task_table_restore(journal->table, &task);
+            }
+        } else if (header->op == JOURNAL_DELETE && header->length == sizeof(uint64_t)) {
+            uint64_t id;
+            memcpy(&id, payload, sizeof(id));
+            if (id == TASK_ID_ALL)
+                task_table_clear(journal->table);
+            else
+                task_table_remove(journal->table, id);
+        } else if (header->op == JOURNAL_BATCH && header->length % sizeof(journal_batch_record_t) == 0 &&
+                   batch_record_check((const journal_batch_record_t *) payload,
+                                      header->length / sizeof(journal_batch_record_t))) {
+            const journal_batch_record_t *records = (const journal_batch_record_t *) payload;
+            size_t count = header->length / sizeof(journal_batch_record_t);
+
+            for (size_t i = 0; i < count; ++i) {
+                if (records[i].op == JOURNAL_DELETE && records[i].task.id == TASK_ID_ALL) {
+                    task_table_clear(journal->table);
+                } else if (records[i].op == JOURNAL_DELETE) {
+                    task_table_remove(journal->table, records[i].task.id);
+                } else {
+                    record_to_task(&records[i].task, &task);
+                    task_table_restore(journal->table, &task);
+                }
+            }
+        } else {
+            break;
+        }
+
+        offset += sizeof(journal_header_t) + header->length;
+        if (header->op == JOURNAL_IMPORT)
+            journal->records += header->length / sizeof(journal_task_t);
+        else if (header->op == JOURNAL_BATCH)
+            journal->records += header->length / sizeof(journal_batch_record_t);
+        else
+            journal->records++;
+    }
+
+    if (offset != size)
+        printf("Journal has a damaged tail, dropping %lu bytes.\n", size - offset);
+
+    munmap((void *) data, size);
+    return offset;
+}
+
+// Cuts off a record that failed, records appended after torn bytes would be lost on replay
+static void journal_discard(journal_t *journal) {
+    if (ftruncate(journal->fd, (off_t) journal->size) == -1)
+        perror("Failed to truncate journal");
+}
+
+static int journal_append(journal_t *journal, journal_op_t op, const void *payload, uint32_t length,
+                          size_t records) {
+    journal_header_t header = {
+            .magic = JOURNAL_MAGIC,
+            .version = JOURNAL_VERSION,
+            .op = (uint16_t) op,
+            .length = length,
+            .checksum = journal_checksum(payload, length, op)
+    };
+    struct iovec iov[2] = {
+            {.iov_base = &header, .iov_len = sizeof(header)},
+            {.iov_base = (void *) payload, .iov_len = length}
+    };
+
+    // One write per record, so a crash can only tear the last one
+    ssize_t written = writev(journal->fd, iov, 2);
+    if (written != (ssize_t) (sizeof(header) + length)) {
+        if (written != -1)
+            errno = EIO;
+        perror("Failed to write journal");
+        journal_discard(journal);
+        return -1;
+    }
+
+    // Imports and batches are acknowledged as durable, so a failed sync fails them too
+    int durable = op == JOURNAL_IMPORT || op == JOURNAL_BATCH;
+    if (journal->unsynced + records >= journal->sync_every || durable) {
+        if (fdatasync(journal->fd) == -1) {
+            perror("Failed to sync journal");
+            if (durable) {
+                journal_discard(journal);
+                return -1;
+            }
+        }
+        journal->unsynced = 0;
+    } else {
+        journal->unsynced += records;
+    }
+
+    journal->size += sizeof(header) + length;
+    journal->records += records;
+
+    // The record is already durable, a failed compaction only leaves a longer journal to replay
+    if (journal->records >= journal->compact_after)
+        journal_compact(journal);
+    return 0;
+}
+
+int journal_open(journal_t *journal, const char *dir, task_table_t *table, size_t sync_every, size_t compact_after) {
+    if (!journal)
+        return -1;
+
+    journal->fd = -1;
+    journal->dir_fd = -1;
+    if (!dir || !table || sync_every < 1 || compact_after < 1)
+        return -1;
+
+    if (strlen(dir) >= JOURNAL_PATH_LEN - sizeof(SNAPSHOT_TMP_FILE_NAME) - 1) {
+        printf("State directory path is too long.\n");
+        return -1;
+    }
+
+    strcpy(journal->dir, dir);
+    journal->table = table;
+    journal->records = 0;
+    journal->size = 0;
+    journal->unsynced = 0;
+    journal->sync_every = sync_every;
+    journal->compact_after = compact_after;
+
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+        perror("Failed to create state directory");
+        return -1;
+    }
+
+    journal->dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (journal->dir_fd == -1) {
+        perror("Failed to open state directory");
+        return -1;
+    }
+
+    return 0;
+}
+
+int journal_recover(journal_t *journal) {
+    char path[JOURNAL_PATH_LEN];
+
+    if (!journal || journal->fd != -1)
+        return -1;
+
+    recover_snapshot(journal);
+    size_t valid = recover_journal(journal);
+
+    if (journal_path(journal, JOURNAL_FILE_NAME, path) == -1)
+        return -1;
+
+    journal->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (journal->fd == -1) {
+        perror("Failed to open journal");
+        return -1;
+    }
+
+    // Appending after a torn record would hide everything written later
+    if (ftruncate(journal->fd, (off_t) valid) == -1) {
+        perror("Failed to truncate journal");
+        return -1;
+    }
+    journal->size = valid;
+
+    if (task_table_schedule_all(journal->table, scheduler_now(journal->table->scheduler)) == -1) {
+        printf("Failed to schedule restored tasks.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int journal_log_task(journal_t *journal, journal_op_t op, const task_t *task) {
+    journal_task_t record;
+
+    if (!journal || journal->fd == -1 || !task)
+        return -1;
+
+    task_to_record(task, &record);
+    return journal_append(journal, op, &record, sizeof(record), 1);
+}
+
+// Writes a whole import as one record, so after a crash it is replayed either completely or not at all
+int journal_log_import(journal_t *journal, task_t **tasks, size_t count) {
+    if (!journal || journal->fd == -1 || !tasks || !count)
+        return -1;
+
+    if (count > UINT32_MAX / sizeof(journal_task_t)) {
+        printf("Import is too large for one journal record.\n");
+        return -1;
+    }
+
+    journal_task_t *records = malloc(count * sizeof(journal_task_t));
+    if (!records) {
+        perror("malloc failed");
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        task_to_record(tasks[i], &records[i]);
+
+    int result = journal_append(journal, JOURNAL_IMPORT, records, (uint32_t) (count * sizeof(journal_task_t)), count);
+    free(records);
+    return result;
+}
+
+int journal_log_delete(journal_t *journal, uint64_t id) {
+    if (!journal || journal->fd == -1)
+        return -1;
+
+    return journal_append(journal, JOURNAL_DELETE, &id, sizeof(id), 1);
+}
+
+// Writes a whole BATCH request as one record, the request is acknowledged only once it is synced
+int journal_log_batch(journal_t *journal, const journal_batch_op_t *ops, size_t count) {
+    if (!journal || journal->fd == -1 || !ops || !count)
+        return -1;
+
+    if (count > UINT32_MAX / sizeof(journal_batch_record_t)) {
+        printf("Batch is too large for one journal record.\n");
+        return -1;
+    }
+
+    journal_batch_record_t *records = malloc(count * sizeof(journal_batch_record_t));
+    if (!records) {
+        perror("malloc failed");
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        records[i].op = (uint32_t) ops[i].op;
+        records[i].reserved = 0;
+        if (ops[i].task) {
+            task_to_record(ops[i].task, &records[i].task);
+        } else {
+            memset(&records[i].task, 0, sizeof(journal_task_t));
+            records[i].task.id = ops[i].id;
+        }
+    }
+
+    int result = journal_append(journal, JOURNAL_BATCH, records, (uint32_t) (count * sizeof(journal_batch_record_t)),
+                                count);
+    free(records);
+    return result;
+}
+
+int journal_compact(journal_t *journal) {
+    char tmp_path[JOURNAL_PATH_LEN], path[JOURNAL_PATH_LEN];
+
+    if (!journal || journal->fd == -1 || journal_path(journal, SNAPSHOT_TMP_FILE_NAME, tmp_path) == -1 ||
+        journal_path(journal, SNAPSHOT_FILE_NAME, path) == -1)
+        return -1;
+
+    // Records are staged in one buffer so the checksum can be computed before anything is written
+    size_t count = 0, cursor = 0;
+    size_t size = sizeof(snapshot_header_t) + task_table_size(journal->table) * sizeof(journal_task_t);
+    char *buffer = malloc(size);
+    if (!buffer) {
+        perror("malloc failed");
+        return -1;
+    }
+
+    journal_task_t *records = (journal_task_t *) (buffer + sizeof(snapshot_header_t));
+    task_t *task;
+    while ((task = task_table_next(journal->table, &cursor)))
+        task_to_record(task, &records[count++]);
+
+    snapshot_header_t header = {
+            .magic = SNAPSHOT_MAGIC,
+            .version = JOURNAL_VERSION,
+            .count = count,
+            .next_id = journal->table->next_id,
+            .checksum = journal_checksum(records, count * sizeof(journal_task_t), SNAPSHOT_MAGIC)
+    };
+    memcpy(buffer, &header, sizeof(header));
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int result = fd == -1 ? -1 : 0;
+    for (size_t written = 0; result == 0 && written < size;) {
+        ssize_t n = write(fd, buffer + written, size - written);
+        if (n == -1 && errno != EINTR)
+            result = -1;
+        else if (n > 0)
+            written += (size_t) n;
+    }
+    if (result == 0 && fsync(fd) == -1)
+        result = -1;
+
+    free(buffer);
+    if (fd != -1)
+        close(fd);
+
+    // The rename is the commit point, a crash before it leaves the previous snapshot intact
+    if (result == -1 || rename(tmp_path, path) == -1) {
+        perror("Failed to write snapshot");
+        unlink(tmp_path);
+        return -1;
+    }
+    fsync(journal->dir_fd);
+
+    // Everything in the journal is now covered by the snapshot
+    if (ftruncate(journal->fd, 0) == -1) {
+        perror("Failed to truncate journal");
+        return -1;
+    }
+    fdatasync(journal->fd);
+    journal->records = 0;
+    journal->size = 0;
+    journal->unsynced = 0;
+    return 0;
+}
+
+void journal_close(journal_t *journal) {
+    if (!journal)
+        return;
+
+    if (journal->fd != -1) {
+        fdatasync(journal->fd);
+        close(journal->fd);
+        journal->fd = -1;
+    }
+    if (journal->dir_fd != -1) {
+        close(journal->dir_fd);
+        journal->dir_fd = -1;
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef CRON_JOURNAL_H
+#define CRON_JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "task_table.h"
+
+// Defines
+#define JOURNAL_MAGIC (0x4C4E524Au)
+#define SNAPSHOT_MAGIC (0x504E534Au)
+#define JOURNAL_VERSION (1)
+#define JOURNAL_PATH_LEN (512)
+#define JOURNAL_FILE_NAME "journal.bin"
+#define SNAPSHOT_FILE_NAME "snapshot.bin"
+#define SNAPSHOT_TMP_FILE_NAME "snapshot.tmp"
+#define JOURNAL_DEFAULT_DIR ".cron_state"
+#define JOURNAL_DEFAULT_SYNC_EVERY (32)
+#define JOURNAL_DEFAULT_COMPACT_AFTER (10000)
+
+// Enums
+typedef enum {
+    JOURNAL_ADD = 1,
+    JOURNAL_EDIT,
+    JOURNAL_DELETE,
+    JOURNAL_IMPORT,
+    JOURNAL_BATCH
+} journal_op_t;
+
+// Structures
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t op;
+    uint32_t length;
+    uint32_t checksum;
+} journal_header_t;
+
+// On-disk form of a task, shared by journal records and snapshots
+typedef struct {
+    uint64_t id;
+    int64_t anchor;
+    int32_t timer_type;
+    int32_t reserved;
+    ctime_spec_t time_spec;
+    char exec_file_path[EXEC_FILE_PATH_LEN];
+} journal_task_t;
+
+// One operation of a JOURNAL_BATCH record, a DELETE only uses task.id
+typedef struct {
+    uint32_t op;
+    uint32_t reserved;
+    journal_task_t task;
+} journal_batch_record_t;
+
+// An operation to log with journal_log_batch, task is the state after it and NULL for a DELETE
+typedef struct {
+    journal_op_t op;
+    uint64_t id;
+    const task_t *task;
+} journal_batch_op_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t count;
+    uint64_t next_id;
+    uint32_t checksum;
+    uint32_t reserved2;
+} snapshot_header_t;
+
+/*
+ * Keeps the task table across restarts. Every ADD, EDIT and DELETE is
+ * appended to a checksummed journal; once the journal grows past
+ * compact_after records the whole table is written to a snapshot (through
+ * a temporary file and rename) and the journal is truncated. Records are
+ * written immediately and fdatasync'ed every sync_every records, so a
+ * crash of the server loses nothing and a power loss at most that batch.
+ * Imports and BATCH requests are written as one record each and synced
+ * right away, so they are replayed either completely or not at all.
+ */
+typedef struct {
+    int fd;
+    int dir_fd;
+    char dir[JOURNAL_PATH_LEN];
+    size_t records;
+    size_t size;
+    size_t unsynced;
+    size_t sync_every;
+    size_t compact_after;
+    task_table_t *table;
+} journal_t;
+
+// Journal methods
+int journal_open(journal_t *journal, const char *dir, task_table_t *table, size_t sync_every, size_t compact_after);
+
+int journal_recover(journal_t *journal);
+
+int journal_log_task(journal_t *journal, journal_op_t op, const task_t *task);
+
+int journal_log_import(journal_t *journal, task_t **tasks, size_t count);
+
+int journal_log_delete(journal_t *journal, uint64_t id);
+
+int journal_log_batch(journal_t *journal, const journal_batch_op_t *ops, size_t count);
+
+int journal_compact(journal_t *journal);
+
+void journal_close(journal_t *journal);
+
+#endif //CRON_JOURNAL_H
@@ -0,0 +1,149 @@
+#include "log_binary.h"
+#include "logger.h"
+#include <string.h>
+
+#define LOG_FORMAT_FLAGS "-+ #0'"
+
+const char *log_conversion_next(const char *format, const char **end, log_arg_t *arg) {
+    const char *start = strchr(format, '%');
+    if (!start)
+        return NULL;
+
+    const char *cursor = start + 1;
+    if (*cursor == '%') {
+        *end = cursor + 1;
+        *arg = LOG_ARG_LITERAL;
+        return start;
+    }
+
+    // Szerokość albo dokładność z argumentu ('*') nie jest obsługiwana
+    while (*cursor && strchr(LOG_FORMAT_FLAGS, *cursor))
+        cursor++;
+    while (*cursor >= '0' && *cursor <= '9')
+        cursor++;
+    if (*cursor == '.') {
+        cursor++;
+        while (*cursor >= '0' && *cursor <= '9')
+            cursor++;
+    }
+
+    log_arg_t integer = LOG_ARG_INT;
+    switch (*cursor) {
+        case 'h':
+            cursor += cursor[1] == 'h' ? 2 : 1;
+            break;
+        case 'l':
+            integer = cursor[1] == 'l' ? LOG_ARG_LLONG : LOG_ARG_LONG;
+            cursor += cursor[1] == 'l' ? 2 : 1;
+            break;
+        case 'z':
+            integer = LOG_ARG_SIZE;
+            cursor++;
+            break;
+        case 'j':
+            integer = LOG_ARG_INTMAX;
+            cursor++;
+            break;
+        case 't':
+            integer = LOG_ARG_PTRDIFF;
+            cursor++;
+            break;
+        default:
+            break;
+    }
+
+    switch (*cursor) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            *arg = integer;
+            break;
+        case 'c':
+            *arg = integer == LOG_ARG_INT ? LOG_ARG_INT : LOG_ARG_UNSUPPORTED;
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            *arg = integer == LOG_ARG_INT ? LOG_ARG_DOUBLE : LOG_ARG_UNSUPPORTED;
+            break;
+        case 's':
+            *arg = integer == LOG_ARG_INT ? LOG_ARG_STRING : LOG_ARG_UNSUPPORTED;
+            break;
+        case 'p':
+            *arg = LOG_ARG_POINTER;
+            break;
+        default:
+            *arg = LOG_ARG_UNSUPPORTED;
+            break;
+    }
+
+    *end = *cursor ? cursor + 1 : cursor;
+    return start;
+}
+
+int log_conversion_parse(const char *format, uint8_t *args, size_t max_args) {
+    const char *end;
+    log_arg_t arg;
+    int count = 0;
+
+    while ((format = log_conversion_next(format, &end, &arg))) {
+        if (arg == LOG_ARG_UNSUPPORTED || (arg != LOG_ARG_LITERAL && (size_t) count == max_args))
+            return -1;
+        if (arg != LOG_ARG_LITERAL)
+            args[count++] = (uint8_t) arg;
+        format = end;
+    }
+    return count;
+}
+
+size_t log_varint_put(char *out, uint64_t value) {
+    size_t length = 0;
+
+    while (value >= 0x80) {
+        out[length++] = (char) (value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (char) value;
+    return length;
+}
+
+int log_varint_get(const char **cursor, const char *end, uint64_t *value) {
+    uint64_t result = 0;
+
+    for (int shift = 0; *cursor < end && shift < 64; shift += 7) {
+        uint8_t byte = (uint8_t) *(*cursor)++;
+        result |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+uint64_t log_zigzag(int64_t value) {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+int64_t log_unzigzag(uint64_t value) {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+int64_t log_binary_time_unit(int resolution) {
+    switch (resolution) {
+        case LOG_TIME_MICROSECONDS:
+            return 1;
+        case LOG_TIME_MILLISECONDS:
+            return 1000;
+        default:
+            return 1000000;
+    }
+}
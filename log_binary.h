@@ -0,0 +1,97 @@
+#ifndef CRON_LOG_BINARY_H
+#define CRON_LOG_BINARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_BINARY_MAGIC "CRONLOG"
+#define LOG_BINARY_VERSION (1)
+#define LOG_BINARY_EXTENSION ".bin"
+#define LOG_FORMAT_TABLE_SUFFIX ".fmt"
+#define LOG_BINARY_MAX_ARGS (16)
+#define LOG_BINARY_MAX_RECORD (4096)
+#define LOG_VARINT_MAX (10)
+
+/*
+ * Identyfikator formatu wpisów, które zapisano jako gotowy
+ * tekst (jeden argument %s), np. gdy format ma konwersję
+ * bez odpowiednika w zapisie binarnym.
+ * */
+#define LOG_TEXT_FORMAT_ID (0)
+
+/*
+ * Typy argumentów zapisywanych w rekordzie. Liczby całkowite
+ * i wskaźniki są zapisywane jako varint (ze znakiem w kodzie
+ * zigzag), double jako 8 bajtów, napisy jako varint z długością
+ * i bajty napisu.
+ * */
+typedef enum {
+    LOG_ARG_LITERAL,
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_INTMAX,
+    LOG_ARG_PTRDIFF,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING,
+    LOG_ARG_POINTER,
+    LOG_ARG_UNSUPPORTED
+} log_arg_t;
+
+/*
+ * Nagłówek pliku logu binarnego. Czas rekordu to liczba
+ * jednostek od base (sekundy od epoki), jednostką jest
+ * dokładność znacznika czasu resolution (log_time_resolution_t).
+ *
+ * Rekord: varint z długością reszty rekordu, varint z id
+ * formatu, bajt priorytetu, varint z czasem (zigzag)
+ * i argumenty.
+ * Formaty są zapisywane raz, w pliku z przyrostkiem
+ * LOG_FORMAT_TABLE_SUFFIX: log_format_entry_t i tekst formatu.
+ * */
+typedef struct {
+    char magic[8];
+    uint16_t version;
+    uint8_t resolution;
+    uint8_t reserved;
+    uint32_t reserved2;
+    int64_t base;
+} log_binary_header_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t length;
+} log_format_entry_t;
+
+/*
+ * Funkcja szukająca następnej konwersji w formacie. Zwraca
+ * wskaźnik na jej '%' albo NULL, w end zapisuje koniec
+ * konwersji, a w arg typ jej argumentu.
+ * */
+const char *log_conversion_next(const char *format, const char **end, log_arg_t *arg);
+
+/*
+ * Funkcja zapisująca typy argumentów formatu. Zwraca ich
+ * liczbę albo -1, gdy formatu nie da się zapisać binarnie.
+ * */
+int log_conversion_parse(const char *format, uint8_t *args, size_t max_args);
+
+/*
+ * Funkcje kodujące i dekodujące liczby varint.
+ * */
+size_t log_varint_put(char *out, uint64_t value);
+
+int log_varint_get(const char **cursor, const char *end, uint64_t *value);
+
+uint64_t log_zigzag(int64_t value);
+
+/*
+ * Funkcja zwracająca długość jednostki czasu
+ * rekordu w mikrosekundach.
+ * */
+int64_t log_binary_time_unit(int resolution);
+
+int64_t log_unzigzag(uint64_t value);
+
+#endif //CRON_LOG_BINARY_H
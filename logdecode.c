@@ -0,0 +1,282 @@
+#include "logger.h"
+#include "log_binary.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Ten sam układ znacznika czasu co w logger.c.
+ * */
+#define DATETIME_BUFFER_SIZE (18)
+#define DATETIME_FORMAT "%y-%m-%d_%H.%M.%S"
+#define CONVERSION_SIZE (32)
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+/*
+ * Tabela formatów wczytana z pliku LOG_FORMAT_TABLE_SUFFIX,
+ * indeksowana id formatu.
+ * */
+typedef struct {
+    char **formats;
+    uint32_t count;
+} format_table_t;
+
+static int format_table_load(format_table_t *table, const char *filename) {
+    char format_filename[strlen(filename) + sizeof(LOG_FORMAT_TABLE_SUFFIX)];
+    sprintf(format_filename, "%s%s", filename, LOG_FORMAT_TABLE_SUFFIX);
+
+    // Segmenty po rotacji (log.1, log.2, ...) dzielą tabelę formatów z bieżącym logiem
+    FILE *file = fopen(format_filename, "r");
+    if (!file) {
+        char *suffix = strrchr(format_filename, '.');
+        char *segment = suffix;
+        while (segment > format_filename && segment[-1] >= '0' && segment[-1] <= '9')
+            segment--;
+        if (segment != suffix && segment - 1 > format_filename && segment[-1] == '.') {
+            memmove(segment - 1, suffix, strlen(suffix) + 1);
+            file = fopen(format_filename, "r");
+        }
+    }
+    if (!file) {
+        perror(format_filename);
+        return -1;
+    }
+
+    table->formats = NULL;
+    table->count = 0;
+
+    log_format_entry_t entry;
+    while (fread(&entry, sizeof(entry), 1, file) == 1) {
+        char *format = malloc(entry.length + 1);
+        if (!format || fread(format, 1, entry.length, file) != entry.length) {
+            free(format);
+            break;
+        }
+        format[entry.length] = '\0';
+
+        if (entry.id >= table->count) {
+            char **formats = realloc(table->formats, (entry.id + 1) * sizeof(char *));
+            if (!formats) {
+                free(format);
+                break;
+            }
+            memset(formats + table->count, 0, (entry.id + 1 - table->count) * sizeof(char *));
+            table->formats = formats;
+            table->count = entry.id + 1;
+        }
+        free(table->formats[entry.id]);
+        table->formats[entry.id] = format;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static void format_table_free(format_table_t *table) {
+    for (uint32_t i = 0; i < table->count; ++i)
+        free(table->formats[i]);
+    free(table->formats);
+}
+
+static void print_timestamp(int64_t base, int64_t elapsed, log_time_resolution_t resolution) {
+    elapsed *= log_binary_time_unit(resolution);
+    int64_t microseconds = elapsed % 1000000;
+    time_t second = (time_t) (base + elapsed / 1000000);
+    if (microseconds < 0) {
+        microseconds += 1000000;
+        second--;
+    }
+
+    char text[DATETIME_BUFFER_SIZE];
+    struct tm time_info;
+    localtime_r(&second, &time_info);
+    strftime(text, sizeof(text), DATETIME_FORMAT, &time_info);
+
+    if (resolution == LOG_TIME_MILLISECONDS)
+        printf("%s.%03d", text, (int) (microseconds / 1000));
+    else if (resolution == LOG_TIME_MICROSECONDS)
+        printf("%s.%06d", text, (int) microseconds);
+    else
+        printf("%s", text);
+}
+
+/*
+ * Wypisuje tekst wpisu: każda konwersja formatu jest
+ * wypisywana osobno, z zapisanym argumentem.
+ * */
+static int print_record(const char *format, const char *cursor, const char *end) {
+    const char *conversion_end;
+    const char *conversion;
+    log_arg_t arg;
+
+    while ((conversion = log_conversion_next(format, &conversion_end, &arg))) {
+        fwrite(format, 1, (size_t) (conversion - format), stdout);
+        format = conversion_end;
+
+        char spec[CONVERSION_SIZE];
+        size_t spec_length = (size_t) (conversion_end - conversion);
+        if (spec_length >= sizeof(spec) || arg == LOG_ARG_UNSUPPORTED)
+            return -1;
+        memcpy(spec, conversion, spec_length);
+        spec[spec_length] = '\0';
+
+        uint64_t value;
+        double number;
+        switch (arg) {
+            case LOG_ARG_LITERAL:
+                putchar('%');
+                continue;
+            case LOG_ARG_DOUBLE:
+                if (end - cursor < (ptrdiff_t) sizeof(number))
+                    return -1;
+                memcpy(&number, cursor, sizeof(number));
+                cursor += sizeof(number);
+                printf(spec, number);
+                continue;
+            default:
+                break;
+        }
+
+        if (log_varint_get(&cursor, end, &value) == -1)
+            return -1;
+
+        int64_t integer = log_unzigzag(value);
+        switch (arg) {
+            case LOG_ARG_INT:
+                printf(spec, (int) integer);
+                break;
+            case LOG_ARG_LONG:
+                printf(spec, (long) integer);
+                break;
+            case LOG_ARG_LLONG:
+                printf(spec, (long long) integer);
+                break;
+            case LOG_ARG_SIZE:
+                printf(spec, (size_t) integer);
+                break;
+            case LOG_ARG_INTMAX:
+                printf(spec, (intmax_t) integer);
+                break;
+            case LOG_ARG_PTRDIFF:
+                printf(spec, (ptrdiff_t) integer);
+                break;
+            case LOG_ARG_POINTER:
+                printf(spec, (void *) (uintptr_t) value);
+                break;
+            case LOG_ARG_STRING: {
+                if ((uint64_t) (end - cursor) < value)
+                    return -1;
+                char *text = strndup(cursor, (size_t) value);
+                cursor += value;
+                if (!text)
+                    return -1;
+                printf(spec, text);
+                free(text);
+                break;
+            }
+            default:
+                return -1;
+        }
+    }
+
+    fputs(format, stdout);
+    return 0;
+}
+
+static const char *priority_sign(int priority) {
+    switch (priority) {
+        case LOW:
+            return "#";
+        case MID:
+            return "##";
+        case MAX:
+            return "###";
+        default:
+            return "?";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <log%s>\n", argv[0], LOG_BINARY_EXTENSION);
+        return 1;
+    }
+
+    format_table_t table;
+    if (format_table_load(&table, argv[1]) == -1)
+        return 1;
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat status;
+    if (fd == -1 || fstat(fd, &status) == -1) {
+        perror(argv[1]);
+        format_table_free(&table);
+        return 1;
+    }
+
+    size_t size = (size_t) status.st_size;
+    const char *data = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+
+    log_binary_header_t header;
+    if (data == MAP_FAILED || size < sizeof(header)) {
+        fprintf(stderr, "%s: not a binary log\n", argv[1]);
+        format_table_free(&table);
+        return 1;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, LOG_BINARY_MAGIC, sizeof(LOG_BINARY_MAGIC)) != 0 || header.version != LOG_BINARY_VERSION) {
+        fprintf(stderr, "%s: not a binary log\n", argv[1]);
+        munmap((void *) data, size);
+        format_table_free(&table);
+        return 1;
+    }
+
+    log_time_resolution_t resolution = (log_time_resolution_t) header.resolution;
+    static char output[OUTPUT_BUFFER_SIZE];
+    setvbuf(stdout, output, _IOFBF, sizeof(output));
+
+    int result = 0;
+    const char *cursor = data + sizeof(header), *end = data + size;
+    while (cursor < end) {
+        uint64_t length, id, elapsed;
+        if (log_varint_get(&cursor, end, &length) == -1 || length > (uint64_t) (end - cursor)) {
+            result = 1;
+            break;
+        }
+
+        const char *record_end = cursor + length;
+        if (log_varint_get(&cursor, record_end, &id) == -1 || cursor == record_end) {
+            result = 1;
+            break;
+        }
+        int priority = (unsigned char) *cursor++;
+        if (log_varint_get(&cursor, record_end, &elapsed) == -1) {
+            result = 1;
+            break;
+        }
+
+        const char *format = id == LOG_TEXT_FORMAT_ID ? "%s" : id < table.count ? table.formats[id] : NULL;
+        printf("[%3s]<", priority_sign(priority));
+        print_timestamp(header.base, log_unzigzag(elapsed), resolution);
+        putchar('>');
+
+        if (!format || print_record(format, cursor, record_end) == -1)
+            printf("<undecodable record, format %llu>\n", (unsigned long long) id);
+        cursor = record_end;
+    }
+
+    if (result)
+        fprintf(stderr, "%s: truncated record at offset %td\n", argv[1], cursor - data);
+
+    fflush(stdout);
+    munmap((void *) data, size);
+    format_table_free(&table);
+    return result;
+}
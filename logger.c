@@ -1,4 +1,6 @@
+#define _GNU_SOURCE
 #include "logger.h"
+#include "log_binary.h"
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
@@ -7,21 +9,54 @@
 #include <signal.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <time.h>
 #include <stdatomic.h>
-#include <semaphore.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
 
 #define TRUE  (1)
 #define FALSE (0)
 
-#define DATETIME_BUFFER_SIZE (17)
-#define DUMP_FILENAME_SIZE (DATETIME_BUFFER_SIZE + 19)
+#define DATETIME_BUFFER_SIZE (18)
+#define DATETIME_FORMAT "%y-%m-%d_%H.%M.%S"
+#define TIMESTAMP_BUFFER_SIZE (DATETIME_BUFFER_SIZE + 7)
+#define DUMP_FILENAME_SIZE (DATETIME_BUFFER_SIZE + 31)
 #define LOG_FILENAME_SIZE (DATETIME_BUFFER_SIZE + 19)
 
-#define FILE_APPEND_MODE "a"
+#define LOG_FILE_FLAGS (O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC)
+#define LOG_FILE_PERMISSIONS (0644)
 #define DUMP_PREFIX "dump_"
 #define LOG_PREFIX "log_"
 #define LOG_EXTENSION ".log"
 
+#define LOG_ENTRY_SIZE (256)
+#define LOG_BATCH_SIZE (64 * 1024)
+#define LOG_FLUSH_INTERVAL_MS (100)
+#define LOG_BLOCK_PAUSE_US (50)
+#define LOG_CACHE_LINE (64)
+#define LOG_LINE_SIZE (4096)
+#define LOG_SEGMENT_SUFFIX_SIZE (12)
+
+#define LOG_MODE_SYNC_NAME "sync"
+#define LOG_MODE_BLOCK_NAME "block"
+#define LOG_TIME_MS_NAME "ms"
+#define LOG_TIME_US_NAME "us"
+#define LOG_FORMAT_BINARY_NAME "binary"
+#define LOG_LEVELS_SEPARATOR ","
+#define LOG_COMMAND_STOP (LOG_COMMAND_PRIORITY + 1)
+#define LOG_COMMAND_COUNT (LOG_COMMAND_STOP + 1)
+
+static const char *log_component_names[LOG_COMPONENT_COUNT] = {"core", "scheduler", "ipc", "spawn"};
+static const char *log_level_names[] = {"low", "mid", "max"};
+
+#define LOG_FORMAT_SLOTS (1024)
+#define LOG_FORMAT_FILE_MODE "a+"
+#define LOG_DROPPED_FORMAT "Dropped %llu log entries\n"
+
 
 /*
  * Wartości określające flagi działania systemu
@@ -35,270 +70,1049 @@ typedef enum {
  * Struktura przechowywyująca informacje o systemie logowania
  */
 typedef struct {
-    FILE *logfile;
-    log_priority_t priority;
-    log_state_t state;
+    int fd;
+    char *filename;
 } logger_t;
 
 /*
- * Funkcja wykonywana przez wątek odpowiedzialny
- * za pliki dump.
+ * Znacznik czasu wątku. Część z datą i sekundą jest
+ * formatowana tylko gdy zmieni się sekunda, przy każdym
+ * wpisie dopisywany jest jedynie ułamek sekundy.
  * */
-void *log_dump_thread_func(void *arg);
+typedef struct {
+    time_t second;
+    size_t length;
+    char text[TIMESTAMP_BUFFER_SIZE];
+} log_timestamp_t;
 
 /*
- * Funkcja wykonywana przez wątek odpowiedzialny
- * za stan systemu logowania plików.
+ * Wpis w buforze wątku: gotowa linia logu, dłuższe
+ * są obcinane do rozmiaru wpisu.
  * */
-void *log_switch_thread_func(void *arg);
+typedef struct {
+    size_t length;
+    char text[LOG_ENTRY_SIZE - sizeof(size_t)];
+} log_entry_t;
 
 /*
- * Funkcja wykonywana przez wątek odpowiedzialny
- * za zmiane priorytetu zapisywanych logów.
+ * Bufor cykliczny jednego wątku. Pisze do niego tylko
+ * właściciel (tail), czyta tylko wątek zapisujący (head),
+ * więc wystarczą dwa liczniki atomowe. Bufor zakończonego
+ * wątku przejmuje następny nowy wątek.
  * */
-void *log_priority_thread_func(void *arg);
+typedef struct log_ring {
+    _Alignas(LOG_CACHE_LINE) atomic_size_t tail;
+    _Alignas(LOG_CACHE_LINE) atomic_size_t head;
+    _Alignas(LOG_CACHE_LINE) atomic_int owned;
+    atomic_ullong dropped;
+    atomic_ullong blocked;
+    size_t mask;
+    log_entry_t *entries;
+    struct log_ring *next;
+} log_ring_t;
 
 /*
- * Handler sygnału wykonującego plik dump
+ * Format zarejestrowany w logu binarnym. Kluczem jest adres
+ * napisu formatu, więc wyszukanie nie porównuje tekstu.
+ * Wpis jest gotowy do użycia dopiero po ustawieniu ready.
  * */
-void log_dump_signal_handler(int signum);
+typedef struct {
+    _Atomic(const char *) format;
+    atomic_int ready;
+    uint32_t id;
+    int count;
+    uint8_t args[LOG_BINARY_MAX_ARGS];
+} log_format_slot_t;
 
 /*
- * Handler sygnału do zmiany stanu systemu logowania
- * plików.
+ * Funkcja wykonywana przez wątek zapisujący
+ * bufory wątków do pliku.
  * */
-void log_switch_signal_handler(int signum);
+void *log_flush_thread_func(void *arg);
 
 /*
- * Handler sygnału do zmiany priorytetu zapisywanych
- * logów.
+ * Funkcja wykonywana przez wątek sterujący: odbiera sygnały
+ * LOG_*_SIGNAL przez signalfd i polecenia log_control przez
+ * eventfd, każde wykonuje od razu.
  * */
-void log_priority_signal_handler(int signum);
+void *log_control_thread_func(void *arg);
 
 /*
- * Handler sygnału utylizujący system logowania plików
+ * Handler sygnałów sterujących, które trafiły do wątku bez
+ * ich blokady (utworzonego przed log_init). Przekazuje je
+ * wątkowi sterującemu.
  * */
-void log_terminate_signal_handler(int signum);
+void log_control_signal_handler(int signum);
 
 /*
  * Funkcja zapisująca aktualą data do zmiennej
- * date_buffer.
+ * datetime_buffer wątku.
  * */
 void datetime(void);
 
-static logger_t logger;
+static logger_t logger = {.fd = -1, .filename = NULL};
 
-static atomic_int flag_logger_init = FALSE;
-static atomic_int flag_logger_dump = FALSE;
-static atomic_int flag_logger_switch = FALSE;
-static atomic_int flag_logger_priority = FALSE;
-static atomic_int flag_logger_terminate = FALSE;
-static atomic_int flag_logger_change_dump_func = FALSE;
+atomic_int log_levels[LOG_COMPONENT_COUNT] = {MAX, MAX, MAX, MAX};
+static atomic_int log_state = ON;
 
+static atomic_int flag_logger_init = FALSE;
 
-static pthread_t log_dump_thread;
-static pthread_t log_switch_thread;
-static pthread_t log_priority_thread;
+static pthread_t log_control_thread;
+static int log_control_fd = -1;
+static int log_signal_fd = -1;
+static sigset_t log_signals;
+static sigset_t log_blocked_signals;
+static atomic_uint log_commands[LOG_COMMAND_COUNT];
 
 static pthread_mutex_t log_dump_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t log_state_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t log_switch_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t log_logfile_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t log_priority_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-static sem_t log_dump_sem;
-static sem_t log_switch_sem;
-static sem_t log_priority_sem;
 
 static log_dump_func_t state_dump_callback = NULL;
+static void *state_dump_args = NULL;
+static time_t log_dump_second = 0;
+static unsigned log_dump_sequence = 0;
+
+static __thread char datetime_buffer[DATETIME_BUFFER_SIZE];
+static __thread log_timestamp_t thread_timestamp = {.second = -1};
+
+static atomic_int log_time_resolution = LOG_TIME_SECONDS;
+static atomic_int log_time_clock = CLOCK_REALTIME_COARSE;
+
+static log_mode_t log_mode = LOG_SYNC;
+static size_t log_ring_entries = LOG_DEFAULT_RING_ENTRIES;
+static int log_async = FALSE;
+static int log_flush_fd = -1;
+static pthread_t log_flush_thread;
+static pthread_key_t log_ring_key;
+static _Atomic(log_ring_t *) log_rings = NULL;
+static atomic_uint log_epoch = 0;
+static atomic_int flag_logger_flush_stop = FALSE;
+static atomic_ullong log_written = 0;
+static atomic_ullong log_flushes = 0;
+static unsigned long long log_dropped_reported = 0;
+
+static log_format_t log_format = LOG_FORMAT_TEXT;
+static log_format_slot_t log_formats[LOG_FORMAT_SLOTS];
+static FILE *log_format_file = NULL;
+static uint32_t log_format_base = 0;
+static int64_t log_binary_base = 0;
+static int64_t log_binary_unit = 1000000;
+static uint8_t log_binary_resolution = LOG_TIME_SECONDS;
+static pthread_mutex_t log_format_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t log_rotate_size = 0;
+static unsigned log_rotate_interval = 0;
+static unsigned log_rotate_segments = LOG_DEFAULT_SEGMENTS;
+static atomic_size_t log_segment_bytes = 0;
+static atomic_llong log_segment_start = 0;
+static atomic_int flag_logger_rotating = FALSE;
+static atomic_ullong log_rotations = 0;
+
+static __thread log_ring_t *thread_ring = NULL;
+static __thread unsigned thread_ring_epoch = 0;
+
+int log_set_mode(log_mode_t mode, size_t ring_entries) {
+    if (atomic_load(&flag_logger_init) == TRUE || ring_entries < 2) {
+        errno = EINVAL;
+        return -1;
+    }
 
-static char datetime_buffer[DATETIME_BUFFER_SIZE];
+    // Rozmiar jest potęgą dwójki, indeks wpisu to maska licznika
+    size_t entries = 2;
+    while (entries < ring_entries)
+        entries *= 2;
 
-void log_init(const char *filename, log_dump_func_t callback, void *dump_args) {
+    log_mode = mode;
+    log_ring_entries = entries;
+    return 0;
+}
+
+log_mode_t log_mode_parse(const char *name) {
+    if (name && strcmp(name, LOG_MODE_SYNC_NAME) == 0)
+        return LOG_SYNC;
+    if (name && strcmp(name, LOG_MODE_BLOCK_NAME) == 0)
+        return LOG_ASYNC_BLOCK;
+    return LOG_ASYNC_DROP;
+}
+
+/*
+ * Zegar zgrubny jest tańszy, ale używany tylko gdy jego
+ * rozdzielczość wystarcza dla wybranej jednostki.
+ * */
+void log_set_time_resolution(log_time_resolution_t resolution) {
+    long unit = resolution == LOG_TIME_MICROSECONDS ? 1000 : resolution == LOG_TIME_MILLISECONDS ? 1000000 : 1000000000;
+    struct timespec coarse;
+    int clock = CLOCK_REALTIME_COARSE;
+
+    if (clock_getres(CLOCK_REALTIME_COARSE, &coarse) == -1 || coarse.tv_sec > 0 || coarse.tv_nsec > unit)
+        clock = CLOCK_REALTIME;
+
+    atomic_store(&log_time_clock, clock);
+    atomic_store(&log_time_resolution, resolution);
+}
+
+log_time_resolution_t log_time_resolution_parse(const char *name) {
+    if (name && strcmp(name, LOG_TIME_MS_NAME) == 0)
+        return LOG_TIME_MILLISECONDS;
+    if (name && strcmp(name, LOG_TIME_US_NAME) == 0)
+        return LOG_TIME_MICROSECONDS;
+    return LOG_TIME_SECONDS;
+}
+
+// Zwraca znacznik czasu wątku, ważny do następnego wywołania w tym wątku
+static const char *log_timestamp(void) {
+    log_timestamp_t *timestamp = &thread_timestamp;
+    struct timespec now;
+    clock_gettime(atomic_load_explicit(&log_time_clock, memory_order_relaxed), &now);
+
+    if (now.tv_sec != timestamp->second) {
+        struct tm time_info;
+        localtime_r(&now.tv_sec, &time_info);
+        timestamp->length = strftime(timestamp->text, DATETIME_BUFFER_SIZE, DATETIME_FORMAT, &time_info);
+        timestamp->second = now.tv_sec;
+    }
+
+    int digits = 0;
+    long fraction = 0;
+    switch (atomic_load_explicit(&log_time_resolution, memory_order_relaxed)) {
+        case LOG_TIME_MILLISECONDS:
+            digits = 3;
+            fraction = now.tv_nsec / 1000000;
+            break;
+        case LOG_TIME_MICROSECONDS:
+            digits = 6;
+            fraction = now.tv_nsec / 1000;
+            break;
+        default:
+            break;
+    }
+
+    char *end = timestamp->text + timestamp->length;
+    if (digits) {
+        *end++ = '.';
+        for (int i = digits - 1; i >= 0; --i, fraction /= 10)
+            end[i] = (char) ('0' + fraction % 10);
+        end += digits;
+    }
+    *end = '\0';
+    return timestamp->text;
+}
+
+int log_set_format(log_format_t format) {
     if (atomic_load(&flag_logger_init) == TRUE) {
-        errno = EFAULT;
-        return;
+        errno = EINVAL;
+        return -1;
     }
 
-    if (!filename) {
-        char log_filename[LOG_FILENAME_SIZE] = {0};
+    log_format = format;
+    return 0;
+}
 
-        datetime();
-        sprintf(log_filename, "%s%d_%s%s",LOG_PREFIX, getpid(), datetime_buffer, LOG_EXTENSION);
+log_format_t log_format_parse(const char *name) {
+    if (name && strcmp(name, LOG_FORMAT_BINARY_NAME) == 0)
+        return LOG_FORMAT_BINARY;
+    return LOG_FORMAT_TEXT;
+}
 
-        filename = log_filename;
+// Dopisuje format do tabeli obok logu, tylko przy pierwszym użyciu
+static void log_format_register(log_format_slot_t *slot, size_t index, const char *format) {
+    slot->id = log_format_base + (uint32_t) index + 1;
+    slot->count = log_conversion_parse(format, slot->args, LOG_BINARY_MAX_ARGS);
+
+    log_format_entry_t entry = {.id = slot->id, .length = (uint32_t) strlen(format)};
+    pthread_mutex_lock(&log_format_mutex);
+    if (fwrite(&entry, sizeof(entry), 1, log_format_file) != 1 ||
+        fwrite(format, 1, entry.length, log_format_file) != entry.length || fflush(log_format_file) == EOF) {
+        perror("log format write failed");
+        slot->count = -1;
     }
+    pthread_mutex_unlock(&log_format_mutex);
 
-    logger.logfile = fopen(filename, FILE_APPEND_MODE);
-    if (!logger.logfile) {
-        errno = EIO;
-        return;
+    atomic_store_explicit(&slot->ready, TRUE, memory_order_release);
+}
+
+/*
+ * Zwraca zarejestrowany format albo NULL, gdy tabela jest
+ * pełna lub inny wątek właśnie go rejestruje; wtedy wpis
+ * jest zapisywany jako gotowy tekst.
+ * */
+static log_format_slot_t *log_format_lookup(const char *format) {
+    size_t mask = LOG_FORMAT_SLOTS - 1;
+    size_t index = (size_t) (((uintptr_t) format * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+
+    for (size_t probe = 0; probe < LOG_FORMAT_SLOTS; ++probe, index = (index + 1) & mask) {
+        log_format_slot_t *slot = &log_formats[index];
+        const char *current = atomic_load_explicit(&slot->format, memory_order_acquire);
+
+        if (!current && atomic_compare_exchange_strong(&slot->format, &current, format)) {
+            log_format_register(slot, index, format);
+            return slot->count >= 0 ? slot : NULL;
+        }
+        if (current == format)
+            return atomic_load_explicit(&slot->ready, memory_order_acquire) && slot->count >= 0 ? slot : NULL;
     }
+    return NULL;
+}
 
-    logger.priority = MAX;
-    logger.state = ON;
+static size_t log_put_string(char *out, size_t space, const char *text, size_t length) {
+    size_t limit = space > LOG_VARINT_MAX ? space - LOG_VARINT_MAX : 0;
+    if (length > limit)
+        length = limit;
 
-    if (callback)
-        state_dump_callback = callback;
+    size_t used = log_varint_put(out, length);
+    memcpy(out + used, text, length);
+    return used + length;
+}
 
-    sem_t *sems[3] = {&log_dump_sem, &log_switch_sem, &log_priority_sem};
-    for (int i = 0; i < 3; ++i) {
-        if (sem_init(sems[i],0,0) == -1) {
-            for (int j = 0; j < i; ++j) {
-                sem_destroy(sems[j]);
-            }
-            fclose(logger.logfile);
-            errno = EINVAL;
-            return;
+/*
+ * Koduje wpis binarny do out i zwraca jego długość. Napisy są
+ * obcinane tak, by zmieściły się pozostałe argumenty; size
+ * musi pomieścić nagłówek i LOG_BINARY_MAX_ARGS liczb.
+ * */
+static size_t log_binary_encode(char *out, size_t size, log_priority_t priority, const char *format, va_list args) {
+    struct timespec now;
+    clock_gettime(atomic_load_explicit(&log_time_clock, memory_order_relaxed), &now);
+    int64_t elapsed = (((int64_t) now.tv_sec - log_binary_base) * 1000000 + now.tv_nsec / 1000) / log_binary_unit;
+
+    // Na długość zostaje jeden bajt, drugi jest zarezerwowany na końcu bufora na rzadkie dłuższe rekordy
+    log_format_slot_t *slot = log_format_lookup(format);
+    size_t used = 1;
+    size--;
+    used += log_varint_put(out + used, slot ? slot->id : LOG_TEXT_FORMAT_ID);
+    out[used++] = (char) priority;
+    used += log_varint_put(out + used, log_zigzag(elapsed));
+
+    if (!slot) {
+        char text[LOG_BINARY_MAX_RECORD];
+        int length = vsnprintf(text, sizeof(text), format, args);
+        if (length < 0)
+            length = 0;
+        used += log_put_string(out + used, size - used, text,
+                               (size_t) length < sizeof(text) ? (size_t) length : sizeof(text) - 1);
+    }
+
+    for (int i = 0; slot && i < slot->count; ++i) {
+        // Miejsce zostawione na liczby z pozostałych argumentów
+        size_t reserve = (size_t) (slot->count - i - 1) * LOG_VARINT_MAX;
+        double value;
+        const char *text;
+
+        switch (slot->args[i]) {
+            case LOG_ARG_INT:
+                used += log_varint_put(out + used, log_zigzag(va_arg(args, int)));
+                break;
+            case LOG_ARG_LONG:
+                used += log_varint_put(out + used, log_zigzag(va_arg(args, long)));
+                break;
+            case LOG_ARG_LLONG:
+                used += log_varint_put(out + used, log_zigzag(va_arg(args, long long)));
+                break;
+            case LOG_ARG_SIZE:
+                used += log_varint_put(out + used, log_zigzag((int64_t) va_arg(args, size_t)));
+                break;
+            case LOG_ARG_INTMAX:
+                used += log_varint_put(out + used, log_zigzag(va_arg(args, intmax_t)));
+                break;
+            case LOG_ARG_PTRDIFF:
+                used += log_varint_put(out + used, log_zigzag(va_arg(args, ptrdiff_t)));
+                break;
+            case LOG_ARG_DOUBLE:
+                value = va_arg(args, double);
+                memcpy(out + used, &value, sizeof(value));
+                used += sizeof(value);
+                break;
+            case LOG_ARG_STRING:
+                text = va_arg(args, const char *);
+                if (!text)
+                    text = "(null)";
+                used += log_put_string(out + used, size - used - reserve, text, strlen(text));
+                break;
+            case LOG_ARG_POINTER:
+                used += log_varint_put(out + used, (uintptr_t) va_arg(args, void *));
+                break;
+            default:
+                break;
         }
     }
 
-    pthread_create(&log_priority_thread, NULL, log_priority_thread_func, NULL);
-    pthread_create(&log_switch_thread, NULL, log_switch_thread_func, NULL);
-    pthread_create(&log_dump_thread, NULL, log_dump_thread_func, dump_args);
+    size_t length = used - 1;
+    if (length >= 0x80) {
+        memmove(out + 2, out + 1, length);
+        used = length + 2;
+    }
+    log_varint_put(out, length);
+    return used;
+}
 
-    struct sigaction sa;
-    sigset_t set;
+static size_t log_binary_record(char *out, size_t size, log_priority_t priority, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t length = log_binary_encode(out, size, priority, format, args);
+    va_end(args);
+    return length;
+}
 
-    sigfillset(&set);
+// Każdy segment logu zaczyna się od nagłówka z tym samym czasem bazowym
+static int log_binary_header_write(int fd) {
+    log_binary_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOG_BINARY_MAGIC, sizeof(LOG_BINARY_MAGIC));
+    header.version = LOG_BINARY_VERSION;
+    header.resolution = log_binary_resolution;
+    header.base = log_binary_base;
 
-    sa.sa_handler = log_priority_signal_handler;
-    sa.sa_mask = set;
-    sa.sa_flags = 0;
+    return write(fd, &header, sizeof(header)) == sizeof(header) ? 0 : -1;
+}
+
+/*
+ * Otwiera tabelę formatów i ustala czas bazowy logu. Przy
+ * dopisywaniu do istniejącego logu nowe id są większe od
+ * zapisanych, a czas bazowy jest brany z nagłówka pliku.
+ * */
+static int log_binary_open(const char *filename) {
+    char format_filename[strlen(filename) + sizeof(LOG_FORMAT_TABLE_SUFFIX)];
+    sprintf(format_filename, "%s%s", filename, LOG_FORMAT_TABLE_SUFFIX);
+
+    log_format_file = fopen(format_filename, LOG_FORMAT_FILE_MODE);
+    if (!log_format_file)
+        return -1;
+
+    log_format_entry_t entry;
+    log_format_base = 0;
+    while (fread(&entry, sizeof(entry), 1, log_format_file) == 1 && fseek(log_format_file, entry.length, SEEK_CUR) == 0)
+        if (entry.id > log_format_base)
+            log_format_base = entry.id;
+
+    log_binary_header_t header;
+    if (pread(logger.fd, &header, sizeof(header), 0) == sizeof(header)) {
+        if (memcmp(header.magic, LOG_BINARY_MAGIC, sizeof(LOG_BINARY_MAGIC)) != 0 ||
+            header.version != LOG_BINARY_VERSION) {
+            fclose(log_format_file);
+            return -1;
+        }
+        log_binary_base = header.base;
+        log_binary_resolution = header.resolution;
+        log_binary_unit = log_binary_time_unit(header.resolution);
+        return 0;
+    }
 
-    sigaction(LOG_PRIORITY_SIGNAL, &sa, NULL);
+    log_binary_base = (int64_t) time(NULL);
+    log_binary_resolution = (uint8_t) atomic_load(&log_time_resolution);
+    log_binary_unit = log_binary_time_unit(log_binary_resolution);
+    if (log_binary_header_write(logger.fd) == -1) {
+        fclose(log_format_file);
+        return -1;
+    }
+    return 0;
+}
 
-    sa.sa_handler = log_switch_signal_handler;
-    sigaction(LOG_SWITCH_SIGNAL, &sa, NULL);
+static void log_binary_close(void) {
+    fclose(log_format_file);
+    log_format_file = NULL;
+    memset(log_formats, 0, sizeof(log_formats));
+}
 
-    sa.sa_handler = log_dump_signal_handler;
-    sigaction(LOG_DUMP_SIGNAL, &sa, NULL);
+static void log_flush_wake(void) {
+    uint64_t value = 1;
+    if (write(log_flush_fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+        perror("eventfd write failed");
+}
 
-    sa.sa_handler = log_terminate_signal_handler;
-    sigaction(LOG_TERMINATE_SIGNAL, &sa, NULL);
+static void log_ring_release(void *arg) {
+    log_ring_t *ring = (log_ring_t *) arg;
+    atomic_store_explicit(&ring->owned, FALSE, memory_order_release);
+}
 
-    atomic_store(&flag_logger_init, TRUE);
+/*
+ * Zwraca bufor wątku. Przy pierwszym wpisie wątek przejmuje
+ * bufor zakończonego wątku albo dokłada nowy na początek listy.
+ * */
+static log_ring_t *log_ring_get(void) {
+    unsigned epoch = atomic_load_explicit(&log_epoch, memory_order_acquire);
+    if (thread_ring && thread_ring_epoch == epoch)
+        return thread_ring;
+
+    log_ring_t *ring;
+    for (ring = atomic_load(&log_rings); ring; ring = ring->next) {
+        int expected = FALSE;
+        if (atomic_compare_exchange_strong(&ring->owned, &expected, TRUE))
+            break;
+    }
+
+    if (!ring) {
+        ring = aligned_alloc(LOG_CACHE_LINE, sizeof(log_ring_t));
+        log_entry_t *entries = ring ? malloc(log_ring_entries * sizeof(log_entry_t)) : NULL;
+        if (!entries) {
+            free(ring);
+            return NULL;
+        }
+
+        memset(ring, 0, sizeof(log_ring_t));
+        ring->entries = entries;
+        ring->mask = log_ring_entries - 1;
+        atomic_init(&ring->owned, TRUE);
+
+        ring->next = atomic_load(&log_rings);
+        while (!atomic_compare_exchange_weak(&log_rings, &ring->next, ring));
+    }
+
+    thread_ring = ring;
+    thread_ring_epoch = epoch;
+    pthread_setspecific(log_ring_key, ring);
+    return ring;
 }
 
-void log_dump_signal_handler(int signum) {
-    atomic_store(&flag_logger_dump, TRUE);
-    sem_post(&log_dump_sem);
+// Zwraca TRUE gdy w buforze jest miejsce na wpis tail
+static int log_ring_reserve(log_ring_t *ring, size_t tail) {
+    if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) <= ring->mask)
+        return TRUE;
+
+    if (log_mode == LOG_ASYNC_DROP) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return FALSE;
+    }
+
+    atomic_fetch_add_explicit(&ring->blocked, 1, memory_order_relaxed);
+    while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) > ring->mask) {
+        // Po log_close nikt już bufora nie opróżni
+        if (atomic_load(&flag_logger_flush_stop) == TRUE) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return FALSE;
+        }
+        log_flush_wake();
+        usleep(LOG_BLOCK_PAUSE_US);
+    }
+    return TRUE;
 }
 
-void log_switch_signal_handler(int signum) {
-    atomic_store(&flag_logger_switch, TRUE);
-    sem_post(&log_switch_sem);
+static int log_async_vprintf(log_priority_t priority, const char *priority_sign, const char *format, va_list args) {
+    log_ring_t *ring = log_ring_get();
+    if (!ring)
+        return 0;
+
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (!log_ring_reserve(ring, tail))
+        return 0;
+
+    log_entry_t *entry = &ring->entries[tail & ring->mask];
+    size_t length;
+    if (log_format == LOG_FORMAT_BINARY) {
+        length = log_binary_encode(entry->text, sizeof(entry->text), priority, format, args);
+    } else {
+        int result = snprintf(entry->text, sizeof(entry->text), "[%3s]<%s>", priority_sign, log_timestamp());
+        length = (size_t) result < sizeof(entry->text) ? (size_t) result : sizeof(entry->text) - 1;
+        int text = vsnprintf(entry->text + length, sizeof(entry->text) - length, format, args);
+        if (text > 0)
+            length += (size_t) text < sizeof(entry->text) - length ? (size_t) text : sizeof(entry->text) - length - 1;
+    }
+    entry->length = length;
+
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    // Wątek zapisujący budzi się sam co LOG_FLUSH_INTERVAL_MS, wcześniej tylko gdy bufor zapełnił się w połowie
+    if (tail + 1 - atomic_load_explicit(&ring->head, memory_order_relaxed) == (ring->mask + 1) / 2)
+        log_flush_wake();
+    return (int) length;
 }
 
-void log_priority_signal_handler(int signum) {
-    atomic_store(&flag_logger_priority, TRUE);
-    sem_post(&log_priority_sem);
+int log_set_rotation(size_t max_bytes, unsigned interval, unsigned segments) {
+    if (atomic_load(&flag_logger_init) == TRUE || segments == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    log_rotate_size = max_bytes;
+    log_rotate_interval = interval;
+    log_rotate_segments = segments;
+    return 0;
 }
 
-void log_terminate_signal_handler(int signum) {
-    atomic_store(&flag_logger_terminate, TRUE);
-    sem_post(&log_dump_sem);
-    sem_post(&log_switch_sem);
-    sem_post(&log_priority_sem);
+static time_t log_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    return now.tv_sec;
 }
 
-void *log_dump_thread_func(void *arg) {
-    sigset_t set;
-    sigfillset(&set);
-    sigdelset(&set, LOG_DUMP_SIGNAL);
-    pthread_sigmask(SIG_SETMASK, &set, NULL);
+/*
+ * Przygotowuje nowy segment: rezerwuje miejsce na cały
+ * segment bez zmiany rozmiaru pliku, więc zapisy O_APPEND
+ * dalej trafiają na koniec danych.
+ * */
+static void log_segment_prepare(int fd) {
+    struct stat status;
+    off_t size = fstat(fd, &status) == 0 ? status.st_size : 0;
 
-    while (TRUE) {
-        sem_wait(&log_dump_sem);
-        if (atomic_load(&flag_logger_dump) == TRUE) {
-            if (state_dump_callback) {
-                pthread_mutex_lock(&log_dump_mutex);
-                char dump_filename[DUMP_FILENAME_SIZE] = {0};
+    if (log_rotate_size && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) log_rotate_size) == -1 &&
+        errno != EOPNOTSUPP && errno != ENOSYS)
+        perror("log fallocate failed");
+
+    atomic_store(&log_segment_bytes, (size_t) size);
+    atomic_store(&log_segment_start, (long long) log_now());
+}
+
+// Zwalnia miejsce zarezerwowane za końcem segmentu, do którego nikt już nie pisze
+static void log_segment_trim(const char *filename) {
+    struct stat status;
+    if (stat(filename, &status) == 0 && truncate(filename, status.st_size) == -1)
+        perror("log truncate failed");
+}
+
+/*
+ * Przesuwa starsze segmenty (log.1 -> log.2, ...), zmienia
+ * nazwę bieżącego na log.1 i podmienia deskryptor przez dup2.
+ * Wątki w trakcie write kończą zapis do starego segmentu, a
+ * każda linia to jeden write, więc żadna nie jest gubiona
+ * ani dzielona między segmenty.
+ * */
+static void log_rotate(void) {
+    size_t length = strlen(logger.filename) + LOG_SEGMENT_SUFFIX_SIZE;
+    char from[length], to[length];
+
+    for (unsigned i = log_rotate_segments; i > 1; --i) {
+        sprintf(from, "%s.%u", logger.filename, i - 1);
+        sprintf(to, "%s.%u", logger.filename, i);
+        if (i == 2)
+            log_segment_trim(from);
+        if (rename(from, to) == -1 && errno != ENOENT)
+            perror("log rename failed");
+    }
+
+    sprintf(to, "%s.1", logger.filename);
+    if (rename(logger.filename, to) == -1) {
+        perror("log rename failed");
+        return;
+    }
+
+    int fd = open(logger.filename, LOG_FILE_FLAGS, LOG_FILE_PERMISSIONS);
+    if (fd == -1) {
+        perror("log open failed");
+        return;
+    }
 
-                datetime();
-                sprintf(dump_filename, "%s%d_%s%s",DUMP_PREFIX, getpid(), datetime_buffer, LOG_EXTENSION);
+    if (log_format == LOG_FORMAT_BINARY && log_binary_header_write(fd) == -1)
+        perror("log header write failed");
+    log_segment_prepare(fd);
+
+    if (dup2(fd, logger.fd) == -1)
+        perror("log dup2 failed");
+    close(fd);
+    atomic_fetch_add_explicit(&log_rotations, 1, memory_order_relaxed);
+}
+
+static int log_rotate_due(void) {
+    if (log_rotate_size && atomic_load_explicit(&log_segment_bytes, memory_order_relaxed) >= log_rotate_size)
+        return TRUE;
+    return log_rotate_interval &&
+           log_now() - atomic_load_explicit(&log_segment_start, memory_order_relaxed) >= log_rotate_interval;
+}
+
+// Rotację wykonuje wątek, który przekroczył limit, pozostali piszą dalej
+static void log_rotate_check(size_t length) {
+    if (!log_rotate_size && !log_rotate_interval)
+        return;
+
+    atomic_fetch_add_explicit(&log_segment_bytes, length, memory_order_relaxed);
+    if (!log_rotate_due())
+        return;
+
+    int expected = FALSE;
+    if (!atomic_compare_exchange_strong(&flag_logger_rotating, &expected, TRUE))
+        return;
+
+    // Warunek sprawdzany ponownie, segment mógł zostać właśnie zmieniony
+    if (log_rotate_due())
+        log_rotate();
+    atomic_store(&flag_logger_rotating, FALSE);
+}
+
+static void log_write(const char *data, size_t length) {
+    size_t total = length;
+
+    while (length) {
+        ssize_t written = write(logger.fd, data, length);
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("log write failed");
+            return;
+        }
+        data += written;
+        length -= (size_t) written;
+    }
+    atomic_fetch_add_explicit(&log_flushes, 1, memory_order_relaxed);
+    log_rotate_check(total);
+}
 
-                state_dump_callback(dump_filename, arg);
-                pthread_mutex_unlock(&log_dump_mutex);
+/*
+ * Przepisuje wszystkie bufory do jednej porcji i zapisuje
+ * ją jednym write. Kolejność wpisów jest zachowana w
+ * obrębie wątku, wpisy różnych wątków mogą się przeplatać.
+ * */
+static void log_flush_rings(char *batch) {
+    unsigned long long dropped = 0, written = 0;
+    size_t used = 0;
+
+    for (log_ring_t *ring = atomic_load(&log_rings); ring; ring = ring->next) {
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        for (; head != tail; ++head) {
+            const log_entry_t *entry = &ring->entries[head & ring->mask];
+            if (used + entry->length > LOG_BATCH_SIZE) {
+                log_write(batch, used);
+                used = 0;
             }
-            atomic_store(&flag_logger_dump, FALSE);
+            memcpy(batch + used, entry->text, entry->length);
+            used += entry->length;
+            written++;
         }
 
-        if (atomic_load(&flag_logger_change_dump_func) == TRUE || atomic_load(&flag_logger_terminate) == TRUE) {
-            atomic_store(&flag_logger_change_dump_func, FALSE);
-            break;
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    }
+
+    if (dropped > log_dropped_reported) {
+        char line[LOG_ENTRY_SIZE];
+        int length = log_format == LOG_FORMAT_BINARY ?
+                     (int) log_binary_record(line, sizeof(line), MAX, LOG_DROPPED_FORMAT, dropped - log_dropped_reported) :
+                     snprintf(line, sizeof(line), "[###]<%s>" LOG_DROPPED_FORMAT, log_timestamp(),
+                              dropped - log_dropped_reported);
+        if (used + (size_t) length > LOG_BATCH_SIZE) {
+            log_write(batch, used);
+            used = 0;
         }
-        sleep(1);
+        memcpy(batch + used, line, (size_t) length);
+        used += (size_t) length;
+        log_dropped_reported = dropped;
     }
-    return NULL;
-}
 
+    if (used)
+        log_write(batch, used);
+    atomic_fetch_add_explicit(&log_written, written, memory_order_relaxed);
+}
 
-void *log_switch_thread_func(void *arg) {
+void *log_flush_thread_func(void *arg) {
     sigset_t set;
-
     sigfillset(&set);
-    sigdelset(&set, LOG_SWITCH_SIGNAL);
     pthread_sigmask(SIG_SETMASK, &set, NULL);
 
-    while (TRUE) {
-        sem_wait(&log_switch_sem);
-        if (atomic_load(&flag_logger_switch) == TRUE) {
-            pthread_mutex_lock(&log_switch_mutex);
-            logger.state = logger.state == ON ? OFF : ON;
-            pthread_mutex_unlock(&log_switch_mutex);
-            atomic_store(&flag_logger_switch, FALSE);
-        }
+    char *batch = malloc(LOG_BATCH_SIZE);
+    if (!batch)
+        return NULL;
 
-        if (atomic_load(&flag_logger_terminate) == TRUE) {
+    while (TRUE) {
+        // Flaga czytana przed opróżnieniem, więc ostatni przebieg zapisuje wszystko sprzed log_close
+        int stop = atomic_load(&flag_logger_flush_stop);
+        log_flush_rings(batch);
+        if (stop == TRUE)
             break;
-        }
-        sleep(1);
+
+        struct pollfd poll_fd = {.fd = log_flush_fd, .events = POLLIN};
+        uint64_t value;
+        if (poll(&poll_fd, 1, LOG_FLUSH_INTERVAL_MS) > 0 && read(log_flush_fd, &value, sizeof(value)) == -1)
+            perror("eventfd read failed");
     }
 
+    free(batch);
     return NULL;
 }
 
-void *log_priority_thread_func(void *arg) {
-    sigset_t set;
+static int log_async_start(void) {
+    log_flush_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (log_flush_fd == -1)
+        return -1;
 
+    if (pthread_key_create(&log_ring_key, log_ring_release) != 0) {
+        close(log_flush_fd);
+        return -1;
+    }
+
+    atomic_store(&flag_logger_flush_stop, FALSE);
+    if (pthread_create(&log_flush_thread, NULL, log_flush_thread_func, NULL) != 0) {
+        pthread_key_delete(log_ring_key);
+        close(log_flush_fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void log_async_stop(void) {
+    atomic_store(&flag_logger_flush_stop, TRUE);
+    log_flush_wake();
+    pthread_join(log_flush_thread, NULL);
+    pthread_key_delete(log_ring_key);
+    close(log_flush_fd);
+    log_flush_fd = -1;
+
+    // Wątki, które jeszcze żyją, przy następnym wpisie wezmą nowy bufor
+    atomic_fetch_add_explicit(&log_epoch, 1, memory_order_release);
+    log_ring_t *ring = atomic_exchange(&log_rings, NULL);
+    while (ring) {
+        log_ring_t *next = ring->next;
+        free(ring->entries);
+        free(ring);
+        ring = next;
+    }
+    log_dropped_reported = 0;
+}
+
+void log_stats(log_stats_t *stats) {
+    stats->written = atomic_load(&log_written);
+    stats->flushes = atomic_load(&log_flushes);
+    stats->rotations = atomic_load(&log_rotations);
+    stats->dropped = 0;
+    stats->blocked = 0;
+
+    for (log_ring_t *ring = atomic_load(&log_rings); ring; ring = ring->next) {
+        stats->dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        stats->blocked += atomic_load_explicit(&ring->blocked, memory_order_relaxed);
+    }
+}
+
+static int log_signal_command(int signum) {
+    if (signum == LOG_DUMP_SIGNAL)
+        return LOG_COMMAND_DUMP;
+    if (signum == LOG_SWITCH_SIGNAL)
+        return LOG_COMMAND_SWITCH;
+    if (signum == LOG_PRIORITY_SIGNAL)
+        return LOG_COMMAND_PRIORITY;
+    if (signum == LOG_TERMINATE_SIGNAL)
+        return LOG_COMMAND_STOP;
+    return -1;
+}
+
+// Bezpieczna w handlerze sygnału: tylko licznik atomowy i write do eventfd
+static int log_control_post(int command) {
+    int error = errno;
+    uint64_t value = 1;
+
+    atomic_fetch_add(&log_commands[command], 1);
+    int result = write(log_control_fd, &value, sizeof(value)) == sizeof(value) ? 0 : -1;
+    errno = error;
+    return result;
+}
+
+int log_control(log_command_t command) {
+    if (atomic_load(&flag_logger_init) == FALSE || command < LOG_COMMAND_DUMP || command > LOG_COMMAND_PRIORITY) {
+        errno = EINVAL;
+        return -1;
+    }
+    return log_control_post(command);
+}
+
+void log_control_signal_handler(int signum) {
+    int command = log_signal_command(signum);
+    if (command != -1)
+        log_control_post(command);
+}
+
+/*
+ * Zapisuje dump. Kolejne dumpy w tej samej sekundzie dostają
+ * numer, żeby nie nadpisać poprzedniego pliku.
+ * */
+static void log_dump_run(void) {
+    pthread_mutex_lock(&log_dump_mutex);
+    if (state_dump_callback) {
+        char dump_filename[DUMP_FILENAME_SIZE] = {0};
+        time_t now = time(NULL);
+
+        log_dump_sequence = now == log_dump_second ? log_dump_sequence + 1 : 0;
+        log_dump_second = now;
+
+        datetime();
+        if (log_dump_sequence)
+            sprintf(dump_filename, "%s%d_%s_%u%s", DUMP_PREFIX, getpid(), datetime_buffer, log_dump_sequence,
+                    LOG_EXTENSION);
+        else
+            sprintf(dump_filename, "%s%d_%s%s", DUMP_PREFIX, getpid(), datetime_buffer, LOG_EXTENSION);
+
+        state_dump_callback(dump_filename, state_dump_args);
+    }
+    pthread_mutex_unlock(&log_dump_mutex);
+}
+
+// Wykonuje zebrane polecenia, zwraca TRUE gdy wątek ma się zakończyć
+static int log_control_run(void) {
+    // Sygnał zmienia poziom każdego komponentu
+    for (unsigned i = atomic_exchange(&log_commands[LOG_COMMAND_PRIORITY], 0); i > 0; --i)
+        for (int j = 0; j < LOG_COMPONENT_COUNT; ++j)
+            atomic_store(&log_levels[j], (atomic_load(&log_levels[j]) + 1) % 3);
+
+    if (atomic_exchange(&log_commands[LOG_COMMAND_SWITCH], 0) % 2)
+        atomic_fetch_xor(&log_state, ON);
+
+    for (unsigned i = atomic_exchange(&log_commands[LOG_COMMAND_DUMP], 0); i > 0; --i)
+        log_dump_run();
+
+    return atomic_exchange(&log_commands[LOG_COMMAND_STOP], 0) > 0;
+}
+
+void *log_control_thread_func(void *arg) {
+    sigset_t set;
     sigfillset(&set);
-    sigdelset(&set, LOG_PRIORITY_SIGNAL);
     pthread_sigmask(SIG_SETMASK, &set, NULL);
 
+    struct pollfd fds[2] = {
+            {.fd = log_signal_fd, .events = POLLIN},
+            {.fd = log_control_fd, .events = POLLIN}
+    };
+
     while (TRUE) {
-        sem_wait(&log_priority_sem);
-        if (atomic_load(&flag_logger_priority) == TRUE) {
-            pthread_mutex_lock(&log_priority_mutex);
-            logger.priority = (logger.priority + 1) % 3;
-            pthread_mutex_unlock(&log_priority_mutex);
-            atomic_store(&flag_logger_priority, FALSE);
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("log control poll failed");
+            break;
         }
 
-        if (atomic_load(&flag_logger_terminate) == TRUE) {
-            break;
+        if (fds[0].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(log_signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                int command = log_signal_command((int) info.ssi_signo);
+                if (command != -1)
+                    atomic_fetch_add(&log_commands[command], 1);
+            }
         }
-        sleep(1);
-    }
 
+        uint64_t value;
+        if ((fds[1].revents & POLLIN) && read(log_control_fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+            perror("eventfd read failed");
+
+        if (log_control_run())
+            break;
+    }
     return NULL;
 }
 
+/*
+ * Sygnały sterujące są blokowane w wątku wywołującym log_init,
+ * więc wątki tworzone później je dziedziczą i sygnały czeka na
+ * signalfd. Wątki starsze dostają je przez handler.
+ * */
+static int log_control_start(void) {
+    sigemptyset(&log_signals);
+    sigaddset(&log_signals, LOG_DUMP_SIGNAL);
+    sigaddset(&log_signals, LOG_SWITCH_SIGNAL);
+    sigaddset(&log_signals, LOG_PRIORITY_SIGNAL);
+    sigaddset(&log_signals, LOG_TERMINATE_SIGNAL);
+
+    for (int i = 0; i < LOG_COMMAND_COUNT; ++i)
+        atomic_store(&log_commands[i], 0);
+
+    log_control_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    log_signal_fd = signalfd(-1, &log_signals, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (log_control_fd == -1 || log_signal_fd == -1 ||
+        pthread_create(&log_control_thread, NULL, log_control_thread_func, NULL) != 0) {
+        if (log_control_fd != -1)
+            close(log_control_fd);
+        if (log_signal_fd != -1)
+            close(log_signal_fd);
+        log_control_fd = log_signal_fd = -1;
+        return -1;
+    }
+
+    // Zapamiętane tylko sygnały, które ta funkcja zablokowała, log_close zdejmuje blokadę tylko z nich
+    sigset_t previous;
+    pthread_sigmask(SIG_BLOCK, &log_signals, &previous);
+    sigemptyset(&log_blocked_signals);
+    for (int signum = SIGRTMIN; signum <= SIGRTMAX; ++signum)
+        if (sigismember(&log_signals, signum) && !sigismember(&previous, signum))
+            sigaddset(&log_blocked_signals, signum);
+
+    struct sigaction sa;
+    sigfillset(&sa.sa_mask);
+    sa.sa_handler = log_control_signal_handler;
+    sa.sa_flags = SA_RESTART;
+    for (int signum = SIGRTMIN; signum <= SIGRTMAX; ++signum)
+        if (sigismember(&log_signals, signum))
+            sigaction(signum, &sa, NULL);
+    return 0;
+}
+
+static void log_control_stop(void) {
+    log_control_post(LOG_COMMAND_STOP);
+    pthread_join(log_control_thread, NULL);
 
-int lprintf(log_priority_t priority, const char *format, ...) {
-    pthread_mutex_lock(&log_priority_mutex);
-    if (priority > logger.priority) {
-        pthread_mutex_unlock(&log_priority_mutex);
-        return 0;
+    struct sigaction sa;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = SIG_DFL;
+    sa.sa_flags = 0;
+
+    pthread_sigmask(SIG_UNBLOCK, &log_blocked_signals, NULL);
+    for (int signum = SIGRTMIN; signum <= SIGRTMAX; ++signum)
+        if (sigismember(&log_signals, signum))
+            sigaction(signum, &sa, NULL);
+
+    close(log_signal_fd);
+    close(log_control_fd);
+    log_signal_fd = log_control_fd = -1;
+}
+
+static void log_file_close(void) {
+    close(logger.fd);
+    logger.fd = -1;
+    free(logger.filename);
+    logger.filename = NULL;
+}
+
+void log_init(const char *filename, log_dump_func_t callback, void *dump_args) {
+    if (atomic_load(&flag_logger_init) == TRUE) {
+        errno = EFAULT;
+        return;
     }
-    pthread_mutex_unlock(&log_priority_mutex);
 
-    pthread_mutex_lock(&log_state_mutex);
-    if (logger.state == OFF) {
-        pthread_mutex_unlock(&log_state_mutex);
-        return 0;
+    char log_filename[LOG_FILENAME_SIZE] = {0};
+    if (!filename) {
+        datetime();
+        sprintf(log_filename, "%s%d_%s%s",LOG_PREFIX, getpid(), datetime_buffer,
+                log_format == LOG_FORMAT_BINARY ? LOG_BINARY_EXTENSION : LOG_EXTENSION);
+
+        filename = log_filename;
     }
-    pthread_mutex_unlock(&log_state_mutex);
+
+    logger.fd = open(filename, LOG_FILE_FLAGS, LOG_FILE_PERMISSIONS);
+    logger.filename = logger.fd != -1 ? strdup(filename) : NULL;
+    if (!logger.filename) {
+        if (logger.fd != -1)
+            close(logger.fd);
+        errno = EIO;
+        return;
+    }
+
+    if (log_format == LOG_FORMAT_BINARY && log_binary_open(filename) == -1) {
+        log_file_close();
+        errno = EIO;
+        return;
+    }
+    log_segment_prepare(logger.fd);
+
+    log_set_default_settings();
+
+    if (callback)
+        state_dump_callback = callback;
+    state_dump_args = dump_args;
+
+    if (log_control_start() == -1) {
+        if (log_format == LOG_FORMAT_BINARY)
+            log_binary_close();
+        log_file_close();
+        errno = EINVAL;
+        return;
+    }
+
+    // Bez wątku zapisującego logi idą synchronicznie
+    log_async = log_mode != LOG_SYNC && log_async_start() == 0;
+
+    atomic_store(&flag_logger_init, TRUE);
+}
+
+static int log_vprintf(log_priority_t priority, const char *format, va_list args) {
+    /*
+     * Przed log_init i po log_close nie ma pliku logu, wpis
+     * trafiłby do deskryptora 0 albo do zamkniętego.
+     * */
+    if (atomic_load_explicit(&flag_logger_init, memory_order_acquire) == FALSE ||
+        atomic_load_explicit(&log_state, memory_order_relaxed) == OFF)
+        return 0;
 
     char *priority_sign;
 
@@ -312,23 +1126,104 @@ int lprintf(log_priority_t priority, const char *format, ...) {
         case MAX:
             priority_sign = "###";
             break;
+        default:
+            priority_sign = "?";
+            break;
+    }
+
+    if (log_async)
+        return log_async_vprintf(priority, priority_sign, format, args);
+
+    if (log_format == LOG_FORMAT_BINARY) {
+        char record[LOG_BINARY_MAX_RECORD];
+        size_t length = log_binary_encode(record, sizeof(record), priority, format, args);
+        log_write(record, length);
+        return (int) length;
+    }
+
+    // Cała linia idzie jednym write do pliku O_APPEND, więc linie wątków się nie przeplatają
+    char line[LOG_LINE_SIZE];
+    va_list copy;
+    va_copy(copy, args);
+
+    int prefix = snprintf(line, sizeof(line), "[%3s]<%s>", priority_sign, log_timestamp());
+    int text = vsnprintf(line + prefix, sizeof(line) - (size_t) prefix, format, args);
+    int result = text < 0 ? prefix : prefix + text;
+
+    if (result < (int) sizeof(line)) {
+        log_write(line, (size_t) result);
+    } else {
+        char *long_line = malloc((size_t) result + 1);
+        if (long_line) {
+            memcpy(long_line, line, (size_t) prefix);
+            vsnprintf(long_line + prefix, (size_t) text + 1, format, copy);
+            log_write(long_line, (size_t) result);
+            free(long_line);
+        }
     }
 
+    va_end(copy);
+    return result;
+}
+
+int lprintf(log_priority_t priority, const char *format, ...) {
+    if ((int) priority > atomic_load_explicit(&log_levels[LOG_CORE], memory_order_relaxed))
+        return 0;
+
     va_list args;
     va_start(args, format);
+    int result = log_vprintf(priority, format, args);
+    va_end(args);
 
-    datetime();
+    return result;
+}
 
-    pthread_mutex_lock(&log_logfile_mutex);
-    int result = fprintf(logger.logfile, "[%3s]<%s>", priority_sign, datetime_buffer);
-    vfprintf(logger.logfile, format, args);
-    pthread_mutex_unlock(&log_logfile_mutex);
+int log_printf(log_component_t component, log_priority_t priority, const char *format, ...) {
+    if ((int) priority > atomic_load_explicit(&log_levels[component], memory_order_relaxed))
+        return 0;
 
+    va_list args;
+    va_start(args, format);
+    int result = log_vprintf(priority, format, args);
     va_end(args);
 
     return result;
 }
 
+void log_set_level(log_component_t component, log_priority_t level) {
+    atomic_store(&log_levels[component], level);
+}
+
+int log_levels_parse(const char *spec) {
+    char *copy = strdup(spec), *save = NULL;
+    if (!copy)
+        return -1;
+
+    int result = 0;
+    for (char *item = strtok_r(copy, LOG_LEVELS_SEPARATOR, &save); item && result == 0;
+         item = strtok_r(NULL, LOG_LEVELS_SEPARATOR, &save)) {
+        char *level = strchr(item, '=');
+        int component = LOG_COMPONENT_COUNT, priority = MAX + 1;
+        if (level)
+            *level++ = '\0';
+
+        for (int i = 0; level && i < LOG_COMPONENT_COUNT; ++i)
+            if (strcmp(item, log_component_names[i]) == 0)
+                component = i;
+        for (int i = LOW; level && i <= MAX; ++i)
+            if (strcmp(level, log_level_names[i]) == 0)
+                priority = i;
+
+        if (component == LOG_COMPONENT_COUNT || priority > MAX)
+            result = -1;
+        else
+            log_set_level((log_component_t) component, (log_priority_t) priority);
+    }
+
+    free(copy);
+    return result;
+}
+
 void log_register_state_dump_callback(log_dump_func_t callback, void *args) {
     pthread_mutex_lock(&log_dump_mutex);
 
@@ -337,11 +1232,7 @@ void log_register_state_dump_callback(log_dump_func_t callback, void *args) {
     }
 
     if (args) {
-        atomic_store(&flag_logger_change_dump_func, TRUE);
-        sem_post(&log_dump_sem);
-        pthread_join(log_dump_thread, NULL);
-
-        pthread_create(&log_dump_thread, NULL, log_dump_thread_func, args);
+        state_dump_args = args;
     }
     pthread_mutex_unlock(&log_dump_mutex);
 }
@@ -350,38 +1241,35 @@ void datetime(void) {
     strcpy(datetime_buffer,"");
 
     time_t curr_time = time(NULL);
-    struct tm *time_info = localtime(&curr_time);
+    struct tm time_info;
+    localtime_r(&curr_time, &time_info);
 
-    strftime(datetime_buffer, 20, "%y-%m-%d_%H.%M.%S", time_info);
+    strftime(datetime_buffer, DATETIME_BUFFER_SIZE, DATETIME_FORMAT, &time_info);
 }
 
 void log_set_default_settings(void) {
-    pthread_mutex_lock(&log_priority_mutex);
-    pthread_mutex_lock(&log_state_mutex);
-    logger.priority = MAX;
-    logger.state = ON;
-    pthread_mutex_unlock(&log_priority_mutex);
-    pthread_mutex_unlock(&log_state_mutex);
+    for (int i = 0; i < LOG_COMPONENT_COUNT; ++i)
+        atomic_store(&log_levels[i], MAX);
+    atomic_store(&log_state, ON);
 }
 
 void log_close(void) {
     if (atomic_load(&flag_logger_init) == FALSE)
         return;
 
-    raise(LOG_TERMINATE_SIGNAL);
-    pthread_join(log_dump_thread, NULL);
-    pthread_join(log_switch_thread, NULL);
-    pthread_join(log_priority_thread, NULL);
-    struct sigaction sa;
-
-    sa.sa_handler = SIG_DFL;
-    sa.sa_flags = 0;
-
-    sigaction(LOG_PRIORITY_SIGNAL, &sa, NULL);
-    sigaction(LOG_SWITCH_SIGNAL, &sa, NULL);
-    sigaction(LOG_DUMP_SIGNAL, &sa, NULL);
+    log_control_stop();
 
     atomic_store(&flag_logger_init, FALSE);
-    fclose(logger.logfile);
+    if (log_async) {
+        log_async_stop();
+        log_async = FALSE;
+    }
+    // Nikt już nie pisze, więc można zwolnić zarezerwowane miejsce
+    struct stat status;
+    if (fstat(logger.fd, &status) == 0 && ftruncate(logger.fd, status.st_size) == -1)
+        perror("log truncate failed");
+    log_file_close();
+    if (log_format == LOG_FORMAT_BINARY)
+        log_binary_close();
 }
 
@@ -6,6 +6,12 @@
 #define LOG_PRIORITY_SIGNAL     (SIGRTMIN + 2)
 #define LOG_TERMINATE_SIGNAL    (SIGRTMIN + 3)
 
+#define LOG_DEFAULT_RING_ENTRIES (1024)
+#define LOG_DEFAULT_SEGMENTS (5)
+
+#include <stddef.h>
+#include <stdatomic.h>
+
 /*
  * Wartości określające priorytet komunikatu logowania
  * */
@@ -15,11 +21,176 @@ typedef enum {
     MAX
 } log_priority_t;
 
+/*
+ * Komponenty z osobnym poziomem logowania, np. śledzenie
+ * uruchomień (LOG_SPAWN) można włączyć bez komunikatów IPC.
+ * */
+typedef enum {
+    LOG_CORE,
+    LOG_SCHEDULER,
+    LOG_IPC,
+    LOG_SPAWN,
+    LOG_COMPONENT_COUNT
+} log_component_t;
+
+/*
+ * Poziom ustalany przy kompilacji (-DLOG_MIN_LEVEL=LOW|MID):
+ * wywołania LPRINTF z priorytetem wyższym niż ten poziom są
+ * usuwane z programu, tak jakby poziom logowania nigdy nie
+ * przekraczał LOG_MIN_LEVEL.
+ * */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL MAX
+#endif
+
+/*
+ * Komponent wywołań LPRINTF w danym pliku, definiowany
+ * przed dołączeniem nagłówków.
+ * */
+#ifndef LOG_COMPONENT
+#define LOG_COMPONENT LOG_CORE
+#endif
+
+/*
+ * Poziomy komponentów, wpis o priorytecie wyższym niż poziom
+ * komponentu jest pomijany. Czytane bez blokad przez LPRINTF.
+ * */
+extern atomic_int log_levels[LOG_COMPONENT_COUNT];
+
+/*
+ * Makra sprawdzające poziom przed obliczeniem argumentów,
+ * wyłączone wywołanie kosztuje jeden odczyt atomowy.
+ * */
+#define LPRINTF_AT(component, priority, ...)                                                        \
+    do {                                                                                            \
+        if ((priority) <= LOG_MIN_LEVEL &&                                                          \
+            (int) (priority) <= atomic_load_explicit(&log_levels[component], memory_order_relaxed)) \
+            log_printf(component, priority, __VA_ARGS__);                                           \
+    } while (0)
+
+#define LPRINTF(priority, ...) LPRINTF_AT(LOG_COMPONENT, priority, __VA_ARGS__)
+
+/*
+ * Tryby zapisu logów. W trybach asynchronicznych lprintf formatuje wpis
+ * do bufora cyklicznego własnego wątku, bez żadnych blokad, a do pliku
+ * zapisuje je osobny wątek dużymi porcjami. Gdy bufor jest pełny, wpis
+ * jest odrzucany (LOG_ASYNC_DROP) albo wątek czeka na miejsce
+ * (LOG_ASYNC_BLOCK).
+ * */
+typedef enum {
+    LOG_SYNC,
+    LOG_ASYNC_DROP,
+    LOG_ASYNC_BLOCK
+} log_mode_t;
+
+/*
+ * Dokładność znacznika czasu w logach. Milisekundy i
+ * mikrosekundy pokazują opóźnienia harmonogramu.
+ * */
+typedef enum {
+    LOG_TIME_SECONDS,
+    LOG_TIME_MILLISECONDS,
+    LOG_TIME_MICROSECONDS
+} log_time_resolution_t;
+
+/*
+ * Format pliku logu. Wpis binarny zawiera tylko id formatu,
+ * czas, priorytet i argumenty, bez formatowania tekstu. Formaty
+ * są zapisywane raz do pliku obok logu, a tekst odtwarza
+ * program logdecode.
+ * */
+typedef enum {
+    LOG_FORMAT_TEXT,
+    LOG_FORMAT_BINARY
+} log_format_t;
+
+/*
+ * Liczniki trybu asynchronicznego: zapisane i odrzucone wpisy, wpisy
+ * na które wątek musiał czekać, liczba wywołań write oraz rotacji.
+ * */
+typedef struct {
+    unsigned long long written;
+    unsigned long long dropped;
+    unsigned long long blocked;
+    unsigned long long flushes;
+    unsigned long long rotations;
+} log_stats_t;
+
+/*
+ * Polecenia wątku sterującego, te same co sygnały
+ * LOG_DUMP_SIGNAL, LOG_SWITCH_SIGNAL i LOG_PRIORITY_SIGNAL.
+ * */
+typedef enum {
+    LOG_COMMAND_DUMP,
+    LOG_COMMAND_SWITCH,
+    LOG_COMMAND_PRIORITY
+} log_command_t;
+
 /*
  * Zdefiniowany typ uchwytu do funckji dump.
  * */
 typedef void (*log_dump_func_t)(const char *filename, void *args);
 
+/*
+ * Funkcja ustawiająca tryb zapisu i rozmiar bufora
+ * wątku (w wpisach). Wywoływana przed log_init.
+ * */
+int log_set_mode(log_mode_t mode, size_t ring_entries);
+
+/*
+ * Funkcja zamieniająca nazwę trybu (sync, block, drop)
+ * na wartość log_mode_t.
+ * */
+log_mode_t log_mode_parse(const char *name);
+
+/*
+ * Funkcja ustawiająca dokładność znacznika czasu.
+ * */
+void log_set_time_resolution(log_time_resolution_t resolution);
+
+/*
+ * Funkcja zamieniająca nazwę dokładności (s, ms, us)
+ * na wartość log_time_resolution_t.
+ * */
+log_time_resolution_t log_time_resolution_parse(const char *name);
+
+/*
+ * Funkcja ustawiająca format pliku logu. Wywoływana
+ * przed log_init.
+ * */
+int log_set_format(log_format_t format);
+
+/*
+ * Funkcja zamieniająca nazwę formatu (text, binary)
+ * na wartość log_format_t.
+ * */
+log_format_t log_format_parse(const char *name);
+
+/*
+ * Funkcja ustawiająca poziom komponentu.
+ * */
+void log_set_level(log_component_t component, log_priority_t level);
+
+/*
+ * Funkcja ustawiająca poziomy z opisu "komponent=poziom,..."
+ * (core, scheduler, ipc, spawn; low, mid, max). Zwraca -1
+ * przy nieznanej nazwie, poprzednie wpisy są już ustawione.
+ * */
+int log_levels_parse(const char *spec);
+
+/*
+ * Funkcja ustawiająca rotację logu: nowy segment zaczyna się
+ * po max_bytes bajtach albo po interval sekundach (0 wyłącza
+ * warunek), zachowywanych jest segments poprzednich segmentów
+ * (log.1 to najnowszy). Wywoływana przed log_init.
+ * */
+int log_set_rotation(size_t max_bytes, unsigned interval, unsigned segments);
+
+/*
+ * Funkcja zwracająca liczniki trybu asynchronicznego.
+ * */
+void log_stats(log_stats_t *stats);
+
 /*
  * Funkcja inicjalizująca systom logowania do
  * plików.
@@ -32,12 +203,24 @@ void log_init(const char *filename, log_dump_func_t callback, void *dump_args);
  * */
 int lprintf(log_priority_t priority, const char *format, ...);
 
+/*
+ * Funkcja zapisująca treść logu komponentu, zwykle
+ * wywoływana przez makro LPRINTF.
+ * */
+int log_printf(log_component_t component, log_priority_t priority, const char *format, ...);
+
 /*
  * Funkcja określająca zachowanie funckji dump z
  * opcjonalnymmi argumentami.
  * */
 void log_register_state_dump_callback(log_dump_func_t callback, void *args);
 
+/*
+ * Funkcja zlecająca polecenie wątkowi sterującemu, bez
+ * wysyłania sygnału. Można ją wywołać w handlerze sygnału.
+ * */
+int log_control(log_command_t command);
+
 /*
  * Funkcja zamykająca system logowania plików.
  * */
@@ -1,445 +1,1021 @@
-#include "cron_utils.h"
-
-static list_t list;
+#define LOG_COMPONENT LOG_IPC
+#include "journal.h"
+#include "crontab.h"
+#include "server.h"
+#include "shm_view.h"
+#include "task_snapshot.h"
+#include "cronclient.h"
+
+static task_table_t tasks;
+static task_view_cache_t task_views;
+static shm_view_t shared_view;
+static journal_t journal;
+static scheduler_t scheduler;
+static spawner_t spawner;
+static spawn_pool_t spawn_pool;
+static reaper_t reaper;
+static metrics_t metrics;
+static snapshot_format_t dump_format;
 
 // Mutexes
-static pthread_mutex_t list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t tasks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static server_t server;
+static transport_t transports[2];
 
 // Semaphores
-static sem_t *server_free = NULL;
 static sem_t process_sem;
 
-// Message buffer
-static msgbuf_t server_msgbuf;
-
-// Example dump function
+/*
+ * One parsed operation of a BATCH request. Once it is applied, task holds
+ * the task as it was left by the operation and previous (or cleared, for
+ * a DELETE of every task) what it replaced, so the batch can be undone.
+ */
+typedef struct {
+    const proto_op_t *op;
+    task_t task;
+    task_t previous;
+    task_t *cleared;
+    size_t cleared_count;
+    uint64_t id;
+    proto_status_t status;
+} batch_op_t;
+
+// Runs on the logger control thread, the table lock is held only while the snapshot is taken
 void dump_func(const char *filename, void *args) {
+    task_snapshot_t snapshot;
+    if (task_snapshot_take(&snapshot, (task_view_cache_t *) args) == -1) {
+        printf("Failed to take a snapshot for the dump\n");
+        return;
+    }
+
     FILE *f = fopen(filename,"w");
     if (!f) {
         printf("Failed to create dump file\n");
+        task_snapshot_release(&snapshot);
         return;
     }
 
-    pthread_mutex_lock(&list_mutex);
-    list_print_to_file(&list, f);
-    pthread_mutex_unlock(&list_mutex);
+    task_snapshot_write(&snapshot, dump_format, f);
+    task_snapshot_release(&snapshot);
+
+    // Spawn pool counters only fit the text dump
+    if (dump_format == SNAPSHOT_JSONL) {
+        fclose(f);
+        return;
+    }
+
+    spawn_pool_stats_t stats;
+    spawn_pool_stats(&spawn_pool, &stats);
+    fprintf(f, "Spawn queue: depth %lu (max %lu) | submitted %lu | rejected %lu | spawned %lu | failed %lu\n",
+            stats.depth, stats.max_depth, stats.submitted, stats.rejected, stats.spawned, stats.failed);
+    fprintf(f, "Spawn wait: avg %lu us | max %lu us\n",
+            stats.submitted ? stats.total_wait_ns / stats.submitted / 1000 : 0, stats.max_wait_ns / 1000);
     fclose(f);
 }
 
-int main(int argc, char **argv) {
-    server_free = sem_open(SEM_NAME, O_RDWR);
-    if (server_free == SEM_FAILED && fork() != 0) {
-        server_free = sem_open(SEM_NAME, O_CREAT | O_EXCL | O_RDONLY, 0666, 2);
-        if (server_free == SEM_FAILED) {
-            printf("Failed to create semaphore.\n");
-            return 1;
+// Called by the reaper thread for every finished run
+void run_exit_func(const reaper_run_t *run, void *args) {
+    pthread_mutex_lock(&tasks_mutex);
+    task_t *task = task_table_find((task_table_t *) args, run->task_id);
+    if (task)
+        task_record_run(task, run);
+    pthread_mutex_unlock(&tasks_mutex);
+    metrics_record(&metrics, METRIC_RUN, run->wall_us * 1000);
+
+    LPRINTF_AT(LOG_SPAWN, MID, "[PID:%d]: Exited with status %d | wall %lu us | cpu %lu us | max rss %ld kB\n",
+               run->pid, WIFEXITED(run->status) ? WEXITSTATUS(run->status) : 128 + WTERMSIG(run->status),
+               run->wall_us, run->cpu_us, run->max_rss_kb);
+}
+
+// Applies one operation of a batch with tasks_mutex held, a failed operation leaves the table as it was
+static proto_status_t batch_op_apply(batch_op_t *entry) {
+    task_t *task;
+
+    switch (entry->op->type) {
+        case PROTO_OP_ADD: {
+            entry->id = task_table_add(&tasks, entry->task);
+            if (!entry->id)
+                return PROTO_FAILED;
+            entry->task = *task_table_find(&tasks, entry->id);
+            return PROTO_OK;
+        }
+        case PROTO_OP_EDIT: {
+            // Missing here only when deleted by an earlier operation of the same batch
+            if (!(task = task_table_find(&tasks, entry->id)))
+                return PROTO_NOT_FOUND;
+
+            entry->previous = *task;
+            if (task_table_edit(&tasks, entry->id, entry->task) == -1) {
+                task_table_restore(&tasks, &entry->previous);
+                return PROTO_FAILED;
+            }
+            entry->task = *task_table_find(&tasks, entry->id);
+            return PROTO_OK;
         }
+        case PROTO_OP_DELETE: {
+            if (entry->id != TASK_ID_ALL) {
+                if (!(task = task_table_find(&tasks, entry->id)))
+                    return PROTO_NOT_FOUND;
+                entry->previous = *task;
+                task_table_remove(&tasks, entry->id);
+                return PROTO_OK;
+            }
 
-        mq_attr_t mq_attr = {.mq_curmsgs = 0, .mq_msgsize = sizeof(msgbuf_t), .mq_maxmsg = MSG_MAX_COUNT, .mq_flags = 0};
-        mqd_t mqd = mq_open((const char *) QUEUE_NAME, O_CREAT | O_EXCL | O_RDWR, 0666, &mq_attr);
-        if (mqd == -1) {
-            printf("Failed to create queue.\n");
-            return 1;
+            size_t cursor = 0;
+            entry->cleared = malloc((task_table_size(&tasks) ? task_table_size(&tasks) : 1) * sizeof(task_t));
+            if (!entry->cleared)
+                return PROTO_FAILED;
+            while ((task = task_table_next(&tasks, &cursor)))
+                entry->cleared[entry->cleared_count++] = *task;
+            task_table_clear(&tasks);
+            return PROTO_OK;
         }
+    }
+    return PROTO_INVALID;
+}
 
-        if (sem_init(&process_sem, 0, 0) == -1) {
-            printf("Failed to init thread semaphore.\n");
-            mq_close(mqd);
-            mq_unlink(QUEUE_NAME);
-            return 1;
+// Undoes the first count operations of a batch in reverse order, restored tasks keep their id and anchor
+static void batch_rollback(batch_op_t *ops, size_t count) {
+    while (count-- > 0) {
+        batch_op_t *entry = &ops[count];
+
+        switch (entry->op->type) {
+            case PROTO_OP_ADD: {
+                task_table_remove(&tasks, entry->id);
+                entry->id = 0;
+                break;
+            }
+            case PROTO_OP_EDIT: {
+                task_table_restore(&tasks, &entry->previous);
+                break;
+            }
+            case PROTO_OP_DELETE: {
+                if (entry->id != TASK_ID_ALL)
+                    task_table_restore(&tasks, &entry->previous);
+                for (size_t i = 0; i < entry->cleared_count; ++i)
+                    task_table_restore(&tasks, &entry->cleared[i]);
+                break;
+            }
         }
+    }
 
-        list_init(&list);
+    if (task_table_schedule_all(&tasks, scheduler_now(&scheduler)) == -1)
+        printf("Failed to schedule tasks restored by a batch rollback.\n");
+}
 
-        log_init(NULL,dump_func,&list);
+/*
+ * Applies a BATCH request atomically. Every operation is parsed and checked
+ * before anything is changed; if one of them is rejected the batch is not
+ * applied and the others are reported as PROTO_ABORTED. Otherwise all
+ * operations are applied under one acquisition of tasks_mutex, and if one
+ * of them still fails (a task deleted twice, an add out of memory) or the
+ * batch cannot be journaled, the ones already applied are rolled back.
+ * The batch is journaled as one record, so a crash never replays part of
+ * it. Returns the status of the batch and appends one result per
+ * operation to results.
+ */
+static proto_status_t batch_apply(const proto_buffer_t *request, proto_buffer_t *results) {
+    size_t count = request->count, parsed = 0, offset = 0;
+    const proto_op_t *op;
+    const char *text;
+
+    if (count == 0)
+        return request->length ? PROTO_INVALID : PROTO_OK;
+
+    batch_op_t *ops = malloc(count * sizeof(batch_op_t));
+    journal_batch_op_t *logged = malloc(count * sizeof(journal_batch_op_t));
+    if (!ops || !logged) {
+        free(ops);
+        free(logged);
+        return PROTO_FAILED;
+    }
 
-        printf("PID: %d\n", getpid());
+    // Parsing is the expensive part of an operation, it does not need the lock
+    while (parsed < count && (op = proto_next_op(request, &offset, &text))) {
+        batch_op_t *entry = &ops[parsed++];
+        entry->op = op;
+        entry->id = op->id;
+        entry->status = PROTO_OK;
+        entry->cleared = NULL;
+        entry->cleared_count = 0;
+
+        if (op->type == PROTO_OP_ADD || op->type == PROTO_OP_EDIT) {
+            if (op->timer_type > I_RELATIVE || (op->type == PROTO_OP_EDIT && op->id == TASK_ID_ALL) ||
+                task_parse_line(text, op->length, &entry->task) != 1)
+                entry->status = PROTO_INVALID;
+            else
+                entry->task.timer_type = op->timer_type;
+        } else if (op->type != PROTO_OP_DELETE) {
+            entry->status = PROTO_INVALID;
+        }
+    }
 
-        int end = 0;
-
-        while (!end) {
-            mq_receive(mqd, (char *) &server_msgbuf, sizeof(msgbuf_t), 0);
-            switch (server_msgbuf.mtype) {
-                case ADD: {
-                    lprintf(MID,"[PID:%d]: Add\n", server_msgbuf.pid);
-                    pthread_mutex_lock(&list_mutex);
-                    list_push(&list, server_msgbuf.task);
-                    pthread_mutex_unlock(&list_mutex);
-                    break;
-                }
-                case DELETE: {
-                    lprintf(MID,"[PID:%d]: Delete\n", server_msgbuf.pid);
-                    pthread_mutex_lock(&list_mutex);
-                    if (server_msgbuf.idx == -1)
-                        list_clear(&list);
-                    else
-                        list_remove_index(&list, server_msgbuf.idx);
-                    pthread_mutex_unlock(&list_mutex);
-                    break;
-                }
-                case EDIT: {
-                    lprintf(MID,"[PID:%d]: Edit\n", server_msgbuf.pid);
-                    pthread_mutex_lock(&list_mutex);
-                    task_edit(&list, server_msgbuf.task, server_msgbuf.idx);
-                    pthread_mutex_unlock(&list_mutex);
-                    break;
-                }
-                case LIST: {
-                    lprintf(MID,"[PID:%d]: List\n", server_msgbuf.pid);
-                    char client_mq_name[CLIENT_MQ_NAME_LEN];
-                    sprintf(client_mq_name, "%s%d", CLIENT_QUEUE_PREFIX, server_msgbuf.pid);
-
-                    mqd_t client_mqd = mq_open(client_mq_name, O_WRONLY, 0666);
-                    if (client_mqd == -1) {
-                        lprintf(LOW,"[PID:%d]: Failed to connect with client queue.\n", server_msgbuf.pid);
-                        break;
-                    }
+    if (parsed != count || offset != request->length) {
+        for (size_t i = 0; i < parsed; ++i)
+            free(ops[i].cleared);
+        free(ops);
+        free(logged);
+        return PROTO_INVALID;
+    }
 
-                    response_t response;
-                    pthread_mutex_lock(&list_mutex);
-                    node_t *node = list.head;
+    proto_status_t status = PROTO_OK;
+    size_t applied = 0;
+
+    pthread_mutex_lock(&tasks_mutex);
+    for (size_t i = 0; i < count; ++i) {
+        batch_op_t *entry = &ops[i];
+        if (entry->status == PROTO_OK && entry->op->type != PROTO_OP_ADD && entry->id != TASK_ID_ALL &&
+            !task_table_find(&tasks, entry->id))
+            entry->status = PROTO_NOT_FOUND;
+        if (entry->status != PROTO_OK && status == PROTO_OK)
+            status = entry->status;
+    }
+    int rejected = status != PROTO_OK;
 
-                    if (!node) {
-                        response.is_next = -1;
-                        mq_send(client_mqd, (char *) &response, sizeof(response_t), 0);
-                    }
+    for (; status == PROTO_OK && applied < count; ++applied) {
+        batch_op_t *entry = &ops[applied];
+        if ((entry->status = batch_op_apply(entry)) != PROTO_OK) {
+            status = entry->status;
+            break;
+        }
 
-                    while (node) {
-                        response.task = node->task;
-                        node = node->next;
-                        response.is_next = node ? 1 : 0;
-                        mq_send(client_mqd, (char *) &response, sizeof(response_t), 0);
-                    }
+        logged[applied].op = entry->op->type == PROTO_OP_ADD ? JOURNAL_ADD :
+                             entry->op->type == PROTO_OP_EDIT ? JOURNAL_EDIT : JOURNAL_DELETE;
+        logged[applied].id = entry->id;
+        logged[applied].task = entry->op->type == PROTO_OP_DELETE ? NULL : &entry->task;
+    }
 
-                    pthread_mutex_unlock(&list_mutex);
-                    mq_close(client_mqd);
+    // Tasks that are not in the journal would silently disappear on restart
+    if (status == PROTO_OK && journal_log_batch(&journal, logged, count) == -1)
+        status = PROTO_FAILED;
 
-                    break;
-                }
-                case CLOSE_CLIENT: {
-                    lprintf(MID,"[PID:%d]: Close client\n", server_msgbuf.pid);
-                    sem_post(server_free);
+    if (status != PROTO_OK) {
+        if (!rejected)
+            batch_rollback(ops, applied);
+        for (size_t i = 0; i < count; ++i)
+            if (ops[i].status == PROTO_OK)
+                ops[i].status = applied == count ? PROTO_FAILED : PROTO_ABORTED;
+    }
+    pthread_mutex_unlock(&tasks_mutex);
+
+    for (size_t i = 0; i < count; ++i) {
+        proto_add_result(results, ops[i].status, ops[i].id);
+        free(ops[i].cleared);
+    }
 
-                    break;
+    free(ops);
+    free(logged);
+    return status;
+}
+
+// Runs on the server's handler threads, DESTROY never gets here
+static void request_handle(server_request_t *request, void *args) {
+    proto_header_t *header = &request->header;
+    proto_buffer_t *reply = &request->reply;
+
+    request->reply_type = RESULTS;
+    request->status = PROTO_OK;
+
+    switch (header->type) {
+        case BATCH: {
+            LPRINTF(MID, "[PID:%d]: Batch of %u operations\n", header->pid, request->payload.count);
+            request->status = batch_apply(&request->payload, reply);
+            shm_view_notify(&shared_view);
+            break;
+        }
+        case LIST: {
+            LPRINTF(MID, "[PID:%d]: List\n", header->pid);
+            request->reply_type = LIST;
+
+            proto_list_request_t list;
+            if (request->payload.length != sizeof(list)) {
+                request->status = PROTO_INVALID;
+                break;
+            }
+            memcpy(&list, request->payload.data, sizeof(list));
+            if (list.limit < 1 || list.limit > PROTO_LIST_MAX_LIMIT)
+                list.limit = PROTO_LIST_DEFAULT_LIMIT;
+
+            // Pages come from a copy of the table, the table lock is not held while they are built
+            task_view_t *view = task_view_acquire(&task_views);
+            if (!view || task_view_page(view, list.cursor, list.limit, reply) == -1) {
+                request->status = PROTO_FAILED;
+                proto_buffer_reset(reply);
+            }
+            task_view_release(view);
+            break;
+        }
+        case STATS: {
+            LPRINTF(MID, "[PID:%d]: Stats\n", header->pid);
+            request->reply_type = STATS;
+
+            uint64_t id;
+            if (request->payload.length != sizeof(id)) {
+                request->status = PROTO_INVALID;
+                break;
+            }
+            memcpy(&id, request->payload.data, sizeof(id));
+
+            if (id == TASK_ID_ALL) {
+                for (int metric = 0; metric < METRIC_COUNT && request->status == PROTO_OK; ++metric) {
+                    histogram_summary_t summary;
+                    metrics_summary(&metrics, metric, &summary);
+                    proto_stats_t stats = {.metric = metric, .quantiles = 1, .count = summary.count,
+                                           .sum = summary.sum, .max = summary.max, .p50 = summary.p50,
+                                           .p90 = summary.p90, .p99 = summary.p99, .p999 = summary.p999};
+                    if (proto_add_stats(reply, &stats) == -1)
+                        request->status = PROTO_FAILED;
                 }
-                case DESTROY: {
-                    lprintf(MID,"[PID:%d]: Close\n", server_msgbuf.pid);
-                    end = 1;
-                    break;
+            } else {
+                // A task keeps totals and maxima only, a histogram per task would outweigh the task itself
+                pthread_mutex_lock(&tasks_mutex);
+                task_t *task = task_table_find(&tasks, id);
+                if (task) {
+                    task_stats_t *task_stats = &task->stats;
+                    proto_stats_t lag = {.metric = METRIC_FIRE_LAG, .count = task_stats->runs,
+                                         .sum = task_stats->total_lag_us * 1000, .max = task_stats->max_lag_us * 1000};
+                    proto_stats_t run = {.metric = METRIC_RUN, .count = task_stats->runs,
+                                         .sum = task_stats->total_wall_us * 1000,
+                                         .max = task_stats->max_wall_us * 1000};
+                    if (proto_add_stats(reply, &lag) == -1 || proto_add_stats(reply, &run) == -1)
+                        request->status = PROTO_FAILED;
+                } else {
+                    request->status = PROTO_NOT_FOUND;
                 }
+                pthread_mutex_unlock(&tasks_mutex);
             }
+
+            if (request->status != PROTO_OK)
+                proto_buffer_reset(reply);
+            break;
         }
+        case IMPORT: {
+            LPRINTF(MID, "[PID:%d]: Import %u tasks\n", header->pid, header->count);
+
+            // The client leaves the parsed tasks in a shared memory object named after its pid
+            char shm_name[IMPORT_SHM_NAME_LEN];
+            sprintf(shm_name, "%s%d", IMPORT_SHM_PREFIX, header->pid);
+            size_t count = header->count;
+            size_t size = count * sizeof(task_t);
+            task_t *imported = NULL;
+            struct stat st;
+
+            // The segment belongs to the client and can change under us, so the records are read into a private
+            // copy and checked there; a read cannot fault the way a mapping of a shrunk segment would
+            int shm_fd = shm_open(shm_name, O_RDONLY, 0);
+            if (shm_fd != -1 && count && fstat(shm_fd, &st) == 0 && (size_t) st.st_size >= size &&
+                (imported = malloc(size)) && pread(shm_fd, imported, size, 0) != (ssize_t) size) {
+                free(imported);
+                imported = NULL;
+            }
+            if (shm_fd != -1)
+                close(shm_fd);
+
+            task_t **added = imported ? malloc(count * sizeof(task_t *)) : NULL;
+            request->status = added ? PROTO_OK : PROTO_FAILED;
+            for (size_t i = 0; i < count && request->status == PROTO_OK; ++i)
+                if (!task_record_validate(&imported[i]))
+                    request->status = PROTO_INVALID;
+
+            if (request->status == PROTO_OK) {
+                pthread_mutex_lock(&tasks_mutex);
+                if (task_table_add_batch(&tasks, imported, count, added) == -1) {
+                    request->status = PROTO_FAILED;
+                } else if (journal_log_import(&journal, added, count) == -1) {
+                    // Tasks that are not in the journal would silently disappear on restart
+                    for (size_t i = 0; i < count; ++i)
+                        task_table_remove(&tasks, added[i]->id);
+                    request->status = PROTO_FAILED;
+                } else {
+                    reply->count = header->count;
+                }
+                pthread_mutex_unlock(&tasks_mutex);
+            }
 
-        sem_destroy(&process_sem);
+            free(added);
+            free(imported);
+            shm_view_notify(&shared_view);
+            break;
+        }
+        default: {
+            LPRINTF(LOW, "[PID:%d]: Unknown request %u\n", header->pid, header->type);
+            request->status = PROTO_UNSUPPORTED;
+            break;
+        }
+    }
+}
 
-        sem_close(server_free);
-        sem_unlink(SEM_NAME);
+// Prompts for the time fields and the path, text receives them as one "min h d m wd path" line
+static int task_text_read(char *text, size_t size) {
+    char time_data[5][TIME_SPEC_FIELD_LEN];
+    char exec_file_path[EXEC_FILE_PATH_LEN];
+    ctime_spec_t time_spec;
+    char *prompt = "┌──────────── minutes (0 - 59)\n"
+                   "│ ┌──────────── hours (0 - 23)\n"
+                   "│ │ ┌──────────── months day (1 - 31)\n"
+                   "│ │ │ ┌──────────── month (1 - 12)\n"
+                   "│ │ │ │ ┌──────────── weekday  (1 - 7) (monday - sunday)\n"
+                   "│ │ │ │ │\n"
+                   "│ │ │ │ │\n"
+                   "│ │ │ │ │\n";
+    printf("%s", prompt);
+
+    for (int i = 0; i < 5; ++i)
+        scanf("%63s", time_data[i]);
+
+    exec_file_path[0] = '\0';
+    scanf("%254[^\n]", exec_file_path);
+
+    trim(exec_file_path);
+
+    // The fields are parsed again by the server, checking them here gives an early and precise message
+    snprintf(text, size, "%s %s %s %s %s %s", time_data[0], time_data[1], time_data[2], time_data[3], time_data[4],
+             exec_file_path);
+
+    if (time_spec_validate(&time_spec, time_data) == 0) {
+        printf("Incorrect time specification.\n");
+        return 0;
+    }
+    if (access(exec_file_path, F_OK) == -1) {
+        printf("Incorrect file path.\n");
+        return 0;
+    }
+    return 1;
+}
 
-        mq_close(mqd);
-        mq_unlink(QUEUE_NAME);
+/*
+ * Reads BATCH operations, one per line:
+ *   add -[tr/ta/tir/tia] min h d m wd path
+ *   edit [task id] -[tr/ta/tir/tia] min h d m wd path
+ *   delete [task id/all]
+ * Blank lines and lines starting with # are skipped. Returns -1 if any line is incorrect.
+ */
+static int batch_read(FILE *input, proto_buffer_t *batch) {
+    char *line = NULL;
+    size_t capacity = 0, number = 0, errors = 0;
+
+    while (getline(&line, &capacity, input) != -1) {
+        char command[16], argument[16];
+        uint64_t id = 0;
+        int offset = 0, timer_type = -1, added = -1;
+
+        number++;
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, " %15s%n", command, &offset) != 1 || command[0] == '#')
+            continue;
+
+        char *rest = line + offset;
+        if (strcmp(command, "add") == 0) {
+            if (sscanf(rest, " %15s%n", argument, &offset) == 1 && (timer_type = timer_type_parse(argument)) != -1)
+                added = proto_add_op(batch, PROTO_OP_ADD, timer_type, 0, rest + offset);
+        } else if (strcmp(command, "edit") == 0) {
+            if (sscanf(rest, " %lu %15s%n", &id, argument, &offset) == 2 && id != TASK_ID_ALL &&
+                (timer_type = timer_type_parse(argument)) != -1)
+                added = proto_add_op(batch, PROTO_OP_EDIT, timer_type, id, rest + offset);
+        } else if (strcmp(command, "delete") == 0) {
+            if (sscanf(rest, " %15s", argument) == 1 && strcmp(argument, "all") == 0)
+                added = proto_add_op(batch, PROTO_OP_DELETE, 0, TASK_ID_ALL, NULL);
+            else if (sscanf(rest, " %lu", &id) == 1 && id != TASK_ID_ALL)
+                added = proto_add_op(batch, PROTO_OP_DELETE, 0, id, NULL);
+        }
 
-        log_close();
+        if (added == -1 && errors++ < CRONTAB_MAX_REPORTED_ERRORS)
+            printf("Incorrect operation at line %lu.\n", number);
+    }
+
+    free(line);
+    if (errors > CRONTAB_MAX_REPORTED_ERRORS)
+        printf("%lu incorrect lines in total.\n", errors);
+    return errors ? -1 : 0;
+}
+
+static void list_entries_display(const proto_buffer_t *page, size_t offset) {
+    const proto_list_entry_t *entry;
+    const char *text;
+
+    while ((entry = proto_next_list_entry(page, &offset, &text)))
+        printf("%lu | %.*s | %.*s | %s\n", entry->id, entry->spec_length, text,
+               entry->length - entry->spec_length - 1, text + entry->spec_length + 1,
+               timer_type_name(entry->timer_type));
+}
+
+// Prints the task list the server publishes in shared memory, -1 if it is not available
+static int tasks_list_shared(void) {
+    proto_buffer_t entries;
+    proto_buffer_init(&entries);
+
+    if (shm_view_read(&entries) == -1) {
+        proto_buffer_free(&entries);
+        return -1;
+    }
 
-        list_destroy(&list);
+    if (entries.count == 0) {
+        printf("No tasks.\n");
     } else {
-        sem_wait(server_free);
+        printf("ID | min h d m wd | file name | timer type\n");
+        printf("───────────────────────────────────────────\n");
+        list_entries_display(&entries, 0);
+    }
 
-        msgbuf_t msgbuf = {.pid = getpid()};
+    proto_buffer_free(&entries);
+    return 0;
+}
 
-        mqd_t server_mqd = mq_open(QUEUE_NAME, O_WRONLY, 0666);
-        if (server_mqd == -1) {
-            printf("Failed to open queue.\n");
-            sem_close(server_free);
-            return 1;
+// Fetches the task list page by page and prints it
+static int tasks_list(cronclient_t *client, proto_header_t *header, proto_buffer_t *page) {
+    proto_list_request_t list = {.cursor = 0, .limit = PROTO_LIST_DEFAULT_LIMIT};
+    proto_list_page_t info;
+
+    do {
+        if (cronclient_call(client, LIST, 1, &list, sizeof(list), header, page) == -1 ||
+            header->status != PROTO_OK || page->length < sizeof(info))
+            return -1;
+        memcpy(&info, page->data, sizeof(info));
+
+        if (list.cursor == 0) {
+            if (info.total == 0) {
+                printf("No tasks.\n");
+                return 0;
+            }
+            printf("ID | min h d m wd | file name | timer type\n");
+            printf("───────────────────────────────────────────\n");
         }
 
-        if (argc > 1) {
-            char client_mq_name[CLIENT_MQ_NAME_LEN];
-            sprintf(client_mq_name, "%s%d", CLIENT_QUEUE_PREFIX, msgbuf.pid);
+        list_entries_display(page, sizeof(info));
 
-            mq_attr_t mq_attr = {.mq_maxmsg = 10, .mq_msgsize = sizeof(response_t), .mq_flags = 0, .mq_curmsgs = 0};
+        list.cursor = info.next;
+    } while (list.cursor);
 
-            mqd_t client_mqd = mq_open(client_mq_name, O_CREAT | O_EXCL | O_RDONLY, 0666, &mq_attr);
-            if (client_mqd == -1) {
-                printf("Failed to create client queue.\n");
-                msgbuf.mtype = CLOSE_CLIENT;
+    return 0;
+}
 
-                mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
+static void duration_format(uint64_t ns, char *buffer, size_t size) {
+    if (ns < 1000)
+        snprintf(buffer, size, "%lu ns", ns);
+    else if (ns < 1000000)
+        snprintf(buffer, size, "%.1f us", ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(buffer, size, "%.1f ms", ns / 1e6);
+    else
+        snprintf(buffer, size, "%.2f s", ns / 1e9);
+}
 
-                sem_close(server_free);
-                mq_close(server_mqd);
-                return 1;
-            }
+// Prints the server-wide metrics, or those of one task when id is not TASK_ID_ALL
+static int stats_show(cronclient_t *client, uint64_t id, proto_header_t *header, proto_buffer_t *reply) {
+    if (cronclient_call(client, STATS, 1, &id, sizeof(id), header, reply) == -1)
+        return -1;
+    if (header->status != PROTO_OK) {
+        printf("Failed to get stats: %s.\n", proto_status_name(header->status));
+        return 0;
+    }
+    if (reply->length != reply->count * sizeof(proto_stats_t))
+        return -1;
+
+    const proto_stats_t *stats = (const proto_stats_t *) reply->data;
+    printf("metric | runs | mean | p50 | p90 | p99 | p99.9 | max\n");
+    printf("───────────────────────────────────────────\n");
+
+    for (uint32_t i = 0; i < reply->count; ++i) {
+        uint64_t values[6] = {stats[i].count ? stats[i].sum / stats[i].count : 0, stats[i].p50, stats[i].p90,
+                              stats[i].p99, stats[i].p999, stats[i].max};
+        char columns[6][DURATION_STR_LEN];
+
+        for (int j = 0; j < 6; ++j) {
+            if (!stats[i].count || (!stats[i].quantiles && j > 0 && j < 5))
+                strcpy(columns[j], "-");
+            else
+                duration_format(values[j], columns[j], DURATION_STR_LEN);
+        }
+        printf("%s | %lu | %s | %s | %s | %s | %s | %s\n", metric_name(stats[i].metric), stats[i].count, columns[0],
+               columns[1], columns[2], columns[3], columns[4], columns[5]);
+    }
+    return 0;
+}
 
-            char *flag = argv[1];
+// Sends a BATCH request and waits for its results, NULL unless there is one result per operation
+static const proto_result_t *batch_submit(cronclient_t *client, const proto_buffer_t *batch, proto_header_t *header,
+                                          proto_buffer_t *reply) {
+    if (cronclient_call(client, BATCH, batch->count, batch->data, batch->length, header, reply) == -1)
+        return NULL;
 
-            if (strcmp(flag, ADD_FLAG) == 0 && argc == 3) { // Adding task
-                msgbuf.mtype = ADD;
-                char *timer_type_flag = argv[2];
-                task_t task;
-                if (strcmp(timer_type_flag, ABSOLUTE_TIMER_FLAG) == 0)
-                    task.timer_type = ABSOLUTE;
-                else if (strcmp(timer_type_flag, RELATIVE_TIMER_FLAG) == 0)
-                    task.timer_type = RELATIVE;
-                else if (strcmp(timer_type_flag, I_RELATIVE_TIMER_FLAG) == 0)
-                    task.timer_type = I_RELATIVE;
-                else if (strcmp(timer_type_flag, I_ABSOLUTE_TIMER_FLAG) == 0)
-                    task.timer_type = I_ABSOLUTE;
-                else {
-                    printf("Incorrect timer type flag.\n");
+    if (header->type != RESULTS || reply->count != batch->count ||
+        reply->length != reply->count * sizeof(proto_result_t))
+        return NULL;
+    return (const proto_result_t *) reply->data;
+}
 
-                    msgbuf.mtype = CLOSE_CLIENT;
-                    mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
-                    mq_close(client_mqd);
-                    mq_unlink(client_mq_name);
-                    mq_close(server_mqd);
-                    sem_close(server_free);
+int main(int argc, char **argv) {
+    mqd_t server_mqd = mq_open(QUEUE_NAME, O_WRONLY);
+    pid_t server_pid = -1;
+    if (server_mqd == -1 && (server_pid = fork()) != 0) {
+        // The request queue is drained from an epoll loop, so it is never read in blocking mode
+        mq_attr_t mq_attr = {.mq_curmsgs = 0, .mq_msgsize = PROTO_MAX_MSG, .mq_maxmsg = MSG_MAX_COUNT, .mq_flags = 0};
+        mqd_t mqd = mq_open((const char *) QUEUE_NAME, O_CREAT | O_EXCL | O_RDWR | O_NONBLOCK, 0666, &mq_attr);
+        if (mqd == -1) {
+            printf("Failed to create queue.\n");
+            return 1;
+        }
 
-                    return 1;
-                }
+        // Bound right away, a client forked next to the server may connect before it is set up
+        size_t transport_count = 1;
+        if (transport_mq_init(&transports[0], mqd) == -1) {
+            printf("Failed to init queue transport.\n");
+            mq_close(mqd);
+            mq_unlink(QUEUE_NAME);
+            return 1;
+        }
+        if (transport_socket_listen(&transports[1], SOCKET_NAME) == 0)
+            transport_count++;
+        else
+            printf("Failed to listen on the socket, only the queue is served.\n");
 
-                char time_data[5][10];
-                char *text = "┌──────────── minutes (0 - 59)\n"
-                             "│ ┌──────────── hours (0 - 23)\n"
-                             "│ │ ┌──────────── months day (1 - 31)\n"
-                             "│ │ │ ┌──────────── month (1 - 12)\n"
-                             "│ │ │ │ ┌──────────── weekday  (1 - 7) (monday - sunday)\n"
-                             "│ │ │ │ │\n"
-                             "│ │ │ │ │\n"
-                             "│ │ │ │ │\n";
-                printf("%s", text);
-
-                for (int i = 0; i < 5; ++i) {
-                    scanf("%9s", time_data[i]);
-                }
+        if (sem_init(&process_sem, 0, 0) == -1) {
+            printf("Failed to init thread semaphore.\n");
+            transport_close(&transports[1]);
+            transport_close(&transports[0]);
+            mq_close(mqd);
+            mq_unlink(QUEUE_NAME);
+            return 1;
+        }
 
-                scanf("%254[^\n]", task.exec_file_path);
+        // The zygote has to be forked before any thread is started
+        if (spawner_init(&spawner, spawner_mode_parse(getenv(SPAWNER_ENV))) == -1) {
+            printf("Failed to init spawner.\n");
+            sem_destroy(&process_sem);
+            transport_close(&transports[1]);
+            transport_close(&transports[0]);
+            mq_close(mqd);
+            mq_unlink(QUEUE_NAME);
+            return 1;
+        }
 
-                trim(task.exec_file_path);
+        if (reaper_init(&reaper, &spawner, run_exit_func, &tasks) == -1) {
+            printf("Failed to init reaper.\n");
+            spawner_destroy(&spawner);
+            sem_destroy(&process_sem);
+            transport_close(&transports[1]);
+            transport_close(&transports[0]);
+            mq_close(mqd);
+            mq_unlink(QUEUE_NAME);
+            return 1;
+        }
 
-                if (time_spec_validate(&task.time_spec, time_data) == 0) {
-                    printf("Incorrect time specification.\n");
+        metrics_init(&metrics);
+        if (spawn_pool_init(&spawn_pool, &spawner, &reaper, &metrics, env_size(SPAWN_WORKERS_ENV, SPAWN_DEFAULT_WORKERS),
+                            env_size(SPAWN_QUEUE_ENV, SPAWN_DEFAULT_QUEUE_DEPTH)) == -1) {
+            printf("Failed to init spawn pool.\n");
+            reaper_destroy(&reaper);
+            spawner_destroy(&spawner);
+            sem_destroy(&process_sem);
+            transport_close(&transports[1]);
+            transport_close(&transports[0]);
+            mq_close(mqd);
+            mq_unlink(QUEUE_NAME);
+            return 1;
+        }
 
-                    msgbuf.mtype = CLOSE_CLIENT;
-                    mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
-                } else if (access(task.exec_file_path, F_OK) == -1) {
-                    printf("Incorrect file path.\n");
+        if (scheduler_init(&scheduler, scheduler_backend_parse(getenv(SCHEDULER_ENV)), task_fire, &spawn_pool) == -1) {
+            printf("Failed to init scheduler.\n");
+            spawn_pool_destroy(&spawn_pool);
+            reaper_destroy(&reaper);
+            spawner_destroy(&spawner);
+            sem_destroy(&process_sem);
+            transport_close(&transports[1]);
+            transport_close(&transports[0]);
+            mq_close(mqd);
+            mq_unlink(QUEUE_NAME);
+            return 1;
+        }
 
-                    msgbuf.mtype = CLOSE_CLIENT;
-                    mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
-                } else {
-                    msgbuf.task = task;
-                    mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
+        if (task_table_init(&tasks, &scheduler) == -1) {
+            printf("Failed to init task table.\n");
+            scheduler_destroy(&scheduler);
+            spawn_pool_destroy(&spawn_pool);
+            reaper_destroy(&reaper);
+            spawner_destroy(&spawner);
+            sem_destroy(&process_sem);
+            transport_close(&transports[1]);
+            transport_close(&transports[0]);
+            mq_close(mqd);
+            mq_unlink(QUEUE_NAME);
+            return 1;
+        }
+        task_view_cache_init(&task_views, &tasks, &tasks_mutex);
+
+        char *state_dir = getenv(STATE_DIR_ENV);
+        if (journal_open(&journal, state_dir ? state_dir : JOURNAL_DEFAULT_DIR, &tasks,
+                         env_size(JOURNAL_SYNC_ENV, JOURNAL_DEFAULT_SYNC_EVERY),
+                         env_size(JOURNAL_COMPACT_ENV, JOURNAL_DEFAULT_COMPACT_AFTER)) == -1 ||
+            journal_recover(&journal) == -1) {
+            printf("Failed to restore tasks.\n");
+            journal_close(&journal);
+            task_table_destroy(&tasks);
+            scheduler_destroy(&scheduler);
+            spawn_pool_destroy(&spawn_pool);
+            reaper_destroy(&reaper);
+            spawner_destroy(&spawner);
+            sem_destroy(&process_sem);
+            transport_close(&transports[1]);
+            transport_close(&transports[0]);
+            mq_close(mqd);
+            mq_unlink(QUEUE_NAME);
+            return 1;
+        }
 
-                    msgbuf.mtype = CLOSE_CLIENT;
-                    mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
-                }
-            } else if (strcmp(flag, LIST_FLAG) == 0) { // Show list of tasks
-                response_t response;
-                msgbuf.mtype = LIST;
-
-                mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
-                mq_receive(client_mqd, (char *) &response, sizeof(response_t), 0);
-
-                if (response.is_next == -1)
-                    printf("No tasks.\n");
-                else {
-                    int counter = 0;
-
-                    printf("No. | min h d m wd | file name | timer type\n");
-                    printf("───────────────────────────────────────────\n");
-                    while (1) {
-                        printf("%d. | ", counter + 1);
-                        task_t task = response.task;
-                        if (task.time_spec.minute.is_asterisk) {
-                            printf("* ");
-                        } else {
-                            printf("%d ", task.time_spec.minute.val);
-                        }
+        // Without the shared copy -l still works through the server
+        if (shm_view_init(&shared_view, &task_views) == -1)
+            printf("Failed to share the task list.\n");
+
+        if (server_init(&server, transports, transport_count, env_size(SERVER_WORKERS_ENV, SERVER_DEFAULT_WORKERS),
+                        env_size(SERVER_PENDING_ENV, SERVER_DEFAULT_MAX_PENDING), request_handle, NULL) == -1) {
+            printf("Failed to init server.\n");
+            shm_view_destroy(&shared_view);
+            journal_close(&journal);
+            task_table_destroy(&tasks);
+            scheduler_destroy(&scheduler);
+            spawn_pool_destroy(&spawn_pool);
+            reaper_destroy(&reaper);
+            spawner_destroy(&spawner);
+            sem_destroy(&process_sem);
+            transport_close(&transports[1]);
+            transport_close(&transports[0]);
+            mq_close(mqd);
+            mq_unlink(QUEUE_NAME);
+            return 1;
+        }
 
-                        if (task.time_spec.hour.is_asterisk) {
-                            printf("* ");
-                        } else {
-                            printf("%d ", task.time_spec.hour.val);
-                        }
+        if (task_table_size(&tasks))
+            printf("Restored %lu tasks.\n", task_table_size(&tasks));
+
+        // Timer and handler threads only format into their own buffer, a flusher thread does the writing
+        log_set_mode(log_mode_parse(getenv(LOG_MODE_ENV)), env_size(LOG_RING_ENV, LOG_DEFAULT_RING_ENTRIES));
+        log_set_time_resolution(log_time_resolution_parse(getenv(LOG_TIME_ENV)));
+        log_set_format(log_format_parse(getenv(LOG_FORMAT_ENV)));
+        log_set_rotation(env_size(LOG_ROTATE_SIZE_ENV, 0), (unsigned) env_size(LOG_ROTATE_INTERVAL_ENV, 0),
+                         (unsigned) env_size(LOG_SEGMENTS_ENV, LOG_DEFAULT_SEGMENTS));
+        dump_format = snapshot_format_parse(getenv(DUMP_FORMAT_ENV));
+        log_init(NULL,dump_func,&task_views);
+
+        // e.g. CRON_LOG_LEVELS=spawn=max,ipc=low traces runs without the IPC chatter
+        char *log_levels = getenv(LOG_LEVELS_ENV);
+        if (log_levels && log_levels_parse(log_levels) == -1)
+            printf("Invalid %s, some log levels were not set.\n", LOG_LEVELS_ENV);
+
+        // For the node exporter's textfile collector, e.g. CRON_METRICS_FILE=/var/lib/node_exporter/cron.prom
+        char *metrics_file = getenv(METRICS_FILE_ENV);
+        if (metrics_file && metrics_export_start(&metrics, metrics_file, (unsigned) env_size(
+                METRICS_INTERVAL_ENV, METRICS_DEFAULT_EXPORT_INTERVAL)) == -1)
+            printf("Failed to start metrics export.\n");
 
-                        if (task.time_spec.day.is_asterisk) {
-                            printf("* ");
-                        } else {
-                            printf("%d ", task.time_spec.day.val);
-                        }
+        printf("PID: %d\n", getpid());
 
-                        if (task.time_spec.month.is_asterisk) {
-                            printf("* ");
-                        } else {
-                            printf("%d ", task.time_spec.month.val);
-                        }
+        server_run(&server);
+        server_destroy(&server);
+        shm_view_destroy(&shared_view);
 
-                        if (task.time_spec.weekday.is_asterisk) {
-                            printf("* |");
-                        } else {
-                            printf("%d |", task.time_spec.weekday.val);
-                        }
+        sem_destroy(&process_sem);
 
-                        printf(" %s | ", task.exec_file_path);
-
-                        switch (task.timer_type) {
-                            case RELATIVE: {
-                                printf("relative\n");
-                                break;
-                            }
-                            case ABSOLUTE: {
-                                printf("absolute\n");
-                                break;
-                            }
-                            case I_ABSOLUTE: {
-                                printf("interval absolute\n");
-                                break;
-                            }
-                            case I_RELATIVE: {
-                                printf("interval relative\n");
-                                break;
-                            }
-                        }
+        transport_close(&transports[1]);
+        transport_close(&transports[0]);
+        mq_close(mqd);
+        mq_unlink(QUEUE_NAME);
 
-                        if (!response.is_next)
-                            break;
-                        mq_receive(client_mqd, (char *) &response, sizeof(response_t), 0);
-                        counter++;
-                    }
-                }
+        pthread_mutex_lock(&tasks_mutex);
+        // A fresh snapshot makes the next start a single sequential read
+        journal_compact(&journal);
+        journal_close(&journal);
+        task_table_destroy(&tasks);
+        pthread_mutex_unlock(&tasks_mutex);
+        scheduler_destroy(&scheduler);
+        spawn_pool_destroy(&spawn_pool);
+        reaper_destroy(&reaper);
+        spawner_destroy(&spawner);
+        metrics_destroy(&metrics);
+
+        // A dump can still be taken until the logger is closed
+        log_close();
+        task_view_cache_destroy(&task_views);
+    } else {
+        pid_t pid = getpid();
 
-                msgbuf.mtype = CLOSE_CLIENT;
-                mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
-            } else if (strcmp(flag, DELETE_FLAG) == 0) {
-                if (argc == 3) { // Deleting one task
-                    int idx = atoi(argv[2]) - 1;
+        // Without a command the child forked next to a new server has nothing to do
+        if (server_pid == 0 && argc < 2)
+            return 0;
 
-                    if (idx == -1) {
-                        printf("Incorrect index value.\n");
-                    } else {
-                        msgbuf.mtype = DELETE;
-                        msgbuf.idx = idx;
+        // Listing reads the copy the server keeps in shared memory, no message is sent
+        if (argc == 2 && strcmp(argv[1], LIST_FLAG) == 0 && tasks_list_shared() == 0) {
+            if (server_mqd != -1)
+                mq_close(server_mqd);
+            return 0;
+        }
 
-                        int result = mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
-                        if (result == 0) {
-                            printf("Successful deleting %d. task.\n", idx + 1);
-                        } else {
-                            printf("Failed to delete %d. task.\n", idx + 1);
-                        }
+        // The child forked next to a new server may get here before the queue exists
+        for (int i = 0; server_mqd == -1 && i < CLIENT_OPEN_RETRIES; ++i) {
+            usleep(CLIENT_RETRY_PAUSE_US);
+            server_mqd = mq_open(QUEUE_NAME, O_WRONLY);
+        }
+        if (server_mqd == -1) {
+            printf("Failed to open queue.\n");
+            return 1;
+        }
+
+        if (argc > 1) {
+            transport_type_t transport = transport_type_parse(getenv(TRANSPORT_ENV));
+            cronclient_t client;
+            int connected = cronclient_connect(&client, transport);
+
+            // The socket is bound just after the queue is created
+            for (int i = 0; connected == -1 && errno == ECONNREFUSED && i < CLIENT_OPEN_RETRIES; ++i) {
+                usleep(CLIENT_RETRY_PAUSE_US);
+                connected = cronclient_connect(&client, transport);
+            }
+            if (connected == -1) {
+                printf("Failed to connect to server.\n");
+                mq_close(server_mqd);
+                return 1;
+            }
+
+            char *flag = argv[1];
+            int result = 0;
+            proto_header_t header;
+            proto_buffer_t batch, reply;
+            proto_buffer_init(&batch);
+            proto_buffer_init(&reply);
+
+            if (strcmp(flag, ADD_FLAG) == 0 && argc == 3) { // Adding task
+                int timer_type = timer_type_parse(argv[2]);
+                char text[TASK_TEXT_LEN];
+
+                if (timer_type == -1) {
+                    printf("Incorrect timer type flag.\n");
+                    result = 1;
+                } else if (task_text_read(text, sizeof(text)) &&
+                           proto_add_op(&batch, PROTO_OP_ADD, timer_type, 0, text) == 0) {
+                    const proto_result_t *results = batch_submit(&client, &batch, &header, &reply);
+
+                    if (!results)
+                        printf("Failed to add task.\n");
+                    else if (results[0].status != PROTO_OK)
+                        printf("Failed to add task: %s.\n", proto_status_name(results[0].status));
+                    else
+                        printf("Added task %lu.\n", results[0].id);
+                }
+            } else if (strcmp(flag, LIST_FLAG) == 0) { // Show list of tasks
+                if (tasks_list(&client, &header, &reply) == -1)
+                    printf("Failed to list tasks.\n");
+            } else if (strcmp(flag, DELETE_FLAG) == 0) {
+                uint64_t id = TASK_ID_ALL;
+                int confirmed = 1;
+
+                if (argc == 3) { // Deleting one task
+                    id = strtoull(argv[2], NULL, 10);
+                    if (id == TASK_ID_ALL) {
+                        printf("Incorrect task id.\n");
+                        confirmed = 0;
                     }
                 } else { // Deleting all tasks
                     printf("Do you want to delete all tasks (y/n)?:\n");
                     char c;
                     if (scanf("%c", &c) != 1) {
                         printf("Incorrect input.\n");
-                    } else if (c == 'y') {
-                        msgbuf.mtype = DELETE;
-                        msgbuf.idx = -1;
+                        confirmed = 0;
+                    } else if (c != 'y') {
+                        confirmed = 0;
+                    }
+                }
 
-                        int result = mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
-                        if (result == 1) {
+                if (confirmed && proto_add_op(&batch, PROTO_OP_DELETE, 0, id, NULL) == 0) {
+                    const proto_result_t *results = batch_submit(&client, &batch, &header, &reply);
+
+                    if (results && results[0].status == PROTO_OK) {
+                        if (id == TASK_ID_ALL)
                             printf("Successful deleting all tasks.\n");
-                        } else {
-                            printf("Failed to delete tasks.\n");
-                        }
+                        else
+                            printf("Successful deleting task %lu.\n", id);
+                    } else if (results) {
+                        printf("Failed to delete: %s.\n", proto_status_name(results[0].status));
+                    } else {
+                        printf("Failed to delete tasks.\n");
                     }
                 }
-
-                msgbuf.mtype = CLOSE_CLIENT;
-                mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
             } else if (strcmp(flag, EDIT_FLAG) == 0 && argc == 4) { // Edit task
-                msgbuf.mtype = EDIT;
-                int idx = atoi(argv[2]) - 1;
+                uint64_t id = strtoull(argv[2], NULL, 10);
+                int timer_type = timer_type_parse(argv[3]);
+                char text[TASK_TEXT_LEN];
 
-                if (idx == -1) {
-                    printf("Incorrect index value.\n");
+                if (id == TASK_ID_ALL) {
+                    printf("Incorrect task id.\n");
+                } else if (timer_type == -1) {
+                    printf("Incorrect timer type flag.\n");
+                    result = 1;
+                } else if (task_text_read(text, sizeof(text)) &&
+                           proto_add_op(&batch, PROTO_OP_EDIT, timer_type, id, text) == 0) {
+                    const proto_result_t *results = batch_submit(&client, &batch, &header, &reply);
+
+                    if (!results)
+                        printf("Failed to edit task %lu.\n", id);
+                    else if (results[0].status != PROTO_OK)
+                        printf("Failed to edit task %lu: %s.\n", id, proto_status_name(results[0].status));
+                    else
+                        printf("Edited task %lu.\n", id);
+                }
+            } else if (strcmp(flag, BATCH_FLAG) == 0) { // Apply operations read from stdin
+                if (batch_read(stdin, &batch) == -1) {
+                    printf("Nothing was applied.\n");
+                    result = 1;
+                } else if (batch.count == 0) {
+                    printf("No operations.\n");
                 } else {
-                    msgbuf.idx = idx;
-                    char *timer_type_flag = argv[3];
-                    task_t task;
-                    if (strcmp(timer_type_flag, ABSOLUTE_TIMER_FLAG) == 0)
-                        task.timer_type = ABSOLUTE;
-                    else if (strcmp(timer_type_flag, RELATIVE_TIMER_FLAG) == 0)
-                        task.timer_type = RELATIVE;
-                    else if (strcmp(timer_type_flag, I_RELATIVE_TIMER_FLAG) == 0)
-                        task.timer_type = I_RELATIVE;
-                    else if (strcmp(timer_type_flag, I_ABSOLUTE_TIMER_FLAG) == 0)
-                        task.timer_type = I_ABSOLUTE;
-                    else {
-                        printf("Incorrect timer type flag.\n");
-
-                        msgbuf.mtype = CLOSE_CLIENT;
-                        mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
-                        mq_close(client_mqd);
-                        mq_unlink(client_mq_name);
-                        mq_close(server_mqd);
-                        sem_close(server_free);
-
-                        return 1;
-                    }
-
-                    char time_data[5][10];
-                    char *text = "┌──────────── minutes (0 - 59)\n"
-                                 "│ ┌──────────── hours (0 - 23)\n"
-                                 "│ │ ┌──────────── months day (1 - 31)\n"
-                                 "│ │ │ ┌──────────── month (1 - 12)\n"
-                                 "│ │ │ │ ┌──────────── weekday  (1 - 7) (monday - sunday)\n"
-                                 "│ │ │ │ │\n"
-                                 "│ │ │ │ │\n"
-                                 "│ │ │ │ │\n";
-                    printf("%s", text);
-
-                    for (int i = 0; i < 5; ++i)
-                        scanf("%9s", time_data[i]);
+                    const proto_result_t *results = batch_submit(&client, &batch, &header, &reply);
 
-                    scanf("%254[^\n]", task.exec_file_path);
-
-                    trim(task.exec_file_path);
-
-                    if (time_spec_validate(&task.time_spec, time_data) == 0) {
-                        printf("Incorrect time specification.\n");
-
-                        msgbuf.mtype = CLOSE_CLIENT;
-                        mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
-                    } else if (access(task.exec_file_path, F_OK) == -1) {
-                        printf("Incorrect file path.\n");
-
-                        msgbuf.mtype = CLOSE_CLIENT;
-                        mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
+                    if (!results) {
+                        printf("Failed to apply operations.\n");
+                        result = 1;
                     } else {
-                        msgbuf.task = task;
-                        mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
+                        for (uint32_t i = 0; i < reply.count; ++i)
+                            printf("%u: %s | task %lu\n", i + 1, proto_status_name(results[i].status), results[i].id);
 
-                        msgbuf.mtype = CLOSE_CLIENT;
-                        mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
+                        if (header.status == PROTO_OK) {
+                            printf("Applied %u operations.\n", reply.count);
+                        } else {
+                            printf("Batch failed: %s.\n", proto_status_name(header.status));
+                            result = 1;
+                        }
+                    }
+                }
+            } else if (strcmp(flag, IMPORT_FLAG) == 0 && argc == 3) { // Import crontab file
+                crontab_t crontab;
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+                if (crontab_load(&crontab, argv[2], cpus > 0 ? (size_t) cpus : 1) == -1) {
+                    printf("Nothing was imported.\n");
+                } else if (crontab.count == 0) {
+                    printf("No tasks in %s.\n", argv[2]);
+                } else {
+                    char shm_name[IMPORT_SHM_NAME_LEN];
+                    sprintf(shm_name, "%s%d", IMPORT_SHM_PREFIX, pid);
+                    size_t size = crontab.count * sizeof(task_t);
+
+                    int shm_fd = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+                    void *shared = MAP_FAILED;
+                    if (shm_fd != -1 && ftruncate(shm_fd, (off_t) size) == 0)
+                        shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+                    if (shm_fd != -1)
+                        close(shm_fd);
+
+                    if (shared == MAP_FAILED) {
+                        printf("Failed to share tasks with the server.\n");
+                    } else {
+                        memcpy(shared, crontab.tasks, size);
+                        munmap(shared, size);
+
+                        if (cronclient_call(&client, IMPORT, crontab.count, NULL, 0, &header, &reply) == 0 &&
+                            header.status == PROTO_OK && header.count == crontab.count)
+                            printf("Imported %u tasks.\n", header.count);
+                        else
+                            printf("Failed to import tasks.\n");
                     }
+                    shm_unlink(shm_name);
                 }
 
-                msgbuf.mtype = CLOSE_CLIENT;
-                mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
+                crontab_free(&crontab);
+            } else if (strcmp(flag, STATS_FLAG) == 0 && argc <= 3) { // Show scheduling and run latencies
+                uint64_t id = argc == 3 ? strtoull(argv[2], NULL, 10) : TASK_ID_ALL;
+
+                if (argc == 3 && id == TASK_ID_ALL) {
+                    printf("Incorrect task id.\n");
+                    result = 1;
+                } else if (stats_show(&client, id, &header, &reply) == -1) {
+                    printf("Failed to get stats.\n");
+                    result = 1;
+                }
             } else if (strcmp(flag, DESTROY_FLAG) == 0) { // Close cron
-                msgbuf.mtype = DESTROY;
-                mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
+                cronclient_submit(&client, DESTROY, 0, NULL, 0, NULL, NULL);
             } else {
                 printf("Incorrect flag.\n");
-                msgbuf.mtype = CLOSE_CLIENT;
-
-                mq_send(server_mqd, (char *) &msgbuf, sizeof(msgbuf_t), 0);
             }
-            mq_close(client_mqd);
-            mq_unlink(client_mq_name);
+
+            proto_buffer_free(&batch);
+            proto_buffer_free(&reply);
+            cronclient_close(&client);
+            mq_close(server_mqd);
+            return result;
         } else {
             printf("Server is already working.\n");
             printf("Client options:\n");
             printf("-a -[tr/ta/tir/tia] - add task with relative/absolute/relative interval/absolute interval timer type\n");
-            printf("-e [task index] -[tr/ta/tir/tia] - edit task at index to relative/absolute/relative interval/absolute interval timer type\n");
-            printf("-r ([task index]) - remove all tasks or task at index (if specified)\n");
+            printf("-e [task id] -[tr/ta/tir/tia] - edit task with id to relative/absolute/relative interval/absolute interval timer type\n");
+            printf("-r ([task id]) - remove all tasks or task with id (if specified)\n");
             printf("-l - display tasks list\n");
+            printf("-s ([task id]) - show how late runs start, spawn and queue latency and run time, for all tasks or one\n");
+            printf("Time fields accept values, lists (1,5), ranges (1-5) and steps (*/15); absolute timers follow cron rules.\n");
+            printf("-f [file] - import tasks from a crontab file (min h d m wd path per line) as absolute interval tasks\n");
+            printf("-b - apply operations read from stdin in one request, one per line:\n");
+            printf("     add -[tr/ta/tir/tia] min h d m wd path | edit [task id] -[tr/ta/tir/tia] min h d m wd path | delete [task id/all]\n");
             printf("-d - close cron server\n");
         }
 
         mq_close(server_mqd);
-        sem_close(server_free);
     }
 }
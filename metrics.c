@@ -0,0 +1,192 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define METRICS_TEMPORARY_SUFFIX ".tmp"
+#define METRICS_QUANTILE_COUNT (4)
+
+static const char *metric_names[METRIC_COUNT] = {"fire lag", "queue wait", "spawn", "run"};
+
+static const char *metric_export_names[METRIC_COUNT] = {
+        "cron_fire_lag_seconds", "cron_queue_wait_seconds", "cron_spawn_seconds", "cron_run_seconds"
+};
+
+static const char *metric_help[METRIC_COUNT] = {
+        "Delay between the planned and the actual start of a run.",
+        "Time a run waited in the spawn queue.",
+        "Time taken to spawn a run.",
+        "Wall-clock duration of a run."
+};
+
+// Quantiles in parts per thousand, in the order of the histogram_summary_t fields
+static const unsigned quantiles[METRICS_QUANTILE_COUNT] = {500, 900, 990, 999};
+
+static size_t histogram_index(uint64_t value) {
+    if (value < HISTOGRAM_SUB_COUNT)
+        return (size_t) value;
+
+    unsigned shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    return ((size_t) (shift + 1) << HISTOGRAM_SUB_BITS) + (size_t) ((value >> shift) - HISTOGRAM_SUB_COUNT);
+}
+
+// Largest value that falls into the bucket
+static uint64_t histogram_highest(size_t index) {
+    if (index < HISTOGRAM_SUB_COUNT)
+        return index;
+
+    unsigned shift = (unsigned) (index >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t lowest = ((uint64_t) HISTOGRAM_SUB_COUNT + (index & (HISTOGRAM_SUB_COUNT - 1))) << shift;
+    return lowest + ((uint64_t) 1 << shift) - 1;
+}
+
+void metrics_init(metrics_t *metrics) {
+    for (int metric = 0; metric < METRIC_COUNT; ++metric) {
+        histogram_t *histogram = &metrics->histograms[metric];
+        for (size_t i = 0; i < HISTOGRAM_SIZE; ++i)
+            atomic_init(&histogram->counts[i], 0);
+        atomic_init(&histogram->sum, 0);
+        atomic_init(&histogram->max, 0);
+    }
+
+    metrics->export_path = NULL;
+    metrics->export_interval = 0;
+    metrics->event_fd = -1;
+}
+
+void metrics_record(metrics_t *metrics, metric_t metric, uint64_t value_ns) {
+    if (!metrics)
+        return;
+
+    histogram_t *histogram = &metrics->histograms[metric];
+    atomic_fetch_add_explicit(&histogram->counts[histogram_index(value_ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value_ns, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while (value_ns > max &&
+           !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value_ns, memory_order_relaxed,
+                                                  memory_order_relaxed));
+}
+
+void metrics_summary(metrics_t *metrics, metric_t metric, histogram_summary_t *summary) {
+    histogram_t *histogram = &metrics->histograms[metric];
+    uint64_t *targets[METRICS_QUANTILE_COUNT] = {&summary->p50, &summary->p90, &summary->p99, &summary->p999};
+    uint64_t counts[HISTOGRAM_SIZE];
+
+    // The count is taken from the same copy of the buckets the quantiles are read from
+    summary->count = 0;
+    for (size_t i = 0; i < HISTOGRAM_SIZE; ++i) {
+        counts[i] = atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+        summary->count += counts[i];
+    }
+    summary->sum = atomic_load_explicit(&histogram->sum, memory_order_relaxed);
+    summary->max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+
+    for (size_t q = 0; q < METRICS_QUANTILE_COUNT; ++q)
+        *targets[q] = 0;
+
+    uint64_t seen = 0;
+    size_t q = 0;
+    for (size_t i = 0; i < HISTOGRAM_SIZE && q < METRICS_QUANTILE_COUNT; ++i) {
+        seen += counts[i];
+        while (q < METRICS_QUANTILE_COUNT && summary->count && seen * 1000 >= summary->count * quantiles[q]) {
+            uint64_t value = histogram_highest(i);
+            *targets[q++] = value < summary->max ? value : summary->max;
+        }
+    }
+}
+
+const char *metric_name(metric_t metric) {
+    return metric < METRIC_COUNT ? metric_names[metric] : "unknown";
+}
+
+// Written next to the target and renamed over it, so a scrape never reads half a file
+int metrics_export(metrics_t *metrics, const char *path) {
+    char temporary[strlen(path) + sizeof(METRICS_TEMPORARY_SUFFIX)];
+    sprintf(temporary, "%s%s", path, METRICS_TEMPORARY_SUFFIX);
+
+    FILE *f = fopen(temporary, "w");
+    if (!f)
+        return -1;
+
+    for (int metric = 0; metric < METRIC_COUNT; ++metric) {
+        histogram_summary_t summary;
+        metrics_summary(metrics, metric, &summary);
+        uint64_t values[METRICS_QUANTILE_COUNT] = {summary.p50, summary.p90, summary.p99, summary.p999};
+        const char *name = metric_export_names[metric];
+
+        fprintf(f, "# HELP %s %s\n# TYPE %s summary\n", name, metric_help[metric], name);
+        for (size_t q = 0; q < METRICS_QUANTILE_COUNT; ++q)
+            fprintf(f, "%s{quantile=\"%g\"} %.9f\n", name, quantiles[q] / 1000.0, values[q] / 1e9);
+        fprintf(f, "%s_sum %.9f\n%s_count %lu\n", name, summary.sum / 1e9, name, summary.count);
+    }
+
+    int failed = ferror(f);
+    if (fclose(f) != 0 || failed || rename(temporary, path) == -1) {
+        unlink(temporary);
+        return -1;
+    }
+    return 0;
+}
+
+static void *metrics_export_thread_func(void *arg) {
+    metrics_t *metrics = (metrics_t *) arg;
+    struct pollfd fd = {.fd = metrics->event_fd, .events = POLLIN};
+
+    while (1) {
+        int ready = poll(&fd, 1, (int) metrics->export_interval * 1000);
+        if (ready == -1 && errno == EINTR)
+            continue;
+
+        if (metrics_export(metrics, metrics->export_path) == -1)
+            perror("metrics export failed");
+
+        // Stopping writes the file once more, so it ends with the final counts
+        if (ready != 0)
+            break;
+    }
+
+    return NULL;
+}
+
+int metrics_export_start(metrics_t *metrics, const char *path, unsigned interval) {
+    if (!metrics || !path || metrics->event_fd != -1 || interval < 1 || interval > INT_MAX / 1000)
+        return -1;
+
+    metrics->export_path = strdup(path);
+    metrics->export_interval = interval;
+    metrics->event_fd = eventfd(0, EFD_CLOEXEC);
+    if (!metrics->export_path || metrics->event_fd == -1 ||
+        pthread_create(&metrics->thread, NULL, metrics_export_thread_func, metrics) != 0) {
+        if (metrics->event_fd != -1)
+            close(metrics->event_fd);
+        free(metrics->export_path);
+        metrics->export_path = NULL;
+        metrics->event_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+void metrics_destroy(metrics_t *metrics) {
+    if (!metrics)
+        return;
+
+    if (metrics->event_fd != -1) {
+        uint64_t value = 1;
+        if (write(metrics->event_fd, &value, sizeof(value)) == -1)
+            perror("Failed to stop metrics export");
+        pthread_join(metrics->thread, NULL);
+        close(metrics->event_fd);
+        metrics->event_fd = -1;
+    }
+
+    free(metrics->export_path);
+    metrics->export_path = NULL;
+}
@@ -0,0 +1,79 @@
+#ifndef CRON_METRICS_H
+#define CRON_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Defines
+#define HISTOGRAM_SUB_BITS (5)
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_SIZE ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+#define METRICS_DEFAULT_EXPORT_INTERVAL (15)
+
+// Enums
+typedef enum {
+    METRIC_FIRE_LAG,
+    METRIC_QUEUE_WAIT,
+    METRIC_SPAWN,
+    METRIC_RUN,
+    METRIC_COUNT
+} metric_t;
+
+// Structures
+/*
+ * HDR histogram of nanosecond values. Every power of two is split into
+ * HISTOGRAM_SUB_COUNT linear buckets, so a recorded value is kept within
+ * about 3% over the whole 64-bit range in a fixed 15 kB. Recording is two
+ * relaxed atomic adds, plus a compare-and-swap when the maximum grows, so
+ * any thread can record without a lock; readers sum the buckets while
+ * writers go on, and a reading is exact once recording stops.
+ */
+typedef struct {
+    atomic_uint_fast64_t counts[HISTOGRAM_SIZE];
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t max;
+} histogram_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+} histogram_summary_t;
+
+/*
+ * Server-wide latency histograms: how late runs start against their
+ * planned time (METRIC_FIRE_LAG), how long they wait in the spawn queue,
+ * how long the spawn itself takes and how long the job runs. Optionally
+ * written to a file in the Prometheus text format every export_interval
+ * seconds, for the node exporter's textfile collector.
+ */
+typedef struct {
+    histogram_t histograms[METRIC_COUNT];
+    char *export_path;
+    unsigned export_interval;
+    int event_fd;
+    pthread_t thread;
+} metrics_t;
+
+// Metrics methods
+void metrics_init(metrics_t *metrics);
+
+void metrics_record(metrics_t *metrics, metric_t metric, uint64_t value_ns);
+
+void metrics_summary(metrics_t *metrics, metric_t metric, histogram_summary_t *summary);
+
+const char *metric_name(metric_t metric);
+
+int metrics_export(metrics_t *metrics, const char *path);
+
+int metrics_export_start(metrics_t *metrics, const char *path, unsigned interval);
+
+void metrics_destroy(metrics_t *metrics);
+
+#endif //CRON_METRICS_H
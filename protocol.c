@@ -0,0 +1,312 @@
+#include "protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define PROTO_ALIGN(length) (((length) + 7) & ~(size_t) 7)
+
+void proto_buffer_init(proto_buffer_t *buffer) {
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+    buffer->count = 0;
+}
+
+int proto_buffer_append(proto_buffer_t *buffer, const void *data, size_t length) {
+    if (buffer->length + length > PROTO_MAX_REQUEST)
+        return -1;
+
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : PROTO_MAX_MSG;
+        while (capacity < buffer->length + length)
+            capacity *= 2;
+
+        char *grown = realloc(buffer->data, capacity);
+        if (!grown)
+            return -1;
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+
+    if (data)
+        memcpy(buffer->data + buffer->length, data, length);
+    else
+        memset(buffer->data + buffer->length, 0, length);
+    buffer->length += length;
+    return 0;
+}
+
+void proto_buffer_reset(proto_buffer_t *buffer) {
+    buffer->length = 0;
+    buffer->count = 0;
+}
+
+void proto_buffer_free(proto_buffer_t *buffer) {
+    free(buffer->data);
+    proto_buffer_init(buffer);
+}
+
+int proto_add_op(proto_buffer_t *batch, proto_op_type_t type, int timer_type, uint64_t id, const char *text) {
+    size_t length = text ? strlen(text) : 0;
+    if (length > UINT16_MAX)
+        return -1;
+
+    proto_op_t op = {.type = (uint8_t) type, .timer_type = (uint8_t) timer_type, .length = (uint16_t) length, .id = id};
+    size_t start = batch->length;
+
+    // Records are padded to 8 bytes so the next header stays aligned
+    if (proto_buffer_append(batch, &op, sizeof(op)) == -1 || proto_buffer_append(batch, text, length) == -1 ||
+        proto_buffer_append(batch, NULL, PROTO_ALIGN(length) - length) == -1) {
+        batch->length = start;
+        return -1;
+    }
+
+    batch->count++;
+    return 0;
+}
+
+const proto_op_t *proto_next_op(const proto_buffer_t *batch, size_t *offset, const char **text) {
+    if (*offset > batch->length || batch->length - *offset < sizeof(proto_op_t))
+        return NULL;
+
+    const proto_op_t *op = (const proto_op_t *) (batch->data + *offset);
+    size_t size = sizeof(proto_op_t) + PROTO_ALIGN((size_t) op->length);
+    if (size > batch->length - *offset)
+        return NULL;
+
+    *text = batch->data + *offset + sizeof(proto_op_t);
+    *offset += size;
+    return op;
+}
+
+int proto_add_result(proto_buffer_t *results, proto_status_t status, uint64_t id) {
+    proto_result_t result = {.status = status, .id = id};
+
+    if (proto_buffer_append(results, &result, sizeof(result)) == -1)
+        return -1;
+    results->count++;
+    return 0;
+}
+
+int proto_add_list_entry(proto_buffer_t *page, uint64_t id, int timer_type, const char *spec, const char *path) {
+    size_t spec_length = strlen(spec), path_length = strlen(path);
+    size_t length = spec_length + 1 + path_length;
+    if (length > UINT16_MAX)
+        return -1;
+
+    proto_list_entry_t entry = {.id = id, .timer_type = (uint8_t) timer_type, .length = (uint16_t) length,
+                                .spec_length = (uint16_t) spec_length};
+    size_t start = page->length;
+
+    if (proto_buffer_append(page, &entry, sizeof(entry)) == -1 || proto_buffer_append(page, spec, spec_length) == -1 ||
+        proto_buffer_append(page, " ", 1) == -1 || proto_buffer_append(page, path, path_length) == -1 ||
+        proto_buffer_append(page, NULL, PROTO_ALIGN(length) - length) == -1) {
+        page->length = start;
+        return -1;
+    }
+
+    page->count++;
+    return 0;
+}
+
+const proto_list_entry_t *proto_next_list_entry(const proto_buffer_t *page, size_t *offset, const char **text) {
+    if (*offset > page->length || page->length - *offset < sizeof(proto_list_entry_t))
+        return NULL;
+
+    const proto_list_entry_t *entry = (const proto_list_entry_t *) (page->data + *offset);
+    size_t size = sizeof(proto_list_entry_t) + PROTO_ALIGN((size_t) entry->length);
+    if (size > page->length - *offset || entry->spec_length >= entry->length)
+        return NULL;
+
+    *text = page->data + *offset + sizeof(proto_list_entry_t);
+    *offset += size;
+    return entry;
+}
+
+int proto_add_stats(proto_buffer_t *reply, const proto_stats_t *stats) {
+    if (proto_buffer_append(reply, stats, sizeof(proto_stats_t)) == -1)
+        return -1;
+    reply->count++;
+    return 0;
+}
+
+const char *proto_status_name(proto_status_t status) {
+    switch (status) {
+        case PROTO_OK:
+            return "ok";
+        case PROTO_INVALID:
+            return "invalid request";
+        case PROTO_NOT_FOUND:
+            return "no such task";
+        case PROTO_FAILED:
+            return "failed";
+        case PROTO_UNSUPPORTED:
+            return "unsupported protocol version";
+        case PROTO_ABORTED:
+            return "not applied, the batch was rejected";
+        case PROTO_BUSY:
+            return "server busy";
+        case PROTO_TIMEOUT:
+            return "no reply from the server";
+    }
+    return "unknown";
+}
+
+// Sends the parts of a payload starting at *offset, returns 1 instead of blocking when mqd is non-blocking and full
+int proto_send_from(mqd_t mqd, proto_header_t *header, const void *payload, size_t length, size_t *offset) {
+    char message[PROTO_MAX_MSG];
+
+    do {
+        size_t part = length - *offset;
+        if (part > PROTO_MAX_MSG - sizeof(proto_header_t))
+            part = PROTO_MAX_MSG - sizeof(proto_header_t);
+
+        header->length = (uint32_t) part;
+        header->flags = *offset + part < length ? PROTO_MORE : 0;
+        memcpy(message, header, sizeof(proto_header_t));
+        if (part)
+            memcpy(message + sizeof(proto_header_t), (const char *) payload + *offset, part);
+
+        if (mq_send(mqd, message, sizeof(proto_header_t) + part, 0) == -1)
+            return errno == EAGAIN ? 1 : -1;
+        *offset += part;
+    } while (*offset < length);
+
+    return 0;
+}
+
+int proto_send(mqd_t mqd, uint16_t type, pid_t pid, proto_status_t status, uint32_t count,
+               const void *payload, size_t length) {
+    proto_header_t header = {
+            .version = PROTO_VERSION,
+            .type = type,
+            .status = (uint16_t) status,
+            .pid = pid,
+            .count = count
+    };
+    size_t offset = 0;
+
+    return proto_send_from(mqd, &header, payload, length, &offset) == 0 ? 0 : -1;
+}
+
+int proto_receive(mqd_t mqd, proto_header_t *header, proto_buffer_t *payload) {
+    char message[PROTO_MAX_MSG];
+
+    proto_buffer_reset(payload);
+    do {
+        ssize_t length = mq_receive(mqd, message, PROTO_MAX_MSG, NULL);
+        if (length < (ssize_t) sizeof(proto_header_t))
+            return -1;
+
+        memcpy(header, message, sizeof(proto_header_t));
+        if (header->version != PROTO_VERSION || header->length > length - sizeof(proto_header_t) ||
+            proto_buffer_append(payload, message + sizeof(proto_header_t), header->length) == -1)
+            return -1;
+    } while (header->flags & PROTO_MORE);
+
+    payload->count = header->count;
+    return 0;
+}
+
+void proto_assembler_init(proto_assembler_t *assembler) {
+    for (int i = 0; i < PROTO_MAX_PENDING; ++i) {
+        assembler->slots[i].pid = 0;
+        proto_buffer_init(&assembler->slots[i].payload);
+    }
+    assembler->used = 0;
+}
+
+// The buffer is freed rather than reset, a partial payload may be up to PROTO_MAX_REQUEST
+static void slot_release(proto_assembler_t *assembler, proto_pending_t *slot, int keep_buffer) {
+    slot->pid = 0;
+    if (keep_buffer)
+        proto_buffer_reset(&slot->payload);
+    else
+        proto_buffer_free(&slot->payload);
+    assembler->used--;
+}
+
+// Returns 1 with a complete request in header and payload, 0 while parts are missing and -1 on error
+int proto_assemble(proto_assembler_t *assembler, const char *message, size_t length, proto_header_t *header,
+                   proto_buffer_t *payload) {
+    if (length < sizeof(proto_header_t))
+        return -1;
+
+    memcpy(header, message, sizeof(proto_header_t));
+    if (header->version != PROTO_VERSION || header->length > length - sizeof(proto_header_t))
+        return -1;
+
+    // A recycled pid sends a new request id, so it never continues the payload of a dead client
+    proto_pending_t *slot = NULL, *free_slot = NULL;
+    for (int i = 0; i < PROTO_MAX_PENDING && assembler->used; ++i) {
+        if (assembler->slots[i].pid == header->pid && assembler->slots[i].request_id == header->request_id)
+            slot = &assembler->slots[i];
+    }
+
+    // Single message requests, the common case, never touch a slot
+    if (!slot && !(header->flags & PROTO_MORE)) {
+        proto_buffer_reset(payload);
+        if (proto_buffer_append(payload, message + sizeof(proto_header_t), header->length) == -1)
+            return -1;
+        payload->count = header->count;
+        return 1;
+    }
+
+    if (!slot) {
+        for (int i = 0; i < PROTO_MAX_PENDING && !free_slot; ++i)
+            if (assembler->slots[i].pid == 0)
+                free_slot = &assembler->slots[i];
+        if (!free_slot)
+            return -1;
+        slot = free_slot;
+        slot->pid = header->pid;
+        slot->request_id = header->request_id;
+        slot->type = header->type;
+        proto_buffer_reset(&slot->payload);
+        assembler->used++;
+    }
+
+    if (slot->type != header->type ||
+        proto_buffer_append(&slot->payload, message + sizeof(proto_header_t), header->length) == -1) {
+        slot_release(assembler, slot, 0);
+        return -1;
+    }
+    slot->updated = time(NULL);
+
+    if (header->flags & PROTO_MORE)
+        return 0;
+
+    // Hand the joined payload over by swapping buffers, the slot keeps the caller's allocation
+    proto_buffer_t joined = slot->payload;
+    slot->payload = *payload;
+    *payload = joined;
+    payload->count = header->count;
+    slot_release(assembler, slot, 1);
+    return 1;
+}
+
+// Frees the slots that got no part for PROTO_ASSEMBLY_TIMEOUT seconds
+void proto_assembler_expire(proto_assembler_t *assembler, time_t now) {
+    for (int i = 0; i < PROTO_MAX_PENDING && assembler->used; ++i) {
+        proto_pending_t *slot = &assembler->slots[i];
+        if (slot->pid && slot->updated + PROTO_ASSEMBLY_TIMEOUT <= now)
+            slot_release(assembler, slot, 0);
+    }
+}
+
+// Frees the slots of a client that is gone, the rest of its requests can no longer arrive
+void proto_assembler_drop(proto_assembler_t *assembler, pid_t pid) {
+    for (int i = 0; i < PROTO_MAX_PENDING && assembler->used; ++i) {
+        if (assembler->slots[i].pid == pid)
+            slot_release(assembler, &assembler->slots[i], 0);
+    }
+}
+
+void proto_assembler_destroy(proto_assembler_t *assembler) {
+    for (int i = 0; i < PROTO_MAX_PENDING; ++i) {
+        assembler->slots[i].pid = 0;
+        proto_buffer_free(&assembler->slots[i].payload);
+    }
+    assembler->used = 0;
+}
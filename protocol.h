@@ -0,0 +1,186 @@
+#ifndef CRON_PROTOCOL_H
+#define CRON_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mqueue.h>
+#include <time.h>
+#include <sys/types.h>
+
+// Defines
+#define PROTO_VERSION (2)
+#define PROTO_MAX_MSG (8192)
+#define PROTO_MAX_REQUEST (64 * 1024 * 1024)
+#define PROTO_MAX_PENDING (64)
+#define PROTO_ASSEMBLY_TIMEOUT (30)
+#define PROTO_MORE (1)
+#define PROTO_LIST_DEFAULT_LIMIT (1024)
+#define PROTO_LIST_MAX_LIMIT (16384)
+
+// Enums
+typedef enum {
+    PROTO_OP_ADD = 1,
+    PROTO_OP_EDIT,
+    PROTO_OP_DELETE
+} proto_op_type_t;
+
+typedef enum {
+    PROTO_OK,
+    PROTO_INVALID,
+    PROTO_NOT_FOUND,
+    PROTO_FAILED,
+    PROTO_UNSUPPORTED,
+    PROTO_ABORTED,
+    PROTO_BUSY,
+    PROTO_TIMEOUT
+} proto_status_t;
+
+// Structures
+/*
+ * Every message on a queue starts with this header. A request or reply
+ * larger than one message is split into several, all but the last one
+ * flagged PROTO_MORE; the receiver joins the payloads before parsing, so
+ * records may cross message borders. count is the number of records in
+ * the whole payload, status is only used in replies. request_id is
+ * chosen by the client and copied into the reply, so a client with several
+ * requests in flight can match replies that complete out of order.
+ */
+typedef struct {
+    uint16_t version;
+    uint16_t type;
+    uint16_t flags;
+    uint16_t status;
+    pid_t pid;
+    uint32_t count;
+    uint32_t length;
+    uint32_t request_id;
+} proto_header_t;
+
+// One operation of a BATCH request, followed by length bytes of "min h d m wd path" text
+typedef struct {
+    uint8_t type;
+    uint8_t timer_type;
+    uint16_t length;
+    uint32_t reserved;
+    uint64_t id;
+} proto_op_t;
+
+// Result of one operation, id is the task that was added, edited or deleted
+typedef struct {
+    int32_t status;
+    uint32_t reserved;
+    uint64_t id;
+} proto_result_t;
+
+// Payload of a LIST request, cursor is the last id of the previous page or 0 for the first one
+typedef struct {
+    uint64_t cursor;
+    uint32_t limit;
+    uint32_t reserved;
+} proto_list_request_t;
+
+// A LIST reply starts with the page header, next is 0 on the last page
+typedef struct {
+    uint64_t next;
+    uint64_t total;
+} proto_list_page_t;
+
+// One task of a LIST page, followed by length bytes of "min h d m wd path" text of which spec_length are the fields
+typedef struct {
+    uint64_t id;
+    uint8_t timer_type;
+    uint8_t reserved;
+    uint16_t length;
+    uint16_t spec_length;
+    uint16_t reserved2;
+} proto_list_entry_t;
+
+/*
+ * One metric of a STATS reply, times in nanoseconds. metric is a metric_t;
+ * quantiles is 0 in replies about one task, which keep only count, sum
+ * and max.
+ */
+typedef struct {
+    uint16_t metric;
+    uint16_t quantiles;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+} proto_stats_t;
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    uint32_t count;
+} proto_buffer_t;
+
+typedef struct {
+    pid_t pid;
+    uint32_t request_id;
+    uint16_t type;
+    time_t updated;
+    proto_buffer_t payload;
+} proto_pending_t;
+
+/*
+ * Joins multi-message requests, one slot per (pid, request_id) with parts
+ * still missing. A slot that gets no part for PROTO_ASSEMBLY_TIMEOUT
+ * seconds belongs to a client that died mid-request and is freed by
+ * proto_assembler_expire, so is the slot of a socket client that closed
+ * its connection.
+ */
+typedef struct {
+    proto_pending_t slots[PROTO_MAX_PENDING];
+    size_t used;
+} proto_assembler_t;
+
+// Buffer methods
+void proto_buffer_init(proto_buffer_t *buffer);
+
+int proto_buffer_append(proto_buffer_t *buffer, const void *data, size_t length);
+
+void proto_buffer_reset(proto_buffer_t *buffer);
+
+void proto_buffer_free(proto_buffer_t *buffer);
+
+// Record methods
+int proto_add_op(proto_buffer_t *batch, proto_op_type_t type, int timer_type, uint64_t id, const char *text);
+
+const proto_op_t *proto_next_op(const proto_buffer_t *batch, size_t *offset, const char **text);
+
+int proto_add_result(proto_buffer_t *results, proto_status_t status, uint64_t id);
+
+int proto_add_list_entry(proto_buffer_t *page, uint64_t id, int timer_type, const char *spec, const char *path);
+
+const proto_list_entry_t *proto_next_list_entry(const proto_buffer_t *page, size_t *offset, const char **text);
+
+int proto_add_stats(proto_buffer_t *reply, const proto_stats_t *stats);
+
+const char *proto_status_name(proto_status_t status);
+
+// Message methods
+int proto_send_from(mqd_t mqd, proto_header_t *header, const void *payload, size_t length, size_t *offset);
+
+int proto_send(mqd_t mqd, uint16_t type, pid_t pid, proto_status_t status, uint32_t count,
+               const void *payload, size_t length);
+
+int proto_receive(mqd_t mqd, proto_header_t *header, proto_buffer_t *payload);
+
+void proto_assembler_init(proto_assembler_t *assembler);
+
+int proto_assemble(proto_assembler_t *assembler, const char *message, size_t length, proto_header_t *header,
+                   proto_buffer_t *payload);
+
+void proto_assembler_expire(proto_assembler_t *assembler, time_t now);
+
+void proto_assembler_drop(proto_assembler_t *assembler, pid_t pid);
+
+void proto_assembler_destroy(proto_assembler_t *assembler);
+
+#endif //CRON_PROTOCOL_H
@@ -0,0 +1,387 @@
+#include "reaper.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define REAPER_WAKE_TAG (0)
+#define REAPER_ZYGOTE_TAG (UINT64_MAX)
+
+struct reaper_child_t {
+    pid_t pid;
+    int pidfd;
+    uint64_t task_id;
+    uint64_t lag_us;
+    int status;
+    struct rusage usage;
+    struct timespec started;
+    struct timespec exited;
+    reaper_child_t *next;
+};
+
+static size_t pid_hash(pid_t pid, size_t capacity) {
+    return ((uint32_t) pid * 2654435761u) & (capacity - 1);
+}
+
+static reaper_child_t *table_find(reaper_t *reaper, pid_t pid) {
+    size_t idx = pid_hash(pid, reaper->capacity);
+
+    while (reaper->table[idx]) {
+        if (reaper->table[idx]->pid == pid)
+            return reaper->table[idx];
+        idx = (idx + 1) & (reaper->capacity - 1);
+    }
+    return NULL;
+}
+
+static void table_place(reaper_child_t **table, size_t capacity, reaper_child_t *child) {
+    size_t idx = pid_hash(child->pid, capacity);
+    while (table[idx])
+        idx = (idx + 1) & (capacity - 1);
+    table[idx] = child;
+}
+
+static int table_insert(reaper_t *reaper, reaper_child_t *child) {
+    if ((reaper->count + 1) * 2 > reaper->capacity) {
+        size_t capacity = reaper->capacity * 2;
+        reaper_child_t **table = calloc(capacity, sizeof(reaper_child_t *));
+        if (!table)
+            return -1;
+
+        for (size_t i = 0; i < reaper->capacity; ++i)
+            if (reaper->table[i])
+                table_place(table, capacity, reaper->table[i]);
+
+        free(reaper->table);
+        reaper->table = table;
+        reaper->capacity = capacity;
+    }
+
+    table_place(reaper->table, reaper->capacity, child);
+    reaper->count++;
+    return 0;
+}
+
+// Linear probing removal with backward shift, so lookups never need tombstones
+static void table_remove(reaper_t *reaper, pid_t pid) {
+    size_t mask = reaper->capacity - 1;
+    size_t idx = pid_hash(pid, reaper->capacity);
+
+    while (reaper->table[idx] && reaper->table[idx]->pid != pid)
+        idx = (idx + 1) & mask;
+    if (!reaper->table[idx])
+        return;
+
+    reaper->table[idx] = NULL;
+    reaper->count--;
+
+    size_t next = (idx + 1) & mask;
+    while (reaper->table[next]) {
+        size_t home = pid_hash(reaper->table[next]->pid, reaper->capacity);
+        if (((next - home) & mask) >= ((next - idx) & mask)) {
+            reaper->table[idx] = reaper->table[next];
+            reaper->table[next] = NULL;
+            idx = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+static uint64_t timeval_us(const struct timeval *value) {
+    return (uint64_t) value->tv_sec * 1000000 + value->tv_usec;
+}
+
+static void reaper_finish(reaper_t *reaper, reaper_child_t *child) {
+    reaper_run_t run = {.pid = child->pid, .task_id = child->task_id, .status = child->status,
+                        .lag_us = child->lag_us};
+
+    int64_t wall_ns = (int64_t) (child->exited.tv_sec - child->started.tv_sec) * 1000000000 +
+                      (child->exited.tv_nsec - child->started.tv_nsec);
+    run.wall_us = wall_ns > 0 ? (uint64_t) wall_ns / 1000 : 0;
+    run.cpu_us = timeval_us(&child->usage.ru_utime) + timeval_us(&child->usage.ru_stime);
+    run.max_rss_kb = child->usage.ru_maxrss;
+
+    if (child->pidfd != -1)
+        close(child->pidfd);
+    free(child);
+
+    atomic_fetch_add(&reaper->reaped, 1);
+    if (reaper->callback)
+        reaper->callback(&run, reaper->arg);
+}
+
+static void reaper_collect(reaper_t *reaper, pid_t pid) {
+    pthread_mutex_lock(&reaper->mutex);
+    reaper_child_t *child = table_find(reaper, pid);
+    if (!child || wait4(pid, &child->status, WNOHANG, &child->usage) != pid) {
+        pthread_mutex_unlock(&reaper->mutex);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &child->exited);
+    table_remove(reaper, pid);
+    pthread_mutex_unlock(&reaper->mutex);
+
+    reaper_finish(reaper, child);
+}
+
+static void reaper_report(reaper_t *reaper, const spawner_exit_t *report) {
+    pthread_mutex_lock(&reaper->mutex);
+    reaper_child_t *child = table_find(reaper, report->pid);
+
+    if (!child) {
+        // The child exited before the spawn worker registered it, keep the report until it does
+        child = calloc(1, sizeof(reaper_child_t));
+        if (child) {
+            child->pid = report->pid;
+            child->pidfd = -1;
+            child->status = report->status;
+            child->usage = report->usage;
+            child->exited = report->exited;
+            if (table_insert(reaper, child) == -1)
+                free(child);
+        }
+        pthread_mutex_unlock(&reaper->mutex);
+        return;
+    }
+
+    child->status = report->status;
+    child->usage = report->usage;
+    child->exited = report->exited;
+    table_remove(reaper, report->pid);
+    pthread_mutex_unlock(&reaper->mutex);
+
+    reaper_finish(reaper, child);
+}
+
+// Children without a pidfd (descriptor limit reached) are polled, which is the only O(n) path
+static void reaper_scan_fallback(reaper_t *reaper) {
+    reaper_child_t *done = NULL;
+
+    pthread_mutex_lock(&reaper->mutex);
+    reaper_child_t **link = &reaper->fallback;
+    while (*link) {
+        reaper_child_t *child = *link;
+        if (wait4(child->pid, &child->status, WNOHANG, &child->usage) == child->pid) {
+            clock_gettime(CLOCK_MONOTONIC, &child->exited);
+            *link = child->next;
+            table_remove(reaper, child->pid);
+            child->next = done;
+            done = child;
+        } else {
+            link = &child->next;
+        }
+    }
+    pthread_mutex_unlock(&reaper->mutex);
+
+    while (done) {
+        reaper_child_t *next = done->next;
+        reaper_finish(reaper, done);
+        done = next;
+    }
+}
+
+static void *reaper_thread_func(void *arg) {
+    reaper_t *reaper = (reaper_t *) arg;
+    struct epoll_event events[REAPER_MAX_EVENTS];
+
+    while (1) {
+        pthread_mutex_lock(&reaper->mutex);
+        int timeout = reaper->fallback ? REAPER_FALLBACK_POLL_MS : -1;
+        pthread_mutex_unlock(&reaper->mutex);
+
+        int n = epoll_wait(reaper->epoll_fd, events, REAPER_MAX_EVENTS, timeout);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            uint64_t tag = events[i].data.u64;
+
+            if (tag == REAPER_WAKE_TAG) {
+                uint64_t value;
+                if (read(reaper->event_fd, &value, sizeof(value)) == sizeof(value) && atomic_load(&reaper->stop))
+                    return NULL;
+                continue;
+            }
+
+            if (tag == REAPER_ZYGOTE_TAG) {
+                spawner_exit_t report;
+                while (recv(reaper->spawner->exit_sock, &report, sizeof(report), MSG_DONTWAIT) == sizeof(report))
+                    reaper_report(reaper, &report);
+            } else {
+                reaper_collect(reaper, (pid_t) tag);
+            }
+        }
+
+        if (timeout != -1)
+            reaper_scan_fallback(reaper);
+    }
+
+    return NULL;
+}
+
+int reaper_init(reaper_t *reaper, spawner_t *spawner, reaper_exit_func_t callback, void *arg) {
+    if (!reaper || !spawner)
+        return -1;
+
+    // Every running child holds a pidfd, so allow as many descriptors as the hard limit does
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    reaper->table = calloc(REAPER_INITIAL_CAPACITY, sizeof(reaper_child_t *));
+    if (!reaper->table) {
+        perror("calloc failed");
+        return -1;
+    }
+    reaper->capacity = REAPER_INITIAL_CAPACITY;
+    reaper->count = 0;
+    reaper->fallback = NULL;
+    reaper->spawner = spawner;
+    reaper->callback = callback;
+    reaper->arg = arg;
+    atomic_init(&reaper->reaped, 0);
+    atomic_init(&reaper->stop, 0);
+
+    reaper->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    reaper->event_fd = eventfd(0, EFD_CLOEXEC);
+    if (reaper->epoll_fd == -1 || reaper->event_fd == -1) {
+        perror("Failed to create reaper descriptors");
+        if (reaper->epoll_fd != -1)
+            close(reaper->epoll_fd);
+        if (reaper->event_fd != -1)
+            close(reaper->event_fd);
+        free(reaper->table);
+        return -1;
+    }
+
+    struct epoll_event event = {.events = EPOLLIN, .data.u64 = REAPER_WAKE_TAG};
+    epoll_ctl(reaper->epoll_fd, EPOLL_CTL_ADD, reaper->event_fd, &event);
+
+    if (spawner->mode == SPAWNER_ZYGOTE) {
+        event.data.u64 = REAPER_ZYGOTE_TAG;
+        epoll_ctl(reaper->epoll_fd, EPOLL_CTL_ADD, spawner->exit_sock, &event);
+    }
+
+    pthread_mutex_init(&reaper->mutex, NULL);
+
+    if (pthread_create(&reaper->thread, NULL, reaper_thread_func, reaper) != 0) {
+        printf("Failed to create reaper thread.\n");
+        pthread_mutex_destroy(&reaper->mutex);
+        close(reaper->epoll_fd);
+        close(reaper->event_fd);
+        free(reaper->table);
+        return -1;
+    }
+
+    return 0;
+}
+
+int reaper_watch(reaper_t *reaper, pid_t pid, uint64_t task_id, const struct timespec *started, uint64_t lag_us) {
+    pthread_mutex_lock(&reaper->mutex);
+
+    reaper_child_t *child = table_find(reaper, pid);
+    if (child) {
+        // The zygote already reported this exit
+        child->task_id = task_id;
+        child->started = *started;
+        child->lag_us = lag_us;
+        table_remove(reaper, pid);
+        pthread_mutex_unlock(&reaper->mutex);
+        reaper_finish(reaper, child);
+        return 0;
+    }
+
+    child = calloc(1, sizeof(reaper_child_t));
+    if (!child) {
+        pthread_mutex_unlock(&reaper->mutex);
+        return -1;
+    }
+    child->pid = pid;
+    child->pidfd = -1;
+    child->task_id = task_id;
+    child->started = *started;
+    child->lag_us = lag_us;
+
+    if (reaper->spawner->mode == SPAWNER_DIRECT) {
+        child->pidfd = (int) syscall(SYS_pidfd_open, pid, 0);
+        struct epoll_event event = {.events = EPOLLIN, .data.u64 = (uint64_t) pid};
+
+        if (child->pidfd == -1 || epoll_ctl(reaper->epoll_fd, EPOLL_CTL_ADD, child->pidfd, &event) == -1) {
+            if (child->pidfd != -1)
+                close(child->pidfd);
+            child->pidfd = -1;
+            child->next = reaper->fallback;
+            reaper->fallback = child;
+
+            // Wake the reaper so that it starts polling
+            uint64_t value = 1;
+            if (write(reaper->event_fd, &value, sizeof(value)) == -1)
+                perror("Failed to wake reaper");
+        }
+    }
+
+    if (table_insert(reaper, child) == -1) {
+        // Undo the registration above, nothing may keep pointing at the child
+        if (child->pidfd != -1) {
+            epoll_ctl(reaper->epoll_fd, EPOLL_CTL_DEL, child->pidfd, NULL);
+            close(child->pidfd);
+        } else if (reaper->spawner->mode == SPAWNER_DIRECT) {
+            reaper_child_t **link = &reaper->fallback;
+            while (*link && *link != child)
+                link = &(*link)->next;
+            if (*link)
+                *link = child->next;
+        }
+        free(child);
+        pthread_mutex_unlock(&reaper->mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&reaper->mutex);
+    return 0;
+}
+
+size_t reaper_running(reaper_t *reaper) {
+    pthread_mutex_lock(&reaper->mutex);
+    size_t count = reaper->count;
+    pthread_mutex_unlock(&reaper->mutex);
+    return count;
+}
+
+void reaper_destroy(reaper_t *reaper) {
+    if (!reaper || !reaper->table)
+        return;
+
+    uint64_t value = 1;
+    atomic_store(&reaper->stop, 1);
+    if (write(reaper->event_fd, &value, sizeof(value)) == sizeof(value))
+        pthread_join(reaper->thread, NULL);
+
+    // Children still running are left to init, only our bookkeeping goes away
+    for (size_t i = 0; i < reaper->capacity; ++i) {
+        reaper_child_t *child = reaper->table[i];
+        if (!child)
+            continue;
+        if (child->pidfd != -1)
+            close(child->pidfd);
+        free(child);
+    }
+
+    close(reaper->epoll_fd);
+    close(reaper->event_fd);
+    pthread_mutex_destroy(&reaper->mutex);
+    free(reaper->table);
+    reaper->table = NULL;
+}
@@ -0,0 +1,65 @@
+#ifndef CRON_REAPER_H
+#define CRON_REAPER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "spawner.h"
+
+// Defines
+#define REAPER_INITIAL_CAPACITY (256)
+#define REAPER_MAX_EVENTS (64)
+#define REAPER_FALLBACK_POLL_MS (1000)
+
+// Typedefs
+typedef struct reaper_child_t reaper_child_t;
+
+// Structures
+typedef struct {
+    pid_t pid;
+    uint64_t task_id;
+    int status;
+    uint64_t lag_us;
+    uint64_t wall_us;
+    uint64_t cpu_us;
+    long max_rss_kb;
+} reaper_run_t;
+
+typedef void (*reaper_exit_func_t)(const reaper_run_t *run, void *arg);
+
+/*
+ * Collects every spawned child. Direct children are watched through a
+ * pidfd in an epoll set and collected with wait4(), zygote children are
+ * reported on the spawner's exit socket. Running children are indexed by
+ * pid in an open-addressing table, so an exit costs O(1) and no SIGCHLD
+ * handler is involved.
+ */
+typedef struct {
+    int epoll_fd;
+    int event_fd;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    reaper_child_t **table;
+    size_t capacity;
+    size_t count;
+    reaper_child_t *fallback;
+    spawner_t *spawner;
+    reaper_exit_func_t callback;
+    void *arg;
+    atomic_uint_fast64_t reaped;
+    atomic_int stop;
+} reaper_t;
+
+// Reaper methods
+int reaper_init(reaper_t *reaper, spawner_t *spawner, reaper_exit_func_t callback, void *arg);
+
+int reaper_watch(reaper_t *reaper, pid_t pid, uint64_t task_id, const struct timespec *started, uint64_t lag_us);
+
+size_t reaper_running(reaper_t *reaper);
+
+void reaper_destroy(reaper_t *reaper);
+
+#endif //CRON_REAPER_H
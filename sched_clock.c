@@ -0,0 +1,21 @@
+#include "sched_clock.h"
+
+void sched_clock_init(sched_clock_t *clock, sched_clock_source_t source, time_t start) {
+    clock->source = source;
+    atomic_init(&clock->now, source == SCHED_CLOCK_VIRTUAL ? start : 0);
+}
+
+time_t sched_clock_now(sched_clock_t *clock) {
+    if (clock->source == SCHED_CLOCK_VIRTUAL)
+        return atomic_load_explicit(&clock->now, memory_order_acquire);
+    return time(NULL);
+}
+
+// Only a virtual clock can be set, and never backwards: the timing wheel assumes time only grows
+int sched_clock_set(sched_clock_t *clock, time_t now) {
+    if (clock->source != SCHED_CLOCK_VIRTUAL || now < atomic_load_explicit(&clock->now, memory_order_relaxed))
+        return -1;
+
+    atomic_store_explicit(&clock->now, now, memory_order_release);
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef CRON_SCHED_CLOCK_H
+#define CRON_SCHED_CLOCK_H
+
+#include <time.h>
+#include <stdatomic.h>
+
+// Enums
+typedef enum {
+    SCHED_CLOCK_REAL,
+    SCHED_CLOCK_VIRTUAL
+} sched_clock_source_t;
+
+// Structures
+/*
+ * Time source of a scheduler. The real clock is CLOCK_REALTIME, the clock
+ * the scheduler's timerfd waits on. A virtual clock stands still until its
+ * owner moves it forward, so a harness can jump from one deadline straight
+ * to the next and replay months of schedules without waiting for them.
+ */
+typedef struct {
+    sched_clock_source_t source;
+    _Atomic time_t now;
+} sched_clock_t;
+
+// Clock methods
+void sched_clock_init(sched_clock_t *clock, sched_clock_source_t source, time_t start);
+
+time_t sched_clock_now(sched_clock_t *clock);
+
+int sched_clock_set(sched_clock_t *clock, time_t now);
+
+#endif //CRON_SCHED_CLOCK_H
@@ -0,0 +1,407 @@
+#include "scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#define SCHED_WHEEL_NAME "wheel"
+
+static void heap_swap(sched_heap_t *heap, size_t a, size_t b) {
+    sched_entry_t *tmp = heap->entries[a];
+    heap->entries[a] = heap->entries[b];
+    heap->entries[b] = tmp;
+    heap->entries[a]->slot = a;
+    heap->entries[b]->slot = b;
+}
+
+static void heap_sift_up(sched_heap_t *heap, size_t idx) {
+    while (idx > 0) {
+        size_t parent = (idx - 1) / 2;
+        if (heap->entries[parent]->deadline <= heap->entries[idx]->deadline)
+            break;
+        heap_swap(heap, parent, idx);
+        idx = parent;
+    }
+}
+
+static void heap_sift_down(sched_heap_t *heap, size_t idx) {
+    while (1) {
+        size_t left = 2 * idx + 1;
+        size_t right = left + 1;
+        size_t min = idx;
+
+        if (left < heap->count && heap->entries[left]->deadline < heap->entries[min]->deadline)
+            min = left;
+        if (right < heap->count && heap->entries[right]->deadline < heap->entries[min]->deadline)
+            min = right;
+        if (min == idx)
+            break;
+
+        heap_swap(heap, idx, min);
+        idx = min;
+    }
+}
+
+static int heap_push(sched_heap_t *heap, sched_entry_t *entry) {
+    if (heap->count == heap->capacity) {
+        size_t capacity = heap->capacity * 2;
+        sched_entry_t **entries = realloc(heap->entries, capacity * sizeof(sched_entry_t *));
+        if (!entries)
+            return -1;
+        heap->entries = entries;
+        heap->capacity = capacity;
+    }
+
+    entry->slot = heap->count;
+    heap->entries[heap->count++] = entry;
+    heap_sift_up(heap, entry->slot);
+    return 0;
+}
+
+static void heap_erase(sched_heap_t *heap, sched_entry_t *entry) {
+    size_t idx = entry->slot;
+    size_t last = --heap->count;
+
+    entry->slot = SCHED_NO_SLOT;
+    if (idx == last)
+        return;
+
+    heap->entries[idx] = heap->entries[last];
+    heap->entries[idx]->slot = idx;
+    heap_sift_down(heap, idx);
+    heap_sift_up(heap, idx);
+}
+
+static int backend_insert(scheduler_t *scheduler, sched_entry_t *entry) {
+    if (scheduler->backend == SCHED_WHEEL) {
+        wheel_insert(&scheduler->wheel, entry);
+        return 0;
+    }
+    return heap_push(&scheduler->heap, entry);
+}
+
+static void backend_erase(scheduler_t *scheduler, sched_entry_t *entry) {
+    if (scheduler->backend == SCHED_WHEEL)
+        wheel_erase(&scheduler->wheel, entry);
+    else
+        heap_erase(&scheduler->heap, entry);
+}
+
+static sched_entry_t *backend_pop_expired(scheduler_t *scheduler, time_t now) {
+    if (scheduler->backend == SCHED_WHEEL)
+        return wheel_pop_expired(&scheduler->wheel, now);
+
+    sched_heap_t *heap = &scheduler->heap;
+    if (!heap->count || heap->entries[0]->deadline > now)
+        return NULL;
+
+    sched_entry_t *entry = heap->entries[0];
+    heap_erase(heap, entry);
+    return entry;
+}
+
+// Earliest time at which the backend has work to do, 0 when it is empty
+static time_t backend_next_event(scheduler_t *scheduler) {
+    if (scheduler->backend == SCHED_WHEEL)
+        return wheel_next_event(&scheduler->wheel);
+    return scheduler->heap.count ? scheduler->heap.entries[0]->deadline : 0;
+}
+
+// Arms the timerfd at the earliest deadline, must be called with the lock held
+static void scheduler_arm(scheduler_t *scheduler) {
+    if (scheduler->clock.source == SCHED_CLOCK_VIRTUAL)
+        return;
+
+    time_t deadline = backend_next_event(scheduler);
+    if (deadline == scheduler->armed)
+        return;
+
+    struct itimerspec value = {0};
+    value.it_value.tv_sec = deadline;
+
+    if (timerfd_settime(scheduler->timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &value, NULL) == -1) {
+        perror("timerfd_settime failed");
+        return;
+    }
+    scheduler->armed = deadline;
+}
+
+// Fires and re-arms every entry due at now, must be called with the lock held
+static size_t scheduler_fire_due(scheduler_t *scheduler, time_t now) {
+    size_t fired = 0;
+    sched_entry_t *entry;
+
+    while ((entry = backend_pop_expired(scheduler, now))) {
+        time_t next = scheduler->fire(entry, now, scheduler->fire_arg);
+        fired++;
+
+        if (next > 0) {
+            entry->deadline = next > now ? next : now + 1;
+            if (backend_insert(scheduler, entry) == -1)
+                perror("Failed to rearm task");
+        }
+    }
+    return fired;
+}
+
+static void scheduler_dispatch(scheduler_t *scheduler) {
+    pthread_mutex_lock(&scheduler->mutex);
+
+    scheduler_fire_due(scheduler, sched_clock_now(&scheduler->clock));
+
+    scheduler->armed = 0;
+    scheduler_arm(scheduler);
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+static void *scheduler_thread_func(void *arg) {
+    scheduler_t *scheduler = (scheduler_t *) arg;
+    struct pollfd fds[2] = {
+            {.fd = scheduler->timer_fd, .events = POLLIN},
+            {.fd = scheduler->event_fd, .events = POLLIN}
+    };
+
+    while (1) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll failed");
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+            break;
+
+        if (fds[0].revents & POLLIN) {
+            uint64_t expirations;
+            // ECANCELED means the wall clock was set, deadlines are re-evaluated either way
+            if (read(scheduler->timer_fd, &expirations, sizeof(expirations)) == -1 && errno != ECANCELED)
+                continue;
+            scheduler_dispatch(scheduler);
+        }
+    }
+
+    return NULL;
+}
+
+static int scheduler_setup(scheduler_t *scheduler, sched_backend_t backend, sched_fire_func_t fire, void *arg,
+                           sched_clock_source_t source, time_t start) {
+    if (!scheduler || !fire)
+        return -1;
+
+    sched_clock_init(&scheduler->clock, source, start);
+    scheduler->backend = backend;
+    scheduler->heap.entries = NULL;
+    scheduler->heap.count = 0;
+    scheduler->heap.capacity = 0;
+
+    if (backend == SCHED_WHEEL) {
+        wheel_init(&scheduler->wheel, sched_clock_now(&scheduler->clock));
+    } else {
+        scheduler->heap.entries = calloc(SCHED_INITIAL_CAPACITY, sizeof(sched_entry_t *));
+        if (!scheduler->heap.entries) {
+            perror("calloc failed");
+            return -1;
+        }
+        scheduler->heap.capacity = SCHED_INITIAL_CAPACITY;
+    }
+
+    scheduler->armed = 0;
+    scheduler->fire = fire;
+    scheduler->fire_arg = arg;
+    scheduler->timer_fd = -1;
+    scheduler->event_fd = -1;
+    pthread_mutex_init(&scheduler->mutex, NULL);
+
+    return 0;
+}
+
+int scheduler_init(scheduler_t *scheduler, sched_backend_t backend, sched_fire_func_t fire, void *arg) {
+    if (scheduler_setup(scheduler, backend, fire, arg, SCHED_CLOCK_REAL, 0) == -1)
+        return -1;
+
+    scheduler->timer_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (scheduler->timer_fd == -1) {
+        perror("timerfd_create failed");
+        pthread_mutex_destroy(&scheduler->mutex);
+        free(scheduler->heap.entries);
+        return -1;
+    }
+
+    scheduler->event_fd = eventfd(0, EFD_CLOEXEC);
+    if (scheduler->event_fd == -1) {
+        perror("eventfd failed");
+        pthread_mutex_destroy(&scheduler->mutex);
+        close(scheduler->timer_fd);
+        free(scheduler->heap.entries);
+        return -1;
+    }
+
+    if (pthread_create(&scheduler->thread, NULL, scheduler_thread_func, scheduler) != 0) {
+        printf("Failed to create scheduler thread.\n");
+        pthread_mutex_destroy(&scheduler->mutex);
+        close(scheduler->event_fd);
+        close(scheduler->timer_fd);
+        free(scheduler->heap.entries);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Scheduler on a virtual clock starting at start, nothing fires until scheduler_advance()
+int scheduler_init_virtual(scheduler_t *scheduler, sched_backend_t backend, sched_fire_func_t fire, void *arg,
+                           time_t start) {
+    return scheduler_setup(scheduler, backend, fire, arg, SCHED_CLOCK_VIRTUAL, start);
+}
+
+sched_backend_t scheduler_backend_parse(const char *name) {
+    if (name && strcmp(name, SCHED_WHEEL_NAME) == 0)
+        return SCHED_WHEEL;
+    return SCHED_HEAP;
+}
+
+void scheduler_entry_init(sched_entry_t *entry) {
+    entry->deadline = 0;
+    entry->slot = SCHED_NO_SLOT;
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+int scheduler_add(scheduler_t *scheduler, sched_entry_t *entry, time_t deadline) {
+    if (!scheduler || !entry)
+        return -1;
+
+    pthread_mutex_lock(&scheduler->mutex);
+    if (entry->slot != SCHED_NO_SLOT)
+        backend_erase(scheduler, entry);
+
+    entry->deadline = deadline;
+    int result = backend_insert(scheduler, entry);
+    if (result == 0)
+        scheduler_arm(scheduler);
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    return result;
+}
+
+// Inserts unarmed entries whose deadline is already set, under one lock and with a single heapify
+int scheduler_add_batch(scheduler_t *scheduler, sched_entry_t **entries, size_t count) {
+    if (!scheduler || (!entries && count))
+        return -1;
+
+    pthread_mutex_lock(&scheduler->mutex);
+    int result = 0;
+
+    if (scheduler->backend == SCHED_WHEEL) {
+        for (size_t i = 0; i < count; ++i)
+            wheel_insert(&scheduler->wheel, entries[i]);
+    } else {
+        sched_heap_t *heap = &scheduler->heap;
+        size_t capacity = heap->capacity;
+        while (capacity < heap->count + count)
+            capacity *= 2;
+
+        sched_entry_t **heap_entries = capacity == heap->capacity ? heap->entries
+                                                                  : realloc(heap->entries, capacity * sizeof(sched_entry_t *));
+        if (!heap_entries) {
+            result = -1;
+        } else {
+            heap->entries = heap_entries;
+            heap->capacity = capacity;
+            for (size_t i = 0; i < count; ++i) {
+                entries[i]->slot = heap->count;
+                heap->entries[heap->count++] = entries[i];
+            }
+            for (size_t i = heap->count / 2; i-- > 0;)
+                heap_sift_down(heap, i);
+        }
+    }
+
+    if (result == 0)
+        scheduler_arm(scheduler);
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    return result;
+}
+
+void scheduler_remove(scheduler_t *scheduler, sched_entry_t *entry) {
+    if (!scheduler || !entry)
+        return;
+
+    pthread_mutex_lock(&scheduler->mutex);
+    if (entry->slot != SCHED_NO_SLOT) {
+        backend_erase(scheduler, entry);
+        scheduler_arm(scheduler);
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+// Current time of the scheduler's clock, the wall clock when there is no scheduler
+time_t scheduler_now(scheduler_t *scheduler) {
+    return scheduler ? sched_clock_now(&scheduler->clock) : time(NULL);
+}
+
+/*
+ * Moves a virtual clock forward to until, stopping at every deadline on the
+ * way and firing what is due there, so each entry fires at exactly its
+ * deadline. Returns the number of entries fired; a scheduler on the real
+ * clock is left alone.
+ */
+size_t scheduler_advance(scheduler_t *scheduler, time_t until) {
+    if (!scheduler || scheduler->clock.source != SCHED_CLOCK_VIRTUAL)
+        return 0;
+
+    size_t fired = 0;
+    while (1) {
+        pthread_mutex_lock(&scheduler->mutex);
+        time_t now = sched_clock_now(&scheduler->clock);
+        time_t next = backend_next_event(scheduler);
+
+        if (!next || next > until) {
+            if (until > now)
+                sched_clock_set(&scheduler->clock, until);
+            pthread_mutex_unlock(&scheduler->mutex);
+            break;
+        }
+
+        // Entries added with a deadline already behind the clock fire at the current time
+        if (next > now) {
+            sched_clock_set(&scheduler->clock, next);
+            now = next;
+        }
+        fired += scheduler_fire_due(scheduler, now);
+        pthread_mutex_unlock(&scheduler->mutex);
+    }
+    return fired;
+}
+
+size_t scheduler_size(scheduler_t *scheduler) {
+    pthread_mutex_lock(&scheduler->mutex);
+    size_t count = scheduler->backend == SCHED_WHEEL ? scheduler->wheel.count : scheduler->heap.count;
+    pthread_mutex_unlock(&scheduler->mutex);
+    return count;
+}
+
+void scheduler_destroy(scheduler_t *scheduler) {
+    if (!scheduler)
+        return;
+
+    if (scheduler->clock.source == SCHED_CLOCK_REAL) {
+        uint64_t value = 1;
+        if (write(scheduler->event_fd, &value, sizeof(value)) == sizeof(value))
+            pthread_join(scheduler->thread, NULL);
+
+        close(scheduler->event_fd);
+        close(scheduler->timer_fd);
+    }
+    pthread_mutex_destroy(&scheduler->mutex);
+    free(scheduler->heap.entries);
+    scheduler->heap.entries = NULL;
+    scheduler->heap.count = 0;
+}
@@ -0,0 +1,87 @@
+#ifndef CRON_SCHEDULER_H
+#define CRON_SCHEDULER_H
+
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include "timing_wheel.h"
+#include "sched_clock.h"
+
+// Defines
+#define SCHED_NO_SLOT ((size_t) -1)
+#define SCHED_INITIAL_CAPACITY (64)
+
+// Typedefs
+typedef struct sched_entry_t sched_entry_t;
+
+// Enums
+typedef enum {
+    SCHED_HEAP,
+    SCHED_WHEEL
+} sched_backend_t;
+
+/*
+ * Called by the dispatcher thread, with the scheduler lock held, for every
+ * entry whose deadline has passed. Returns the next deadline of the entry
+ * or 0 when the entry should not be armed again.
+ */
+typedef time_t (*sched_fire_func_t)(sched_entry_t *entry, time_t now, void *arg);
+
+// Structures
+struct sched_entry_t {
+    time_t deadline;
+    size_t slot;
+    sched_entry_t *prev;
+    sched_entry_t *next;
+};
+
+typedef struct {
+    sched_entry_t **entries;
+    size_t count;
+    size_t capacity;
+} sched_heap_t;
+
+/*
+ * Deadlines are kept in a heap or a timing wheel and fired by a dispatcher
+ * thread woken by a timerfd. On a virtual clock there is no thread and no
+ * timerfd: the owner drives the scheduler with scheduler_advance().
+ */
+typedef struct {
+    sched_backend_t backend;
+    sched_heap_t heap;
+    timing_wheel_t wheel;
+    sched_clock_t clock;
+    time_t armed;
+    int timer_fd;
+    int event_fd;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    sched_fire_func_t fire;
+    void *fire_arg;
+} scheduler_t;
+
+// Scheduler methods
+int scheduler_init(scheduler_t *scheduler, sched_backend_t backend, sched_fire_func_t fire, void *arg);
+
+int scheduler_init_virtual(scheduler_t *scheduler, sched_backend_t backend, sched_fire_func_t fire, void *arg,
+                           time_t start);
+
+sched_backend_t scheduler_backend_parse(const char *name);
+
+void scheduler_entry_init(sched_entry_t *entry);
+
+int scheduler_add(scheduler_t *scheduler, sched_entry_t *entry, time_t deadline);
+
+int scheduler_add_batch(scheduler_t *scheduler, sched_entry_t **entries, size_t count);
+
+void scheduler_remove(scheduler_t *scheduler, sched_entry_t *entry);
+
+size_t scheduler_size(scheduler_t *scheduler);
+
+time_t scheduler_now(scheduler_t *scheduler);
+
+size_t scheduler_advance(scheduler_t *scheduler, time_t until);
+
+void scheduler_destroy(scheduler_t *scheduler);
+
+#endif //CRON_SCHEDULER_H
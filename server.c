@@ -0,0 +1,433 @@
+#define LOG_COMPONENT LOG_IPC
+#include "server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define SERVER_WAKE_TAG (0)
+#define SERVER_TRANSPORT_TAG (1)
+
+static void request_free(server_request_t *request) {
+    if (request->fd != -1)
+        close(request->fd);
+    proto_buffer_free(&request->payload);
+    proto_buffer_free(&request->reply);
+    free(request);
+}
+
+static server_request_t *request_alloc(const proto_header_t *header) {
+    server_request_t *request = calloc(1, sizeof(server_request_t));
+    if (!request)
+        return NULL;
+
+    request->header = *header;
+    request->fd = -1;
+    proto_buffer_init(&request->payload);
+    proto_buffer_init(&request->reply);
+    return request;
+}
+
+// The reply descriptor is taken when the request arrives, a socket connection may be gone by the time it is answered
+static server_request_t *request_open(transport_t *transport, const proto_header_t *header, int peer) {
+    server_request_t *request = request_alloc(header);
+    if (!request)
+        return NULL;
+
+    request->transport = transport;
+    request->fd = transport_reply_open(transport, header->pid, peer);
+    if (request->fd == -1) {
+        LPRINTF(LOW, "[PID:%d]: Failed to connect with client.\n", header->pid);
+        request_free(request);
+        return NULL;
+    }
+    return request;
+}
+
+static void sending_remove(server_t *server, server_request_t *request) {
+    for (server_request_t **link = &server->sending; *link; link = &(*link)->next) {
+        if (*link == request) {
+            *link = request->next;
+            break;
+        }
+    }
+}
+
+// Closes a sent reply and returns the next reply queued behind it for the same client
+static server_request_t *reply_finish(server_t *server, server_request_t *request) {
+    server_request_t *queued = request->queued;
+
+    if (request->waiting) {
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, request->fd, NULL);
+        sending_remove(server, request);
+    }
+    request_free(request);
+    return queued;
+}
+
+// Sends as much of the reply as the client takes, the rest waits for EPOLLOUT
+static server_request_t *reply_continue(server_t *server, server_request_t *request) {
+    int result = transport_send_from(request->transport->type, request->fd, &request->header, request->reply.data,
+                                     request->reply.length, &request->offset);
+
+    if (result == 1) {
+        if (!request->waiting) {
+            struct epoll_event event = {.events = EPOLLOUT, .data.ptr = request};
+            if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, request->fd, &event) == -1) {
+                LPRINTF(LOW, "[PID:%d]: Failed to wait for client.\n", request->header.pid);
+                return reply_finish(server, request);
+            }
+            request->waiting = 1;
+            request->deadline = time(NULL) + SERVER_REPLY_TIMEOUT;
+            request->next = server->sending;
+            server->sending = request;
+        }
+        return NULL;
+    }
+
+    if (result == -1)
+        LPRINTF(LOW, "[PID:%d]: Failed to reply.\n", request->header.pid);
+    return reply_finish(server, request);
+}
+
+/*
+ * Replies to one client go out one at a time: while a reply waits for room
+ * in the client queue or socket, later ones are chained behind it, otherwise
+ * the parts of two multi-message replies could interleave.
+ */
+static void reply_start(server_t *server, server_request_t *request) {
+    while (request) {
+        server_request_t *blocked = server->sending;
+        while (blocked && blocked->header.pid != request->header.pid)
+            blocked = blocked->next;
+
+        if (blocked) {
+            while (blocked->queued)
+                blocked = blocked->queued;
+            blocked->queued = request;
+            return;
+        }
+
+        request->header.version = PROTO_VERSION;
+        request->header.type = request->reply_type;
+        request->header.status = (uint16_t) request->status;
+        request->header.count = request->reply.count;
+        request->offset = 0;
+        request = reply_continue(server, request);
+    }
+}
+
+// Answers a request without handing it to the pool
+static void reply_status(server_t *server, transport_t *transport, const proto_header_t *header, int peer,
+                         proto_status_t status) {
+    server_request_t *request = request_open(transport, header, peer);
+    if (!request)
+        return;
+
+    request->reply_type = RESULTS;
+    request->status = status;
+    reply_start(server, request);
+}
+
+static void flush_done(server_t *server) {
+    pthread_mutex_lock(&server->mutex);
+    server_request_t *request = server->done;
+    server->done = NULL;
+    pthread_mutex_unlock(&server->mutex);
+
+    while (request) {
+        server_request_t *next = request->next;
+        request->next = NULL;
+        reply_start(server, request);
+        request = next;
+    }
+}
+
+// Drops replies to clients that stopped reading, their queue would otherwise be kept open forever
+static void expire_replies(server_t *server, time_t now) {
+    server_request_t *request = server->sending;
+
+    while (request) {
+        server_request_t *next = request->next;
+        if (request->deadline <= now) {
+            LPRINTF(LOW, "[PID:%d]: Client stopped reading, reply dropped.\n", request->header.pid);
+            pthread_mutex_lock(&server->mutex);
+            server->stats.expired++;
+            pthread_mutex_unlock(&server->mutex);
+
+            // Replies queued behind it would only wait out the same timeout
+            server_request_t *queued = reply_finish(server, request);
+            while (queued) {
+                server_request_t *dropped = queued;
+                queued = queued->queued;
+                request_free(dropped);
+            }
+        }
+        request = next;
+    }
+}
+
+static void admit(server_t *server, transport_t *transport, const proto_header_t *header, int peer) {
+    server_class_t class = header->type == LIST || header->type == STATS ? SERVER_READ : SERVER_WRITE;
+    server_request_t *request = request_open(transport, header, peer);
+    if (!request)
+        return;
+
+    pthread_mutex_lock(&server->mutex);
+    size_t pending = server->queued[SERVER_WRITE] + server->queued[SERVER_READ];
+    int admitted = class == SERVER_READ ? server->queued[SERVER_READ] < server->max_pending / 2 :
+                   pending < server->max_pending;
+
+    if (admitted) {
+        // The joined payload moves into the request, the loop starts over with an empty buffer
+        request->class = class;
+        request->payload = server->payload;
+        proto_buffer_init(&server->payload);
+
+        if (server->tail[class])
+            server->tail[class]->next = request;
+        else
+            server->head[class] = request;
+        server->tail[class] = request;
+        server->queued[class]++;
+        server->stats.accepted++;
+        pthread_cond_signal(&server->cond);
+    } else {
+        server->stats.rejected++;
+    }
+    pthread_mutex_unlock(&server->mutex);
+
+    if (!admitted) {
+        LPRINTF(LOW, "[PID:%d]: Server busy, request rejected\n", header->pid);
+        request->reply_type = RESULTS;
+        request->status = PROTO_BUSY;
+        reply_start(server, request);
+    }
+}
+
+// A client that closed its connection will not send the rest of a split request
+static void connection_closed(pid_t pid, void *arg) {
+    proto_assembler_drop(&((server_t *) arg)->assembler, pid);
+}
+
+// Drains a transport, returns 1 once a DESTROY request was received
+static int receive_requests(server_t *server, transport_t *transport) {
+    const char *message;
+    proto_header_t header;
+    ssize_t length;
+    int peer;
+
+    while ((length = transport_receive(transport, &message, &peer)) != -1) {
+        int assembled = proto_assemble(&server->assembler, message, (size_t) length, &header, &server->payload);
+        if (assembled == 0)
+            continue;
+
+        if (assembled == -1) {
+            if (length >= (ssize_t) sizeof(proto_header_t)) {
+                LPRINTF(LOW, "[PID:%d]: Malformed request\n", header.pid);
+                reply_status(server, transport, &header, peer,
+                             header.version != PROTO_VERSION ? PROTO_UNSUPPORTED : PROTO_INVALID);
+            }
+            continue;
+        }
+
+        if (header.type == DESTROY) {
+            LPRINTF(MID, "[PID:%d]: Close\n", header.pid);
+            return 1;
+        }
+
+        admit(server, transport, &header, peer);
+    }
+
+    if (errno != EAGAIN)
+        perror("receive failed");
+    return 0;
+}
+
+static void *server_worker_func(void *arg) {
+    server_t *server = (server_t *) arg;
+
+    pthread_mutex_lock(&server->mutex);
+    while (1) {
+        server_request_t *request = NULL;
+        server_class_t class = SERVER_WRITE;
+
+        while (!request) {
+            if (server->head[SERVER_WRITE]) {
+                class = SERVER_WRITE;
+            } else if (server->head[SERVER_READ] && server->running_reads < server->read_slots) {
+                class = SERVER_READ;
+                server->running_reads++;
+            } else if (server->stop) {
+                pthread_mutex_unlock(&server->mutex);
+                return NULL;
+            } else {
+                pthread_cond_wait(&server->cond, &server->mutex);
+                continue;
+            }
+
+            request = server->head[class];
+            server->head[class] = request->next;
+            if (!server->head[class])
+                server->tail[class] = NULL;
+            server->queued[class]--;
+            request->next = NULL;
+        }
+        pthread_mutex_unlock(&server->mutex);
+
+        server->handler(request, server->arg);
+
+        pthread_mutex_lock(&server->mutex);
+        if (class == SERVER_READ) {
+            server->running_reads--;
+            pthread_cond_signal(&server->cond);
+        }
+        request->next = server->done;
+        server->done = request;
+
+        uint64_t value = 1;
+        if (write(server->event_fd, &value, sizeof(value)) == -1)
+            perror("eventfd write failed");
+    }
+}
+
+int server_init(server_t *server, transport_t *transports, size_t transport_count, size_t worker_count,
+                size_t max_pending, server_handler_t handler, void *arg) {
+    if (!server || !transports || transport_count < 1 || !handler || worker_count < 1 || max_pending < 2)
+        return -1;
+
+    memset(server, 0, sizeof(server_t));
+    server->transports = transports;
+    server->transport_count = transport_count;
+    server->handler = handler;
+    server->arg = arg;
+    server->max_pending = max_pending;
+    // One handler always stays free for writes
+    server->read_slots = worker_count > 1 ? worker_count - 1 : 1;
+    proto_assembler_init(&server->assembler);
+    proto_buffer_init(&server->payload);
+
+    server->workers = calloc(worker_count, sizeof(pthread_t));
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (!server->workers || server->epoll_fd == -1 || server->event_fd == -1) {
+        perror("server init failed");
+        free(server->workers);
+        if (server->epoll_fd != -1)
+            close(server->epoll_fd);
+        if (server->event_fd != -1)
+            close(server->event_fd);
+        return -1;
+    }
+
+    struct epoll_event wake = {.events = EPOLLIN, .data.u64 = SERVER_WAKE_TAG};
+    int added = epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->event_fd, &wake);
+    for (size_t i = 0; i < transport_count && added != -1; ++i) {
+        transports[i].closed = connection_closed;
+        transports[i].closed_arg = server;
+        struct epoll_event event = {.events = EPOLLIN, .data.u64 = SERVER_TRANSPORT_TAG + i};
+        added = epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, transports[i].fd, &event);
+    }
+    if (added == -1) {
+        perror("epoll_ctl failed");
+        free(server->workers);
+        close(server->epoll_fd);
+        close(server->event_fd);
+        return -1;
+    }
+
+    pthread_mutex_init(&server->mutex, NULL);
+    pthread_cond_init(&server->cond, NULL);
+
+    for (server->worker_count = 0; server->worker_count < worker_count; ++server->worker_count) {
+        if (pthread_create(&server->workers[server->worker_count], NULL, server_worker_func, server) != 0) {
+            printf("Failed to create server worker.\n");
+            server_destroy(server);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void server_run(server_t *server) {
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    int end = 0;
+
+    while (!end) {
+        int n = epoll_wait(server->epoll_fd, events, SERVER_MAX_EVENTS,
+                           server->sending || server->assembler.used ? 1000 : -1);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < n && !end; ++i) {
+            uint64_t tag = events[i].data.u64;
+
+            if (tag >= SERVER_TRANSPORT_TAG && tag < SERVER_TRANSPORT_TAG + server->transport_count) {
+                end = receive_requests(server, &server->transports[tag - SERVER_TRANSPORT_TAG]);
+            } else if (tag == SERVER_WAKE_TAG) {
+                uint64_t value;
+                if (read(server->event_fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+                    perror("eventfd read failed");
+                flush_done(server);
+            } else {
+                server_request_t *queued = reply_continue(server, (server_request_t *) events[i].data.ptr);
+                if (queued)
+                    reply_start(server, queued);
+            }
+        }
+
+        if (server->sending)
+            expire_replies(server, time(NULL));
+        if (server->assembler.used)
+            proto_assembler_expire(&server->assembler, time(NULL));
+    }
+}
+
+void server_stats(server_t *server, server_stats_t *stats) {
+    pthread_mutex_lock(&server->mutex);
+    *stats = server->stats;
+    stats->queued_writes = server->queued[SERVER_WRITE];
+    stats->queued_reads = server->queued[SERVER_READ];
+    pthread_mutex_unlock(&server->mutex);
+}
+
+void server_destroy(server_t *server) {
+    if (!server || !server->workers)
+        return;
+
+    // Requests already admitted are still handled so that their changes reach the journal
+    pthread_mutex_lock(&server->mutex);
+    server->stop = 1;
+    pthread_cond_broadcast(&server->cond);
+    pthread_mutex_unlock(&server->mutex);
+
+    for (size_t i = 0; i < server->worker_count; ++i)
+        pthread_join(server->workers[i], NULL);
+
+    // Last replies get a single non-blocking attempt
+    flush_done(server);
+    while (server->sending) {
+        server_request_t *queued = reply_finish(server, server->sending);
+        while (queued) {
+            server_request_t *dropped = queued;
+            queued = queued->queued;
+            request_free(dropped);
+        }
+    }
+
+    close(server->epoll_fd);
+    close(server->event_fd);
+    proto_assembler_destroy(&server->assembler);
+    proto_buffer_free(&server->payload);
+    pthread_mutex_destroy(&server->mutex);
+    pthread_cond_destroy(&server->cond);
+    free(server->workers);
+    server->workers = NULL;
+}
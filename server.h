@@ -0,0 +1,102 @@
+#ifndef CRON_SERVER_H
+#define CRON_SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "cron_utils.h"
+#include "protocol.h"
+#include "transport.h"
+
+// Defines
+#define SERVER_DEFAULT_WORKERS (4)
+#define SERVER_DEFAULT_MAX_PENDING (256)
+#define SERVER_MAX_EVENTS (64)
+#define SERVER_REPLY_TIMEOUT (5)
+
+// Enums
+typedef enum {
+    SERVER_WRITE,
+    SERVER_READ
+} server_class_t;
+
+// Structures
+/*
+ * One request from receiving to the last reply message. The handler reads
+ * header and payload and fills reply_type, status and reply; reply.count
+ * becomes the count of the reply header.
+ */
+typedef struct server_request {
+    struct server_request *next;
+    struct server_request *queued;
+    server_class_t class;
+    proto_header_t header;
+    proto_buffer_t payload;
+    uint16_t reply_type;
+    proto_status_t status;
+    proto_buffer_t reply;
+    transport_t *transport;
+    int fd;
+    size_t offset;
+    int waiting;
+    time_t deadline;
+} server_request_t;
+
+typedef void (*server_handler_t)(server_request_t *request, void *arg);
+
+typedef struct {
+    uint64_t accepted;
+    uint64_t rejected;
+    uint64_t expired;
+    uint64_t queued_writes;
+    uint64_t queued_reads;
+} server_stats_t;
+
+/*
+ * Multiplexes all clients over one epoll loop. Every transport (see
+ * transport.h) and the reply descriptors of clients that are slow to read
+ * are non-blocking descriptors in the epoll set, so no client can stall
+ * another one. Complete
+ * requests are handed to a pool of handler threads; writes (BATCH, IMPORT)
+ * are always taken before reads (LIST) and reads may occupy at most all
+ * but one handler. Admission control replaces the old two-client
+ * semaphore: past max_pending queued requests, or half of that for reads,
+ * a request is answered with PROTO_BUSY right away and the client retries.
+ */
+typedef struct {
+    transport_t *transports;
+    size_t transport_count;
+    int epoll_fd;
+    int event_fd;
+    server_handler_t handler;
+    void *arg;
+    proto_assembler_t assembler;
+    proto_buffer_t payload;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    server_request_t *head[2];
+    server_request_t *tail[2];
+    size_t queued[2];
+    size_t running_reads;
+    size_t read_slots;
+    size_t max_pending;
+    server_request_t *done;
+    server_request_t *sending;
+    pthread_t *workers;
+    size_t worker_count;
+    int stop;
+    server_stats_t stats;
+} server_t;
+
+// Server methods
+int server_init(server_t *server, transport_t *transports, size_t transport_count, size_t worker_count,
+                size_t max_pending, server_handler_t handler, void *arg);
+
+void server_run(server_t *server);
+
+void server_stats(server_t *server, server_stats_t *stats);
+
+void server_destroy(server_t *server);
+
+#endif //CRON_SERVER_H
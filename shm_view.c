@@ -0,0 +1,218 @@
+#include "shm_view.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Grows the segment to hold size bytes, existing mappings of readers stay valid
+static int segment_reserve(shm_view_t *shm, size_t size) {
+    if (size <= shm->size)
+        return 0;
+
+    size_t grown = shm->size ? shm->size : SHM_VIEW_MIN_SIZE;
+    while (grown < size)
+        grown *= 2;
+
+    if (ftruncate(shm->fd, (off_t) grown) == -1)
+        return -1;
+
+    char *map = mmap(NULL, grown, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+    if (map == MAP_FAILED)
+        return -1;
+
+    if (shm->map)
+        munmap(shm->map, shm->size);
+    shm->map = map;
+    shm->size = grown;
+    return 0;
+}
+
+static int publish(shm_view_t *shm) {
+    task_view_t *view = task_view_acquire(shm->views);
+    if (!view)
+        return -1;
+
+    if (view->generation == shm->published) {
+        task_view_release(view);
+        return 0;
+    }
+
+    if (segment_reserve(shm, sizeof(shm_view_header_t) + view->entries.length) == -1) {
+        perror("shm view resize failed");
+        task_view_release(view);
+        return -1;
+    }
+
+    shm_view_header_t *header = (shm_view_header_t *) shm->map;
+    uint64_t sequence = atomic_load_explicit(&header->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&header->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    header->generation = view->generation;
+    header->count = view->count;
+    header->length = view->entries.length;
+    header->size = shm->size;
+    if (view->entries.length)
+        memcpy(shm->map + sizeof(shm_view_header_t), view->entries.data, view->entries.length);
+
+    atomic_store_explicit(&header->sequence, sequence + 2, memory_order_release);
+
+    shm->published = view->generation;
+    task_view_release(view);
+    return 0;
+}
+
+static void *shm_view_func(void *arg) {
+    shm_view_t *shm = (shm_view_t *) arg;
+
+    pthread_mutex_lock(&shm->mutex);
+    while (!shm->stop) {
+        if (!shm->dirty) {
+            pthread_cond_wait(&shm->cond, &shm->mutex);
+            continue;
+        }
+        shm->dirty = 0;
+        pthread_mutex_unlock(&shm->mutex);
+
+        publish(shm);
+
+        // Changes arriving in the meantime are published together after the pause
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += SHM_VIEW_INTERVAL_MS * 1000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+
+        pthread_mutex_lock(&shm->mutex);
+        while (!shm->stop && pthread_cond_timedwait(&shm->cond, &shm->mutex, &until) != ETIMEDOUT);
+    }
+    pthread_mutex_unlock(&shm->mutex);
+    return NULL;
+}
+
+int shm_view_init(shm_view_t *shm, task_view_cache_t *views) {
+    if (!shm || !views)
+        return -1;
+
+    shm->map = NULL;
+    shm->size = 0;
+    shm->views = views;
+    shm->published = UINT64_MAX;
+    shm->dirty = 1;
+    shm->stop = 0;
+
+    shm_unlink(VIEW_SHM_NAME);
+    shm->fd = shm_open(VIEW_SHM_NAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (shm->fd == -1 || segment_reserve(shm, SHM_VIEW_MIN_SIZE) == -1) {
+        perror("shm view init failed");
+        if (shm->fd != -1) {
+            close(shm->fd);
+            shm_unlink(VIEW_SHM_NAME);
+        }
+        shm->fd = -1;
+        return -1;
+    }
+
+    shm_view_header_t *header = (shm_view_header_t *) shm->map;
+    header->magic = SHM_VIEW_MAGIC;
+    header->version = SHM_VIEW_VERSION;
+    header->pid = getpid();
+    header->size = shm->size;
+    atomic_init(&header->sequence, 0);
+
+    pthread_mutex_init(&shm->mutex, NULL);
+    pthread_cond_init(&shm->cond, NULL);
+    if (pthread_create(&shm->thread, NULL, shm_view_func, shm) != 0) {
+        printf("Failed to create shm view thread.\n");
+        munmap(shm->map, shm->size);
+        close(shm->fd);
+        shm_unlink(VIEW_SHM_NAME);
+        shm->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void shm_view_notify(shm_view_t *shm) {
+    if (shm->fd == -1)
+        return;
+
+    pthread_mutex_lock(&shm->mutex);
+    shm->dirty = 1;
+    pthread_cond_signal(&shm->cond);
+    pthread_mutex_unlock(&shm->mutex);
+}
+
+void shm_view_destroy(shm_view_t *shm) {
+    if (shm->fd == -1)
+        return;
+
+    pthread_mutex_lock(&shm->mutex);
+    shm->stop = 1;
+    pthread_cond_signal(&shm->cond);
+    pthread_mutex_unlock(&shm->mutex);
+    pthread_join(shm->thread, NULL);
+
+    shm_unlink(VIEW_SHM_NAME);
+    munmap(shm->map, shm->size);
+    close(shm->fd);
+    shm->fd = -1;
+    pthread_mutex_destroy(&shm->mutex);
+    pthread_cond_destroy(&shm->cond);
+}
+
+// Copies a consistent task list out of the segment, -1 if there is none or no server keeps it current
+int shm_view_read(proto_buffer_t *entries) {
+    int fd = shm_open(VIEW_SHM_NAME, O_RDONLY, 0);
+    if (fd == -1)
+        return -1;
+
+    int result = -1;
+    for (int attempt = 0; attempt < SHM_VIEW_READ_RETRIES && result == -1; ++attempt) {
+        struct stat st;
+        if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(shm_view_header_t))
+            break;
+
+        size_t size = (size_t) st.st_size;
+        char *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+            break;
+
+        const shm_view_header_t *header = (const shm_view_header_t *) map;
+        if (header->magic != SHM_VIEW_MAGIC || header->version != SHM_VIEW_VERSION ||
+            (kill(header->pid, 0) == -1 && errno == ESRCH)) {
+            munmap(map, size);
+            break;
+        }
+
+        uint64_t sequence = atomic_load_explicit(&header->sequence, memory_order_acquire);
+        uint64_t count = header->count, length = header->length;
+
+        // Odd means a write is in progress, a longer segment has to be mapped again
+        if (!(sequence & 1) && sequence && sizeof(shm_view_header_t) + length <= size) {
+            proto_buffer_reset(entries);
+            if (proto_buffer_append(entries, map + sizeof(shm_view_header_t), length) == -1) {
+                munmap(map, size);
+                break;
+            }
+
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&header->sequence, memory_order_relaxed) == sequence) {
+                entries->count = (uint32_t) count;
+                result = 0;
+            }
+        }
+
+        munmap(map, size);
+        if (result == -1)
+            sched_yield();
+    }
+
+    close(fd);
+    return result;
+}
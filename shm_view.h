@@ -0,0 +1,65 @@
+#ifndef CRON_SHM_VIEW_H
+#define CRON_SHM_VIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "task_view.h"
+
+// Defines
+#define SHM_VIEW_MAGIC (0x57564A43u)
+#define SHM_VIEW_VERSION (1)
+#define SHM_VIEW_MIN_SIZE (64 * 1024)
+#define SHM_VIEW_INTERVAL_MS (100)
+#define SHM_VIEW_READ_RETRIES (64)
+
+// Structures
+/*
+ * Start of the shared segment, followed by length bytes of LIST entries.
+ * sequence is a seqlock: odd while the server rewrites the segment. The
+ * segment only grows; size is its current size, so a reader whose mapping
+ * is shorter maps it again.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    pid_t pid;
+    atomic_uint_fast64_t sequence;
+    uint64_t generation;
+    uint64_t count;
+    uint64_t length;
+    uint64_t size;
+} shm_view_header_t;
+
+/*
+ * Publishes the task list into POSIX shared memory so that -l reads it
+ * without sending a single message. A publisher thread copies the current
+ * task view whenever the table changed, at most once per
+ * SHM_VIEW_INTERVAL_MS so bursts of changes are published together.
+ * Writes never wait for readers; a reader that raced with one retries.
+ */
+typedef struct {
+    int fd;
+    char *map;
+    size_t size;
+    task_view_cache_t *views;
+    uint64_t published;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int dirty;
+    int stop;
+} shm_view_t;
+
+// Shared view methods
+int shm_view_init(shm_view_t *shm, task_view_cache_t *views);
+
+void shm_view_notify(shm_view_t *shm);
+
+void shm_view_destroy(shm_view_t *shm);
+
+int shm_view_read(proto_buffer_t *entries);
+
+#endif //CRON_SHM_VIEW_H
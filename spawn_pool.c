@@ -0,0 +1,228 @@
+#include "spawn_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+
+static uint64_t elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (uint64_t) (end->tv_sec - start->tv_sec) * 1000000000ULL + end->tv_nsec - start->tv_nsec;
+}
+
+static void atomic_max(atomic_uint_fast64_t *target, uint64_t value) {
+    uint64_t current = atomic_load_explicit(target, memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(target, &current, value, memory_order_relaxed, memory_order_relaxed));
+}
+
+static int queue_push(spawn_pool_t *pool, const spawn_job_t *job) {
+    size_t pos = atomic_load_explicit(&pool->enqueue_pos, memory_order_relaxed);
+    spawn_cell_t *cell;
+
+    while (1) {
+        cell = &pool->cells[pos & pool->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&pool->enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&pool->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    cell->job = *job;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return 0;
+}
+
+static int queue_pop(spawn_pool_t *pool, spawn_job_t *job) {
+    size_t pos = atomic_load_explicit(&pool->dequeue_pos, memory_order_relaxed);
+    spawn_cell_t *cell;
+
+    while (1) {
+        cell = &pool->cells[pos & pool->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t) sequence - (intptr_t) (pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&pool->dequeue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&pool->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    *job = cell->job;
+    atomic_store_explicit(&cell->sequence, pos + pool->mask + 1, memory_order_release);
+    return 0;
+}
+
+static void *spawn_worker_func(void *arg) {
+    spawn_pool_t *pool = (spawn_pool_t *) arg;
+    spawn_job_t job;
+
+    while (1) {
+        if (sem_wait(&pool->items) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (atomic_load(&pool->stop))
+            break;
+
+        // Every token stands for a pushed job, a pop can only fail while the producer that
+        // claimed the next cell is still filling it in, so the token is kept and the pop retried
+        int popped;
+        while ((popped = queue_pop(pool, &job)) == -1 && !atomic_load(&pool->stop))
+            sched_yield();
+        if (popped == -1)
+            break;
+
+        struct timespec now, real, spawned;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        clock_gettime(CLOCK_REALTIME, &real);
+        uint64_t wait_ns = elapsed_ns(&job.enqueued, &now);
+        atomic_fetch_add_explicit(&pool->total_wait_ns, wait_ns, memory_order_relaxed);
+        atomic_max(&pool->max_wait_ns, wait_ns);
+
+        // Deadlines are wall-clock seconds, the lag covers the dispatcher and the queue
+        struct timespec planned = {.tv_sec = job.planned, .tv_nsec = 0};
+        uint64_t lag_ns = real.tv_sec >= job.planned ? elapsed_ns(&planned, &real) : 0;
+        metrics_record(pool->metrics, METRIC_FIRE_LAG, lag_ns);
+        metrics_record(pool->metrics, METRIC_QUEUE_WAIT, wait_ns);
+
+        pid_t pid;
+        int spawn_result = spawner_spawn(pool->spawner, job.exec_file_path, &pid);
+        clock_gettime(CLOCK_MONOTONIC, &spawned);
+        metrics_record(pool->metrics, METRIC_SPAWN, elapsed_ns(&now, &spawned));
+
+        if (spawn_result == -1) {
+            perror("spawn failed");
+            atomic_fetch_add_explicit(&pool->failed, 1, memory_order_relaxed);
+        } else {
+            atomic_fetch_add_explicit(&pool->spawned, 1, memory_order_relaxed);
+            if (reaper_watch(pool->reaper, pid, job.task_id, &now, lag_ns / 1000) == -1)
+                printf("Failed to watch child %d.\n", pid);
+        }
+    }
+
+    return NULL;
+}
+
+int spawn_pool_init(spawn_pool_t *pool, spawner_t *spawner, reaper_t *reaper, metrics_t *metrics, size_t worker_count,
+                    size_t queue_depth) {
+    if (!pool || !spawner || !reaper || worker_count < 1 || queue_depth < 1)
+        return -1;
+
+    size_t capacity = 1;
+    while (capacity < queue_depth)
+        capacity <<= 1;
+
+    pool->cells = calloc(capacity, sizeof(spawn_cell_t));
+    pool->workers = calloc(worker_count, sizeof(pthread_t));
+    if (!pool->cells || !pool->workers) {
+        perror("calloc failed");
+        free(pool->cells);
+        free(pool->workers);
+        return -1;
+    }
+
+    for (size_t i = 0; i < capacity; ++i)
+        atomic_init(&pool->cells[i].sequence, i);
+
+    pool->mask = capacity - 1;
+    pool->spawner = spawner;
+    pool->reaper = reaper;
+    pool->metrics = metrics;
+    atomic_init(&pool->enqueue_pos, 0);
+    atomic_init(&pool->dequeue_pos, 0);
+    atomic_init(&pool->stop, 0);
+    atomic_init(&pool->submitted, 0);
+    atomic_init(&pool->rejected, 0);
+    atomic_init(&pool->spawned, 0);
+    atomic_init(&pool->failed, 0);
+    atomic_init(&pool->max_depth, 0);
+    atomic_init(&pool->total_wait_ns, 0);
+    atomic_init(&pool->max_wait_ns, 0);
+
+    if (sem_init(&pool->items, 0, 0) == -1) {
+        free(pool->cells);
+        free(pool->workers);
+        return -1;
+    }
+
+    for (pool->worker_count = 0; pool->worker_count < worker_count; ++pool->worker_count) {
+        if (pthread_create(&pool->workers[pool->worker_count], NULL, spawn_worker_func, pool) != 0) {
+            printf("Failed to create spawn worker.\n");
+            spawn_pool_destroy(pool);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int spawn_pool_submit(spawn_pool_t *pool, uint64_t task_id, const char *exec_file_path, time_t planned) {
+    spawn_job_t job;
+
+    job.task_id = task_id;
+    strncpy(job.exec_file_path, exec_file_path, SPAWN_PATH_LEN - 1);
+    job.exec_file_path[SPAWN_PATH_LEN - 1] = '\0';
+    job.planned = planned;
+    clock_gettime(CLOCK_MONOTONIC, &job.enqueued);
+
+    if (queue_push(pool, &job) == -1) {
+        atomic_fetch_add_explicit(&pool->rejected, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    uint64_t depth = atomic_load_explicit(&pool->enqueue_pos, memory_order_relaxed) -
+                     atomic_load_explicit(&pool->dequeue_pos, memory_order_relaxed);
+    atomic_max(&pool->max_depth, depth);
+    atomic_fetch_add_explicit(&pool->submitted, 1, memory_order_relaxed);
+
+    sem_post(&pool->items);
+    return 0;
+}
+
+void spawn_pool_stats(spawn_pool_t *pool, spawn_pool_stats_t *stats) {
+    size_t enqueued = atomic_load(&pool->enqueue_pos);
+    size_t dequeued = atomic_load(&pool->dequeue_pos);
+
+    stats->submitted = atomic_load(&pool->submitted);
+    stats->rejected = atomic_load(&pool->rejected);
+    stats->spawned = atomic_load(&pool->spawned);
+    stats->failed = atomic_load(&pool->failed);
+    stats->depth = enqueued > dequeued ? enqueued - dequeued : 0;
+    stats->max_depth = atomic_load(&pool->max_depth);
+    stats->total_wait_ns = atomic_load(&pool->total_wait_ns);
+    stats->max_wait_ns = atomic_load(&pool->max_wait_ns);
+}
+
+void spawn_pool_destroy(spawn_pool_t *pool) {
+    if (!pool || !pool->cells)
+        return;
+
+    // Jobs still queued are cancelled together with the rest of the schedule
+    atomic_store(&pool->stop, 1);
+    for (size_t i = 0; i < pool->worker_count; ++i)
+        sem_post(&pool->items);
+    for (size_t i = 0; i < pool->worker_count; ++i)
+        pthread_join(pool->workers[i], NULL);
+
+    sem_destroy(&pool->items);
+    free(pool->workers);
+    free(pool->cells);
+    pool->workers = NULL;
+    pool->cells = NULL;
+    pool->worker_count = 0;
+}
@@ -0,0 +1,80 @@
+#ifndef CRON_SPAWN_POOL_H
+#define CRON_SPAWN_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "spawner.h"
+#include "reaper.h"
+#include "metrics.h"
+
+// Defines
+#define SPAWN_PATH_LEN (255)
+#define SPAWN_DEFAULT_WORKERS (4)
+#define SPAWN_DEFAULT_QUEUE_DEPTH (1024)
+
+// Structures
+typedef struct {
+    uint64_t task_id;
+    char exec_file_path[SPAWN_PATH_LEN];
+    time_t planned;
+    struct timespec enqueued;
+} spawn_job_t;
+
+typedef struct {
+    atomic_size_t sequence;
+    spawn_job_t job;
+} spawn_cell_t;
+
+typedef struct {
+    uint64_t submitted;
+    uint64_t rejected;
+    uint64_t spawned;
+    uint64_t failed;
+    uint64_t depth;
+    uint64_t max_depth;
+    uint64_t total_wait_ns;
+    uint64_t max_wait_ns;
+} spawn_pool_stats_t;
+
+/*
+ * Fixed set of spawn workers fed by a bounded lock-free MPMC ring
+ * (Vyukov's sequence-numbered cells). Producers never block: a job that
+ * does not fit into a full queue is rejected and counted, and retrying it
+ * is left to the caller.
+ */
+typedef struct {
+    spawn_cell_t *cells;
+    size_t mask;
+    atomic_size_t enqueue_pos;
+    atomic_size_t dequeue_pos;
+    sem_t items;
+    spawner_t *spawner;
+    reaper_t *reaper;
+    metrics_t *metrics;
+    pthread_t *workers;
+    size_t worker_count;
+    atomic_int stop;
+    atomic_uint_fast64_t submitted;
+    atomic_uint_fast64_t rejected;
+    atomic_uint_fast64_t spawned;
+    atomic_uint_fast64_t failed;
+    atomic_uint_fast64_t max_depth;
+    atomic_uint_fast64_t total_wait_ns;
+    atomic_uint_fast64_t max_wait_ns;
+} spawn_pool_t;
+
+// Spawn pool methods
+int spawn_pool_init(spawn_pool_t *pool, spawner_t *spawner, reaper_t *reaper, metrics_t *metrics, size_t worker_count,
+                    size_t queue_depth);
+
+int spawn_pool_submit(spawn_pool_t *pool, uint64_t task_id, const char *exec_file_path, time_t planned);
+
+void spawn_pool_stats(spawn_pool_t *pool, spawn_pool_stats_t *stats);
+
+void spawn_pool_destroy(spawn_pool_t *pool);
+
+#endif //CRON_SPAWN_POOL_H
@@ -0,0 +1,208 @@
+#define _GNU_SOURCE
+#include "spawner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <spawn.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
+#define SPAWNER_ZYGOTE_NAME "zygote"
+
+static void zygote_reap(int exit_sock) {
+    spawner_exit_t report;
+    pid_t pid;
+
+    while ((pid = wait4(-1, &report.status, WNOHANG, &report.usage)) > 0) {
+        report.pid = pid;
+        clock_gettime(CLOCK_MONOTONIC, &report.exited);
+        send(exit_sock, &report, sizeof(report), 0);
+    }
+}
+
+static void zygote_spawn(int sock, const char *exec_file_path, const sigset_t *child_mask) {
+    // vfork shares memory with the child until it execs, so it can report a failed exec here
+    volatile int exec_errno = 0;
+    char *argv[] = {(char *) exec_file_path, NULL};
+    spawner_reply_t reply = {0};
+
+    pid_t pid = vfork();
+    if (pid == 0) {
+        sigprocmask(SIG_SETMASK, child_mask, NULL);
+        execve(exec_file_path, argv, NULL);
+        exec_errno = errno;
+        _exit(127);
+    }
+
+    if (pid == -1) {
+        reply.error = errno;
+    } else if (exec_errno) {
+        // Nobody will watch a child whose exec failed, reap it here instead of reporting its exit
+        reply.error = exec_errno;
+        while (waitpid(pid, NULL, 0) == -1 && errno == EINTR);
+    } else {
+        reply.pid = pid;
+    }
+
+    send(sock, &reply, sizeof(reply), 0);
+}
+
+static void zygote_loop(int sock, int exit_sock) {
+    char exec_file_path[SPAWNER_PATH_LEN];
+    sigset_t set, child_mask;
+
+    // SIGCHLD is consumed through a signalfd, children get the original mask back
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, &child_mask);
+
+    struct pollfd fds[2] = {
+            {.fd = sock, .events = POLLIN},
+            {.fd = signalfd(-1, &set, SFD_CLOEXEC | SFD_NONBLOCK), .events = POLLIN}
+    };
+
+    while (1) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(fds[1].fd, &info, sizeof(info)) == sizeof(info));
+            zygote_reap(exit_sock);
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            ssize_t len = recv(sock, exec_file_path, SPAWNER_PATH_LEN - 1, 0);
+            if (len <= 0)
+                break;
+            exec_file_path[len] = '\0';
+            zygote_spawn(sock, exec_file_path, &child_mask);
+        }
+    }
+
+    _exit(0);
+}
+
+int spawner_init(spawner_t *spawner, spawner_mode_t mode) {
+    if (!spawner)
+        return -1;
+
+    spawner->mode = mode;
+    spawner->sock = -1;
+    spawner->exit_sock = -1;
+    spawner->zygote = -1;
+    pthread_mutex_init(&spawner->mutex, NULL);
+
+    if (mode == SPAWNER_DIRECT)
+        return 0;
+
+    int fds[2], exit_fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1) {
+        perror("socketpair failed");
+        pthread_mutex_destroy(&spawner->mutex);
+        return -1;
+    }
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, exit_fds) == -1) {
+        perror("socketpair failed");
+        close(fds[0]);
+        close(fds[1]);
+        pthread_mutex_destroy(&spawner->mutex);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork failed");
+        close(fds[0]);
+        close(fds[1]);
+        close(exit_fds[0]);
+        close(exit_fds[1]);
+        pthread_mutex_destroy(&spawner->mutex);
+        return -1;
+    }
+
+    if (pid == 0) {
+        // Drop every descriptor inherited from the server except our ends of the sockets
+        int low = fds[1] < exit_fds[1] ? fds[1] : exit_fds[1];
+        int high = fds[1] < exit_fds[1] ? exit_fds[1] : fds[1];
+        close(fds[0]);
+        close(exit_fds[0]);
+        if (low > 3)
+            close_range(3, low - 1, 0);
+        if (high > low + 1)
+            close_range(low + 1, high - 1, 0);
+        close_range(high + 1, ~0U, 0);
+        zygote_loop(fds[1], exit_fds[1]);
+    }
+
+    close(fds[1]);
+    close(exit_fds[1]);
+    spawner->sock = fds[0];
+    spawner->exit_sock = exit_fds[0];
+    spawner->zygote = pid;
+    return 0;
+}
+
+spawner_mode_t spawner_mode_parse(const char *name) {
+    if (name && strcmp(name, SPAWNER_ZYGOTE_NAME) == 0)
+        return SPAWNER_ZYGOTE;
+    return SPAWNER_DIRECT;
+}
+
+int spawner_spawn(spawner_t *spawner, const char *exec_file_path, pid_t *pid) {
+    if (spawner->mode == SPAWNER_DIRECT) {
+        char *argv[] = {(char *) exec_file_path, NULL};
+        int error = posix_spawn(pid, exec_file_path, NULL, NULL, argv, NULL);
+        if (error) {
+            errno = error;
+            return -1;
+        }
+        return 0;
+    }
+
+    size_t len = strnlen(exec_file_path, SPAWNER_PATH_LEN - 1);
+    spawner_reply_t reply;
+
+    pthread_mutex_lock(&spawner->mutex);
+    int result = -1;
+    if (send(spawner->sock, exec_file_path, len, 0) == (ssize_t) len &&
+        recv(spawner->sock, &reply, sizeof(reply), 0) == sizeof(reply))
+        result = 0;
+    pthread_mutex_unlock(&spawner->mutex);
+
+    if (result == -1)
+        return -1;
+
+    if (reply.error) {
+        errno = reply.error;
+        return -1;
+    }
+
+    *pid = reply.pid;
+    return 0;
+}
+
+void spawner_destroy(spawner_t *spawner) {
+    if (!spawner)
+        return;
+
+    if (spawner->mode == SPAWNER_ZYGOTE && spawner->sock != -1) {
+        // Closing our end makes the zygote's recv return 0 and exit
+        close(spawner->sock);
+        waitpid(spawner->zygote, NULL, 0);
+        close(spawner->exit_sock);
+        spawner->sock = -1;
+        spawner->exit_sock = -1;
+        spawner->zygote = -1;
+    }
+
+    pthread_mutex_destroy(&spawner->mutex);
+}
@@ -0,0 +1,56 @@
+#ifndef CRON_SPAWNER_H
+#define CRON_SPAWNER_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <pthread.h>
+
+// Defines
+#define SPAWNER_PATH_LEN (255)
+
+// Enums
+typedef enum {
+    SPAWNER_DIRECT,
+    SPAWNER_ZYGOTE
+} spawner_mode_t;
+
+// Structures
+typedef struct {
+    int error;
+    pid_t pid;
+} spawner_reply_t;
+
+// Sent by the zygote on the exit socket for every child it reaps
+typedef struct {
+    pid_t pid;
+    int status;
+    struct rusage usage;
+    struct timespec exited;
+} spawner_exit_t;
+
+/*
+ * Launches jobs either with posix_spawn from the calling process or through
+ * a zygote: a small single-threaded helper forked before any other thread
+ * exists, which receives paths over a SOCK_SEQPACKET socketpair and does
+ * the vfork/exec, so launch cost does not grow with the server's size.
+ * The zygote reaps its own children and reports them on exit_sock.
+ */
+typedef struct {
+    spawner_mode_t mode;
+    int sock;
+    int exit_sock;
+    pid_t zygote;
+    pthread_mutex_t mutex;
+} spawner_t;
+
+// Spawner methods
+int spawner_init(spawner_t *spawner, spawner_mode_t mode);
+
+spawner_mode_t spawner_mode_parse(const char *name);
+
+int spawner_spawn(spawner_t *spawner, const char *exec_file_path, pid_t *pid);
+
+void spawner_destroy(spawner_t *spawner);
+
+#endif //CRON_SPAWNER_H
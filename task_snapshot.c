@@ -0,0 +1,173 @@
+#include "task_snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#define SNAPSHOT_JSONL_NAME "jsonl"
+#define SNAPSHOT_LOCK_CHUNK (1024)
+
+static int state_compare(const void *a, const void *b) {
+    uint64_t left = ((const snapshot_state_t *) a)->id, right = ((const snapshot_state_t *) b)->id;
+    return left < right ? -1 : left > right;
+}
+
+/*
+ * Called with the table lock held. The dispatcher re-arms tasks under the
+ * scheduler lock only, so deadline, slot and active are read under it too,
+ * but in chunks of SNAPSHOT_LOCK_CHUNK tasks, so timer delivery is not
+ * stalled for a copy of the whole table.
+ */
+static void snapshot_capture(task_table_t *table, void *arg) {
+    task_snapshot_t *snapshot = (task_snapshot_t *) arg;
+
+    snapshot->generation = table->generation;
+    snapshot->states = malloc((table->count ? table->count : 1) * sizeof(snapshot_state_t));
+    if (!snapshot->states)
+        return;
+
+    pthread_mutex_t *lock = table->scheduler ? &table->scheduler->mutex : NULL;
+    if (lock)
+        pthread_mutex_lock(lock);
+
+    size_t cursor = 0, n = 0;
+    task_t *task;
+    while ((task = task_table_next(table, &cursor))) {
+        snapshot_state_t *state = &snapshot->states[n++];
+        state->id = task->id;
+        state->next_run = task->sched.slot != SCHED_NO_SLOT ? task->sched.deadline : 0;
+        state->active = task->active;
+        state->stats = task->stats;
+
+        // Lets the dispatcher in between chunks, the table lock keeps the tasks themselves in place
+        if (lock && n % SNAPSHOT_LOCK_CHUNK == 0) {
+            pthread_mutex_unlock(lock);
+            pthread_mutex_lock(lock);
+        }
+    }
+
+    if (lock)
+        pthread_mutex_unlock(lock);
+    snapshot->count = n;
+}
+
+int task_snapshot_take(task_snapshot_t *snapshot, task_view_cache_t *cache) {
+    memset(snapshot, 0, sizeof(task_snapshot_t));
+
+    snapshot->view = task_view_acquire_with(cache, snapshot_capture, snapshot);
+    if (!snapshot->view || !snapshot->states) {
+        task_snapshot_release(snapshot);
+        return -1;
+    }
+    snapshot->taken = time(NULL);
+
+    // Same order as the view, so the state of entry i is states[i]
+    for (size_t i = 1; i < snapshot->count; ++i) {
+        if (snapshot->states[i - 1].id > snapshot->states[i].id) {
+            qsort(snapshot->states, snapshot->count, sizeof(snapshot_state_t), state_compare);
+            break;
+        }
+    }
+    return 0;
+}
+
+static int exit_code(int status) {
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static void json_string(FILE *f, const char *text, size_t length) {
+    fputc('"', f);
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = (unsigned char) text[i];
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void write_text(const proto_list_entry_t *entry, const char *text, const snapshot_state_t *state, FILE *f) {
+    fprintf(f, "%lu | %.*s | %.*s | %s\n", entry->id, entry->spec_length, text,
+            entry->length - entry->spec_length - 1, text + entry->spec_length + 1,
+            timer_type_name(entry->timer_type));
+
+    if (state && state->stats.runs) {
+        const task_stats_t *stats = &state->stats;
+        fprintf(f, "     runs %lu | failures %lu | last status %d | wall %lu us | cpu %lu us | max rss %ld kB\n",
+                stats->runs, stats->failures, exit_code(stats->last_status), stats->last_wall_us,
+                stats->last_cpu_us, stats->max_rss_kb);
+    }
+}
+
+// One object per task, times are seconds since the epoch and null when there is none
+static void write_jsonl(const proto_list_entry_t *entry, const char *text, const snapshot_state_t *state, FILE *f) {
+    fprintf(f, "{\"id\":%lu,\"timer_type\":\"%s\",\"spec\":", entry->id, timer_type_name(entry->timer_type));
+    json_string(f, text, entry->spec_length);
+    fprintf(f, ",\"path\":");
+    json_string(f, text + entry->spec_length + 1, entry->length - entry->spec_length - 1);
+
+    if (!state) {
+        fprintf(f, "}\n");
+        return;
+    }
+
+    const task_stats_t *stats = &state->stats;
+    fprintf(f, ",\"active\":%s,\"next_run\":", state->active ? "true" : "false");
+    if (state->next_run)
+        fprintf(f, "%ld", (long) state->next_run);
+    else
+        fprintf(f, "null");
+    fprintf(f, ",\"runs\":%lu,\"failures\":%lu,\"last_status\":", stats->runs, stats->failures);
+    if (stats->runs)
+        fprintf(f, "%d", exit_code(stats->last_status));
+    else
+        fprintf(f, "null");
+    fprintf(f, ",\"last_wall_us\":%lu,\"last_cpu_us\":%lu,\"max_rss_kb\":%ld", stats->last_wall_us,
+            stats->last_cpu_us, stats->max_rss_kb);
+    fprintf(f, ",\"total_lag_us\":%lu,\"max_lag_us\":%lu,\"total_wall_us\":%lu,\"max_wall_us\":%lu}\n",
+            stats->total_lag_us, stats->max_lag_us, stats->total_wall_us, stats->max_wall_us);
+}
+
+int task_snapshot_write(const task_snapshot_t *snapshot, snapshot_format_t format, FILE *f) {
+    const task_view_t *view = snapshot->view;
+
+    if (format == SNAPSHOT_JSONL) {
+        fprintf(f, "{\"generation\":%lu,\"taken\":%ld,\"tasks\":%lu}\n", snapshot->generation,
+                (long) snapshot->taken, view->count);
+    } else if (view->count < 1) {
+        fprintf(f, "No tasks.\n");
+        return ferror(f) ? -1 : 0;
+    } else {
+        fprintf(f, "ID | min h d m wd | file name | timer type\n");
+        fprintf(f, "───────────────────────────────────────────\n");
+    }
+
+    const proto_list_entry_t *entry;
+    const char *text;
+    size_t offset = 0;
+    for (size_t i = 0; (entry = proto_next_list_entry(&view->entries, &offset, &text)); ++i) {
+        const snapshot_state_t *state = i < snapshot->count && snapshot->states[i].id == entry->id
+                                        ? &snapshot->states[i] : NULL;
+        if (format == SNAPSHOT_JSONL)
+            write_jsonl(entry, text, state, f);
+        else
+            write_text(entry, text, state, f);
+    }
+    return ferror(f) ? -1 : 0;
+}
+
+void task_snapshot_release(task_snapshot_t *snapshot) {
+    task_view_release(snapshot->view);
+    free(snapshot->states);
+    snapshot->view = NULL;
+    snapshot->states = NULL;
+    snapshot->count = 0;
+}
+
+snapshot_format_t snapshot_format_parse(const char *name) {
+    if (name && strcmp(name, SNAPSHOT_JSONL_NAME) == 0)
+        return SNAPSHOT_JSONL;
+    return SNAPSHOT_TEXT;
+}
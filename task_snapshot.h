@@ -0,0 +1,48 @@
+#ifndef CRON_TASK_SNAPSHOT_H
+#define CRON_TASK_SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "task_view.h"
+
+// Enums
+typedef enum {
+    SNAPSHOT_TEXT,
+    SNAPSHOT_JSONL
+} snapshot_format_t;
+
+// Structures
+// What changes without a new table generation: the schedule and the run stats
+typedef struct {
+    uint64_t id;
+    time_t next_run;
+    int8_t active;
+    task_stats_t stats;
+} snapshot_state_t;
+
+/*
+ * State of the task table at one generation, taken for a dump. The ids,
+ * time specs and paths are the shared view of that generation, so when
+ * the table has not changed since the last LIST or dump nothing but the
+ * per-task state is copied while the table lock is held. Writing the
+ * snapshot out needs no lock at all.
+ */
+typedef struct {
+    task_view_t *view;
+    uint64_t generation;
+    time_t taken;
+    size_t count;
+    snapshot_state_t *states;
+} task_snapshot_t;
+
+// Task snapshot methods
+int task_snapshot_take(task_snapshot_t *snapshot, task_view_cache_t *cache);
+
+int task_snapshot_write(const task_snapshot_t *snapshot, snapshot_format_t format, FILE *f);
+
+void task_snapshot_release(task_snapshot_t *snapshot);
+
+snapshot_format_t snapshot_format_parse(const char *name);
+
+#endif //CRON_TASK_SNAPSHOT_H
@@ -0,0 +1,373 @@
+#include "task_table.h"
+
+#define SLOT_TASK(table, slot) (&(table)->slabs[(slot) / TASK_SLAB_SIZE][(slot) % TASK_SLAB_SIZE])
+
+static size_t id_hash(uint64_t id, size_t capacity) {
+    return (size_t) ((id * 0x9E3779B97F4A7C15ull) >> 32) & (capacity - 1);
+}
+
+static size_t cron_hash(const cron_expr_t *cron) {
+    uint64_t key = cron->minutes ^ ((uint64_t) cron->hours << 7) ^ ((uint64_t) cron->days << 13) ^
+                   ((uint64_t) cron->months << 29) ^ ((uint64_t) cron->weekdays << 41);
+    return (size_t) ((key * 0x9E3779B97F4A7C15ull) >> 58) & (TASK_CRON_CACHE_SIZE - 1);
+}
+
+// Index entries hold slot + 1, zero marks an empty bucket
+static size_t index_find(task_table_t *table, uint64_t id) {
+    size_t idx = id_hash(id, table->index_capacity);
+
+    while (table->index[idx]) {
+        if (SLOT_TASK(table, table->index[idx] - 1)->id == id)
+            return idx;
+        idx = (idx + 1) & (table->index_capacity - 1);
+    }
+    return SIZE_MAX;
+}
+
+static void index_place(task_table_t *table, uint32_t *index, size_t capacity, uint32_t slot) {
+    size_t idx = id_hash(SLOT_TASK(table, slot)->id, capacity);
+    while (index[idx])
+        idx = (idx + 1) & (capacity - 1);
+    index[idx] = slot + 1;
+}
+
+static int index_insert(task_table_t *table, uint32_t slot) {
+    if ((table->count + 1) * 2 > table->index_capacity && task_table_reserve(table, table->count + 1) == -1)
+        return -1;
+
+    index_place(table, table->index, table->index_capacity, slot);
+    return 0;
+}
+
+// Linear probing removal with backward shift, so lookups never need tombstones
+static void index_remove(task_table_t *table, size_t idx) {
+    size_t mask = table->index_capacity - 1;
+
+    table->index[idx] = 0;
+
+    size_t next = (idx + 1) & mask;
+    while (table->index[next]) {
+        size_t home = id_hash(SLOT_TASK(table, table->index[next] - 1)->id, table->index_capacity);
+        if (((next - home) & mask) >= ((next - idx) & mask)) {
+            table->index[idx] = table->index[next];
+            table->index[next] = 0;
+            idx = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+static int slot_alloc(task_table_t *table, uint32_t *slot) {
+    if (table->free_count) {
+        *slot = table->free_slots[--table->free_count];
+        return 0;
+    }
+
+    if (table->used_slots == table->slab_count * TASK_SLAB_SIZE) {
+        size_t slab_count = table->slab_count + 1;
+        task_t **slabs = realloc(table->slabs, slab_count * sizeof(task_t *));
+        if (!slabs)
+            return -1;
+        table->slabs = slabs;
+
+        uint32_t *free_slots = realloc(table->free_slots, slab_count * TASK_SLAB_SIZE * sizeof(uint32_t));
+        if (!free_slots)
+            return -1;
+        table->free_slots = free_slots;
+
+        slabs[table->slab_count] = calloc(TASK_SLAB_SIZE, sizeof(task_t));
+        if (!slabs[table->slab_count])
+            return -1;
+        table->slab_count = slab_count;
+    }
+
+    *slot = (uint32_t) table->used_slots++;
+    return 0;
+}
+
+static int task_schedule(task_table_t *table, task_t *task) {
+    task->active = 1;
+    time_spec_compile(&task->time_spec, &task->cron);
+    scheduler_entry_init(&task->sched);
+
+    time_t deadline = task_next_deadline(task, scheduler_now(table->scheduler));
+    if (!deadline || scheduler_add(table->scheduler, &task->sched, deadline) == -1) {
+        task->active = 0;
+        return -1;
+    }
+    task->anchor = deadline;
+    return 0;
+}
+
+int task_table_init(task_table_t *table, scheduler_t *scheduler) {
+    if (!table)
+        return -1;
+
+    table->slabs = NULL;
+    table->slab_count = 0;
+    table->used_slots = 0;
+    table->free_slots = NULL;
+    table->free_count = 0;
+    table->count = 0;
+    table->next_id = 1;
+    table->generation = 0;
+    table->scheduler = scheduler;
+    table->index_capacity = TASK_INDEX_INITIAL_CAPACITY;
+    table->index = calloc(table->index_capacity, sizeof(uint32_t));
+    if (!table->index)
+        return -1;
+    return 0;
+}
+
+uint64_t task_table_add(task_table_t *table, task_t task) {
+    uint32_t slot;
+
+    if (!table || slot_alloc(table, &slot) == -1)
+        return 0;
+
+    task_t *entry = SLOT_TASK(table, slot);
+    *entry = task;
+    entry->id = table->next_id++;
+    memset(&entry->stats, 0, sizeof(task_stats_t));
+
+    if (index_insert(table, slot) == -1 || task_schedule(table, entry) == -1) {
+        size_t idx = index_find(table, entry->id);
+        if (idx != SIZE_MAX)
+            index_remove(table, idx);
+        entry->id = 0;
+        table->free_slots[table->free_count++] = slot;
+        printf("Failed to schedule task.\n");
+        return 0;
+    }
+
+    table->count++;
+    table->generation++;
+    return entry->id;
+}
+
+// Adds all tasks or none of them, the added records are returned through added
+int task_table_add_batch(task_table_t *table, const task_t *tasks, size_t count, task_t **added) {
+    if (!table || (!tasks && count) || (!added && count))
+        return -1;
+
+    task_table_reserve(table, table->count + count);
+
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t id = task_table_add(table, tasks[i]);
+        if (!id) {
+            while (i-- > 0)
+                task_table_remove(table, added[i]->id);
+            return -1;
+        }
+        added[i] = task_table_find(table, id);
+    }
+    return 0;
+}
+
+task_t *task_table_find(task_table_t *table, uint64_t id) {
+    if (!table || id == TASK_ID_ALL)
+        return NULL;
+
+    size_t idx = index_find(table, id);
+    if (idx == SIZE_MAX)
+        return NULL;
+    return SLOT_TASK(table, table->index[idx] - 1);
+}
+
+int task_table_edit(task_table_t *table, uint64_t id, task_t task) {
+    task_t *entry = task_table_find(table, id);
+    if (!entry)
+        return -1;
+
+    // Unlinking first guarantees the dispatcher is not reading the task while it is overwritten
+    scheduler_remove(table->scheduler, &entry->sched);
+
+    task.id = entry->id;
+    task.stats = entry->stats;
+    *entry = task;
+    table->generation++;
+
+    if (task_schedule(table, entry) == -1) {
+        printf("Failed to schedule task.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Grows the index ahead of a bulk restore so it is not rehashed on the way
+int task_table_reserve(task_table_t *table, size_t count) {
+    if (!table)
+        return -1;
+
+    size_t capacity = table->index_capacity;
+    while (capacity < count * 2)
+        capacity *= 2;
+    if (capacity == table->index_capacity)
+        return 0;
+
+    uint32_t *index = calloc(capacity, sizeof(uint32_t));
+    if (!index)
+        return -1;
+
+    for (size_t i = 0; i < table->index_capacity; ++i)
+        if (table->index[i])
+            index_place(table, index, capacity, table->index[i] - 1);
+
+    free(table->index);
+    table->index = index;
+    table->index_capacity = capacity;
+    return 0;
+}
+
+// Inserts or replaces a task under its own id without scheduling it, used while recovering state
+int task_table_restore(task_table_t *table, const task_t *task) {
+    if (!table || !task || task->id == TASK_ID_ALL)
+        return -1;
+
+    task_t *entry = task_table_find(table, task->id);
+    if (entry) {
+        scheduler_remove(table->scheduler, &entry->sched);
+        *entry = *task;
+    } else {
+        uint32_t slot;
+        if (slot_alloc(table, &slot) == -1)
+            return -1;
+
+        entry = SLOT_TASK(table, slot);
+        *entry = *task;
+        if (index_insert(table, slot) == -1) {
+            entry->id = 0;
+            table->free_slots[table->free_count++] = slot;
+            return -1;
+        }
+        table->count++;
+    }
+
+    scheduler_entry_init(&entry->sched);
+    time_spec_compile(&entry->time_spec, &entry->cron);
+    entry->active = 0;
+    table->generation++;
+    if (task->id >= table->next_id)
+        table->next_id = task->id + 1;
+    return 0;
+}
+
+// Arms every restored task in one batch, keeping interval tasks in phase with their anchor
+int task_table_schedule_all(task_table_t *table, time_t now) {
+    if (!table)
+        return -1;
+
+    sched_entry_t **entries = malloc((table->count ? table->count : 1) * sizeof(sched_entry_t *));
+    if (!entries)
+        return -1;
+
+    // Restored tables tend to repeat the same few expressions and cron_next is the expensive
+    // part of a restore, so results are memoized per expression for this value of now
+    struct {
+        cron_expr_t cron;
+        time_t next;
+    } cache[TASK_CRON_CACHE_SIZE];
+    memset(cache, 0, sizeof(cache));
+
+    size_t count = 0, cursor = 0;
+    task_t *task;
+    while ((task = task_table_next(table, &cursor))) {
+        if (task->sched.slot != SCHED_NO_SLOT)
+            continue;
+
+        time_t deadline;
+        if (task->timer_type == I_ABSOLUTE) {
+            size_t idx = cron_hash(&task->cron);
+            if (!cache[idx].next || memcmp(&cache[idx].cron, &task->cron, sizeof(cron_expr_t)) != 0) {
+                cache[idx].cron = task->cron;
+                cache[idx].next = task_resume_deadline(task, now);
+            }
+            deadline = cache[idx].next;
+        } else {
+            deadline = task_resume_deadline(task, now);
+        }
+        if (!deadline)
+            continue;
+
+        task->active = 1;
+        task->sched.deadline = deadline;
+        entries[count++] = &task->sched;
+    }
+
+    int result = scheduler_add_batch(table->scheduler, entries, count);
+    free(entries);
+    return result;
+}
+
+int task_table_remove(task_table_t *table, uint64_t id) {
+    if (!table || id == TASK_ID_ALL)
+        return -1;
+
+    size_t idx = index_find(table, id);
+    if (idx == SIZE_MAX)
+        return -1;
+
+    uint32_t slot = table->index[idx] - 1;
+    task_t *entry = SLOT_TASK(table, slot);
+
+    scheduler_remove(table->scheduler, &entry->sched);
+    index_remove(table, idx);
+    entry->id = 0;
+    table->free_slots[table->free_count++] = slot;
+    table->count--;
+    table->generation++;
+    return 0;
+}
+
+void task_table_clear(task_table_t *table) {
+    if (!table)
+        return;
+
+    for (size_t slot = 0; slot < table->used_slots; ++slot) {
+        task_t *entry = SLOT_TASK(table, slot);
+        if (entry->id)
+            scheduler_remove(table->scheduler, &entry->sched);
+        entry->id = 0;
+    }
+
+    memset(table->index, 0, table->index_capacity * sizeof(uint32_t));
+    table->used_slots = 0;
+    table->free_count = 0;
+    table->count = 0;
+    table->generation++;
+}
+
+size_t task_table_size(task_table_t *table) {
+    return table ? table->count : 0;
+}
+
+// Returns the first live task at or after *cursor and moves the cursor past it
+task_t *task_table_next(task_table_t *table, size_t *cursor) {
+    if (!table)
+        return NULL;
+
+    while (*cursor < table->used_slots) {
+        task_t *entry = SLOT_TASK(table, *cursor);
+        (*cursor)++;
+        if (entry->id)
+            return entry;
+    }
+    return NULL;
+}
+
+void task_table_destroy(task_table_t *table) {
+    if (!table)
+        return;
+
+    task_table_clear(table);
+
+    for (size_t i = 0; i < table->slab_count; ++i)
+        free(table->slabs[i]);
+    free(table->slabs);
+    free(table->free_slots);
+    free(table->index);
+    table->slabs = NULL;
+    table->free_slots = NULL;
+    table->index = NULL;
+    table->slab_count = 0;
+}
@@ -0,0 +1,62 @@
+#ifndef CRON_TASK_TABLE_H
+#define CRON_TASK_TABLE_H
+
+#include "cron_utils.h"
+
+// Defines
+#define TASK_SLAB_SIZE (256)
+#define TASK_INDEX_INITIAL_CAPACITY (64)
+#define TASK_ID_ALL (0)
+#define TASK_CRON_CACHE_SIZE (64)
+
+/*
+ * Task store. Tasks live in fixed-size slabs that are never moved, so the
+ * scheduler can keep pointers to their entries, and freed slots are reused
+ * through a free stack. Every task gets a 64-bit id that never changes and
+ * is never reused; ids are resolved to slots through an open-addressing
+ * index, so edit and delete do not depend on the position of the task.
+ * generation changes with every add, edit and delete, so copies of the
+ * table can tell whether they are still current.
+ */
+typedef struct {
+    task_t **slabs;
+    size_t slab_count;
+    size_t used_slots;
+    uint32_t *free_slots;
+    size_t free_count;
+    uint32_t *index;
+    size_t index_capacity;
+    size_t count;
+    uint64_t next_id;
+    uint64_t generation;
+    scheduler_t *scheduler;
+} task_table_t;
+
+// Task table methods
+int task_table_init(task_table_t *table, scheduler_t *scheduler);
+
+uint64_t task_table_add(task_table_t *table, task_t task);
+
+int task_table_add_batch(task_table_t *table, const task_t *tasks, size_t count, task_t **added);
+
+task_t *task_table_find(task_table_t *table, uint64_t id);
+
+int task_table_edit(task_table_t *table, uint64_t id, task_t task);
+
+int task_table_reserve(task_table_t *table, size_t count);
+
+int task_table_restore(task_table_t *table, const task_t *task);
+
+int task_table_schedule_all(task_table_t *table, time_t now);
+
+int task_table_remove(task_table_t *table, uint64_t id);
+
+void task_table_clear(task_table_t *table);
+
+size_t task_table_size(task_table_t *table);
+
+task_t *task_table_next(task_table_t *table, size_t *cursor);
+
+void task_table_destroy(task_table_t *table);
+
+#endif //CRON_TASK_TABLE_H
@@ -0,0 +1,173 @@
+#include "task_view.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What is copied out of the table while its lock is held
+typedef struct {
+    uint64_t id;
+    int timer_type;
+    size_t path;
+    ctime_spec_t time_spec;
+} view_record_t;
+
+static int record_compare(const void *a, const void *b) {
+    uint64_t left = ((const view_record_t *) a)->id, right = ((const view_record_t *) b)->id;
+    return left < right ? -1 : left > right;
+}
+
+static void view_free(task_view_t *view) {
+    free(view->ids);
+    free(view->offsets);
+    proto_buffer_free(&view->entries);
+    free(view);
+}
+
+// Called with the table lock held, paths are packed into one buffer instead of copying whole tasks
+static view_record_t *view_capture(task_table_t *table, size_t *count, proto_buffer_t *paths) {
+    view_record_t *records = malloc((table->count ? table->count : 1) * sizeof(view_record_t));
+    if (!records)
+        return NULL;
+
+    size_t cursor = 0, n = 0;
+    task_t *task;
+    while ((task = task_table_next(table, &cursor))) {
+        view_record_t *record = &records[n++];
+        record->id = task->id;
+        record->timer_type = task->timer_type;
+        record->time_spec = task->time_spec;
+        record->path = paths->length;
+
+        if (proto_buffer_append(paths, task->exec_file_path, strlen(task->exec_file_path) + 1) == -1) {
+            free(records);
+            return NULL;
+        }
+    }
+
+    *count = n;
+    return records;
+}
+
+static task_view_t *view_encode(view_record_t *records, size_t count, const proto_buffer_t *paths,
+                                uint64_t generation) {
+    task_view_t *view = calloc(1, sizeof(task_view_t));
+    if (!view)
+        return NULL;
+
+    atomic_init(&view->refs, 1);
+    view->generation = generation;
+    view->count = count;
+    proto_buffer_init(&view->entries);
+    view->ids = malloc((count ? count : 1) * sizeof(uint64_t));
+    view->offsets = malloc((count + 1) * sizeof(size_t));
+    if (!view->ids || !view->offsets) {
+        view_free(view);
+        return NULL;
+    }
+
+    // Slots are reused, so the table order is only mostly sorted by id
+    for (size_t i = 1; i < count; ++i) {
+        if (records[i - 1].id > records[i].id) {
+            qsort(records, count, sizeof(view_record_t), record_compare);
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        char time_spec_str[TIME_SPEC_STR_LEN];
+        time_spec_format(&records[i].time_spec, time_spec_str, TIME_SPEC_STR_LEN);
+
+        view->ids[i] = records[i].id;
+        view->offsets[i] = view->entries.length;
+        if (proto_add_list_entry(&view->entries, records[i].id, records[i].timer_type, time_spec_str,
+                                 paths->data + records[i].path) == -1) {
+            view_free(view);
+            return NULL;
+        }
+    }
+    view->offsets[count] = view->entries.length;
+    return view;
+}
+
+void task_view_cache_init(task_view_cache_t *cache, task_table_t *table, pthread_mutex_t *table_mutex) {
+    pthread_mutex_init(&cache->mutex, NULL);
+    cache->current = NULL;
+    cache->table = table;
+    cache->table_mutex = table_mutex;
+}
+
+task_view_t *task_view_acquire(task_view_cache_t *cache) {
+    return task_view_acquire_with(cache, NULL, NULL);
+}
+
+task_view_t *task_view_acquire_with(task_view_cache_t *cache, task_view_capture_func_t capture, void *arg) {
+    pthread_mutex_lock(&cache->mutex);
+    pthread_mutex_lock(cache->table_mutex);
+
+    task_view_t *view = cache->current;
+    uint64_t generation = cache->table->generation;
+
+    if (!view || view->generation != generation) {
+        proto_buffer_t paths;
+        size_t count = 0;
+        proto_buffer_init(&paths);
+
+        view_record_t *records = view_capture(cache->table, &count, &paths);
+        if (capture)
+            capture(cache->table, arg);
+        pthread_mutex_unlock(cache->table_mutex);
+
+        view = records ? view_encode(records, count, &paths, generation) : NULL;
+        free(records);
+        proto_buffer_free(&paths);
+
+        if (view) {
+            task_view_release(cache->current);
+            cache->current = view;
+        }
+    } else {
+        if (capture)
+            capture(cache->table, arg);
+        pthread_mutex_unlock(cache->table_mutex);
+    }
+
+    if (view)
+        atomic_fetch_add(&view->refs, 1);
+    pthread_mutex_unlock(&cache->mutex);
+    return view;
+}
+
+// Appends the page header and up to limit entries with ids above cursor
+int task_view_page(const task_view_t *view, uint64_t cursor, size_t limit, proto_buffer_t *page) {
+    size_t low = 0, high = view->count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (view->ids[middle] <= cursor)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    size_t end = view->count - low > limit ? low + limit : view->count;
+    proto_list_page_t header = {.next = end < view->count ? view->ids[end - 1] : 0, .total = view->count};
+
+    if (proto_buffer_append(page, &header, sizeof(header)) == -1 ||
+        proto_buffer_append(page, view->entries.data + view->offsets[low],
+                            view->offsets[end] - view->offsets[low]) == -1)
+        return -1;
+
+    page->count = (uint32_t) (end - low);
+    return 0;
+}
+
+void task_view_release(task_view_t *view) {
+    if (view && atomic_fetch_sub(&view->refs, 1) == 1)
+        view_free(view);
+}
+
+void task_view_cache_destroy(task_view_cache_t *cache) {
+    task_view_release(cache->current);
+    cache->current = NULL;
+    pthread_mutex_destroy(&cache->mutex);
+}
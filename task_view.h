@@ -0,0 +1,59 @@
+#ifndef CRON_TASK_VIEW_H
+#define CRON_TASK_VIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "task_table.h"
+#include "protocol.h"
+
+// Structures
+/*
+ * Immutable copy of the task table in LIST wire format, sorted by id.
+ * offsets has count + 1 entries, entry i spans offsets[i] to offsets[i + 1]
+ * of entries, so a page is a single copy of a contiguous range.
+ */
+typedef struct {
+    atomic_uint refs;
+    uint64_t generation;
+    size_t count;
+    uint64_t *ids;
+    size_t *offsets;
+    proto_buffer_t entries;
+} task_view_t;
+
+/*
+ * Keeps the latest view of a table. A view is built once per table
+ * generation: the table lock is held only while the tasks are copied out,
+ * sorting and formatting happen after it is released. Readers page
+ * through a reference-counted view without touching the table lock, so a
+ * long listing never holds up adds or the scheduler.
+ */
+typedef struct {
+    pthread_mutex_t mutex;
+    task_view_t *current;
+    task_table_t *table;
+    pthread_mutex_t *table_mutex;
+} task_view_cache_t;
+
+/*
+ * Called with the table lock held, at the generation of the view being
+ * acquired, to copy out whatever else has to match that view.
+ */
+typedef void (*task_view_capture_func_t)(task_table_t *table, void *arg);
+
+// Task view methods
+void task_view_cache_init(task_view_cache_t *cache, task_table_t *table, pthread_mutex_t *table_mutex);
+
+task_view_t *task_view_acquire(task_view_cache_t *cache);
+
+task_view_t *task_view_acquire_with(task_view_cache_t *cache, task_view_capture_func_t capture, void *arg);
+
+int task_view_page(const task_view_t *view, uint64_t cursor, size_t limit, proto_buffer_t *page);
+
+void task_view_release(task_view_t *view);
+
+void task_view_cache_destroy(task_view_cache_t *cache);
+
+#endif //CRON_TASK_VIEW_H
@@ -0,0 +1,175 @@
+#include "timing_wheel.h"
+#include "scheduler.h"
+
+#define SECONDS_PER_MINUTE (60)
+#define SECONDS_PER_HOUR (60 * 60)
+#define SECONDS_PER_DAY (60 * 60 * 24)
+
+static sched_entry_t **wheel_head(timing_wheel_t *wheel, size_t slot) {
+    size_t level = slot / WHEEL_SLOTS;
+
+    if (level == WHEEL_OVERFLOW)
+        return &wheel->overflow;
+    if (level == WHEEL_DUE)
+        return &wheel->due;
+    return &wheel->slots[level][slot % WHEEL_SLOTS];
+}
+
+static void wheel_link(timing_wheel_t *wheel, sched_entry_t *entry, size_t slot) {
+    sched_entry_t **head = wheel_head(wheel, slot);
+
+    entry->slot = slot;
+    entry->prev = NULL;
+    entry->next = *head;
+    if (*head)
+        (*head)->prev = entry;
+    *head = entry;
+
+    if (slot / WHEEL_SLOTS < WHEEL_LEVELS)
+        wheel->masks[slot / WHEEL_SLOTS] |= 1ULL << (slot % WHEEL_SLOTS);
+}
+
+static void wheel_unlink(timing_wheel_t *wheel, sched_entry_t *entry) {
+    sched_entry_t **head = wheel_head(wheel, entry->slot);
+
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        *head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+
+    if (!*head && entry->slot / WHEEL_SLOTS < WHEEL_LEVELS)
+        wheel->masks[entry->slot / WHEEL_SLOTS] &= ~(1ULL << (entry->slot % WHEEL_SLOTS));
+
+    entry->prev = NULL;
+    entry->next = NULL;
+    entry->slot = SCHED_NO_SLOT;
+}
+
+// Picks the level from the most significant time unit in which the deadline differs from the current time
+static void wheel_place(timing_wheel_t *wheel, sched_entry_t *entry) {
+    time_t deadline = entry->deadline;
+    time_t current = wheel->current;
+    size_t slot;
+
+    if (deadline <= current)
+        slot = WHEEL_DUE * WHEEL_SLOTS;
+    else if (deadline / SECONDS_PER_MINUTE == current / SECONDS_PER_MINUTE)
+        slot = deadline % WHEEL_SECONDS;
+    else if (deadline / SECONDS_PER_HOUR == current / SECONDS_PER_HOUR)
+        slot = WHEEL_SLOTS + (deadline / SECONDS_PER_MINUTE) % WHEEL_MINUTES;
+    else if (deadline / SECONDS_PER_DAY == current / SECONDS_PER_DAY)
+        slot = 2 * WHEEL_SLOTS + (deadline / SECONDS_PER_HOUR) % WHEEL_HOURS;
+    else if (deadline / SECONDS_PER_DAY - current / SECONDS_PER_DAY < WHEEL_DAYS)
+        slot = 3 * WHEEL_SLOTS + (deadline / SECONDS_PER_DAY) % WHEEL_DAYS;
+    else
+        slot = WHEEL_OVERFLOW * WHEEL_SLOTS;
+
+    wheel_link(wheel, entry, slot);
+}
+
+static void wheel_relink(timing_wheel_t *wheel, size_t slot) {
+    sched_entry_t **head = wheel_head(wheel, slot);
+    sched_entry_t *entry = *head;
+
+    *head = NULL;
+    if (slot / WHEEL_SLOTS < WHEEL_LEVELS)
+        wheel->masks[slot / WHEEL_SLOTS] &= ~(1ULL << (slot % WHEEL_SLOTS));
+
+    while (entry) {
+        sched_entry_t *next = entry->next;
+        wheel_place(wheel, entry);
+        entry = next;
+    }
+}
+
+static void wheel_cascade(timing_wheel_t *wheel, time_t now) {
+    if (now % SECONDS_PER_DAY == 0) {
+        wheel_relink(wheel, 3 * WHEEL_SLOTS + (now / SECONDS_PER_DAY) % WHEEL_DAYS);
+        wheel_relink(wheel, WHEEL_OVERFLOW * WHEEL_SLOTS);
+    }
+    if (now % SECONDS_PER_HOUR == 0)
+        wheel_relink(wheel, 2 * WHEEL_SLOTS + (now / SECONDS_PER_HOUR) % WHEEL_HOURS);
+    if (now % SECONDS_PER_MINUTE == 0)
+        wheel_relink(wheel, WHEEL_SLOTS + (now / SECONDS_PER_MINUTE) % WHEEL_MINUTES);
+}
+
+void wheel_init(timing_wheel_t *wheel, time_t now) {
+    for (int i = 0; i < WHEEL_LEVELS; ++i) {
+        for (int j = 0; j < WHEEL_SLOTS; ++j)
+            wheel->slots[i][j] = NULL;
+        wheel->masks[i] = 0;
+    }
+    wheel->overflow = NULL;
+    wheel->due = NULL;
+    wheel->current = now;
+    wheel->count = 0;
+}
+
+void wheel_insert(timing_wheel_t *wheel, sched_entry_t *entry) {
+    wheel_place(wheel, entry);
+    wheel->count++;
+}
+
+void wheel_erase(timing_wheel_t *wheel, sched_entry_t *entry) {
+    wheel_unlink(wheel, entry);
+    wheel->count--;
+}
+
+sched_entry_t *wheel_pop_expired(timing_wheel_t *wheel, time_t now) {
+    while (!wheel->due) {
+        time_t next = wheel_next_event(wheel);
+        if (!next || next > now) {
+            // Nothing happens before now, so the wheel can jump ahead without cascading
+            if (wheel->current < now)
+                wheel->current = now;
+            return NULL;
+        }
+
+        wheel->current = next;
+        wheel_cascade(wheel, next);
+        wheel_relink(wheel, next % WHEEL_SECONDS);
+    }
+
+    sched_entry_t *entry = wheel->due;
+    wheel_erase(wheel, entry);
+    return entry;
+}
+
+time_t wheel_next_event(timing_wheel_t *wheel) {
+    time_t current = wheel->current;
+    uint64_t bits;
+
+    if (wheel->due)
+        return current;
+
+    time_t second = current % WHEEL_SECONDS;
+    bits = wheel->masks[0] & (~0ULL << (second + 1));
+    if (bits)
+        return current - second + __builtin_ctzll(bits);
+
+    time_t minute = (current / SECONDS_PER_MINUTE) % WHEEL_MINUTES;
+    bits = wheel->masks[1] & (~0ULL << (minute + 1));
+    if (bits)
+        return (current / SECONDS_PER_MINUTE - minute + __builtin_ctzll(bits)) * SECONDS_PER_MINUTE;
+
+    time_t hour = (current / SECONDS_PER_HOUR) % WHEEL_HOURS;
+    bits = wheel->masks[2] & (~0ULL << (hour + 1));
+    if (bits)
+        return (current / SECONDS_PER_HOUR - hour + __builtin_ctzll(bits)) * SECONDS_PER_HOUR;
+
+    // The days level is a ring, rotate it so that bit 0 is tomorrow
+    time_t day = current / SECONDS_PER_DAY;
+    int pos = (int) (day % WHEEL_DAYS);
+    bits = wheel->masks[3];
+    if (pos != WHEEL_DAYS - 1)
+        bits = (bits >> (pos + 1)) | (bits << (WHEEL_DAYS - 1 - pos));
+    if (bits)
+        return (day + 1 + __builtin_ctzll(bits)) * SECONDS_PER_DAY;
+
+    if (wheel->overflow)
+        return (day + 1) * SECONDS_PER_DAY;
+
+    return 0;
+}
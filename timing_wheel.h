@@ -0,0 +1,48 @@
+#ifndef CRON_TIMING_WHEEL_H
+#define CRON_TIMING_WHEEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// Defines
+#define WHEEL_LEVELS (4)
+#define WHEEL_SLOTS (64)
+#define WHEEL_SECONDS (60)
+#define WHEEL_MINUTES (60)
+#define WHEEL_HOURS (24)
+#define WHEEL_DAYS (64)
+#define WHEEL_OVERFLOW (WHEEL_LEVELS)
+#define WHEEL_DUE (WHEEL_LEVELS + 1)
+
+// Typedefs
+typedef struct sched_entry_t sched_entry_t;
+
+/*
+ * Hierarchical timing wheel with seconds, minutes, hours and days levels.
+ * Entries are kept in intrusive doubly linked slot lists, so arming and
+ * cancelling are O(1); an occupancy mask per level lets the next event be
+ * found with a bit scan instead of ticking every second. Deadlines beyond
+ * the days wheel wait on the overflow list and are re-examined once a day.
+ */
+typedef struct {
+    sched_entry_t *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t masks[WHEEL_LEVELS];
+    sched_entry_t *overflow;
+    sched_entry_t *due;
+    time_t current;
+    size_t count;
+} timing_wheel_t;
+
+// Timing wheel methods
+void wheel_init(timing_wheel_t *wheel, time_t now);
+
+void wheel_insert(timing_wheel_t *wheel, sched_entry_t *entry);
+
+void wheel_erase(timing_wheel_t *wheel, sched_entry_t *entry);
+
+sched_entry_t *wheel_pop_expired(timing_wheel_t *wheel, time_t now);
+
+time_t wheel_next_event(timing_wheel_t *wheel);
+
+#endif //CRON_TIMING_WHEEL_H
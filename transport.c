@@ -0,0 +1,255 @@
+#define _GNU_SOURCE
+#include "transport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#define TRANSPORT_MQ_NAME "mq"
+#define TRANSPORT_SOCKET_NAME "socket"
+
+transport_type_t transport_type_parse(const char *name) {
+    if (name && strcmp(name, TRANSPORT_SOCKET_NAME) == 0)
+        return TRANSPORT_SOCKET;
+    return TRANSPORT_MQ;
+}
+
+const char *transport_type_name(transport_type_t type) {
+    return type == TRANSPORT_SOCKET ? TRANSPORT_SOCKET_NAME : TRANSPORT_MQ_NAME;
+}
+
+// Names live in the abstract namespace, nothing is left behind in the filesystem
+static socklen_t socket_address(struct sockaddr_un *address, const char *name) {
+    size_t length = strlen(name);
+    if (length + 1 > sizeof(address->sun_path))
+        length = sizeof(address->sun_path) - 1;
+
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    memcpy(address->sun_path + 1, name, length);
+    return (socklen_t) (offsetof(struct sockaddr_un, sun_path) + 1 + length);
+}
+
+int transport_mq_init(transport_t *transport, mqd_t mqd) {
+    memset(transport, 0, sizeof(transport_t));
+    transport->type = TRANSPORT_MQ;
+    transport->fd = (int) mqd;
+    transport->listen_fd = -1;
+    transport->message_size = PROTO_MAX_MSG;
+    transport->message = malloc(transport->message_size);
+    return transport->message ? 0 : -1;
+}
+
+int transport_socket_listen(transport_t *transport, const char *name) {
+    struct sockaddr_un address;
+    socklen_t address_length = socket_address(&address, name);
+
+    memset(transport, 0, sizeof(transport_t));
+    transport->type = TRANSPORT_SOCKET;
+    transport->message_size = TRANSPORT_SOCKET_MAX_MSG;
+    transport->message = malloc(transport->message_size);
+    transport->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    transport->fd = epoll_create1(EPOLL_CLOEXEC);
+
+    // The listening socket is the only entry without a connection
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (!transport->message || transport->listen_fd == -1 || transport->fd == -1 ||
+        bind(transport->listen_fd, (struct sockaddr *) &address, address_length) == -1 ||
+        listen(transport->listen_fd, TRANSPORT_BACKLOG) == -1 ||
+        epoll_ctl(transport->fd, EPOLL_CTL_ADD, transport->listen_fd, &event) == -1) {
+        perror("socket transport failed");
+        transport_close(transport);
+        return -1;
+    }
+    return 0;
+}
+
+static void connection_close(transport_t *transport, transport_connection_t *connection) {
+    epoll_ctl(transport->fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+
+    if (connection->prev)
+        connection->prev->next = connection->next;
+    else
+        transport->connections = connection->next;
+    if (connection->next)
+        connection->next->prev = connection->prev;
+    free(connection);
+}
+
+static void connections_accept(transport_t *transport) {
+    int fd;
+
+    while ((fd = accept4(transport->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        struct ucred credentials;
+        socklen_t length = sizeof(credentials);
+        transport_connection_t *connection = malloc(sizeof(transport_connection_t));
+
+        if (!connection || getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == -1) {
+            free(connection);
+            close(fd);
+            continue;
+        }
+
+        connection->fd = fd;
+        connection->pid = credentials.pid;
+        connection->prev = NULL;
+        connection->next = transport->connections;
+
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = connection};
+        if (epoll_ctl(transport->fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            free(connection);
+            close(fd);
+            continue;
+        }
+        if (transport->connections)
+            transport->connections->prev = connection;
+        transport->connections = connection;
+    }
+}
+
+/*
+ * Returns the next message, or -1 with errno EAGAIN once nothing is left.
+ * peer is the connection it came from, -1 on the message queue. Socket
+ * connections take turns message by message, so one busy client cannot
+ * hold the loop until its buffer is empty.
+ */
+ssize_t transport_receive(transport_t *transport, const char **message, int *peer) {
+    *message = transport->message;
+    *peer = -1;
+
+    if (transport->type == TRANSPORT_MQ)
+        return mq_receive((mqd_t) transport->fd, transport->message, transport->message_size, NULL);
+
+    while (1) {
+        if (transport->ready_index == transport->ready_count) {
+            transport->ready_index = 0;
+            transport->ready_count = epoll_wait(transport->fd, transport->ready, TRANSPORT_MAX_EVENTS, 0);
+            if (transport->ready_count <= 0) {
+                if (transport->ready_count == 0)
+                    errno = EAGAIN;
+                transport->ready_count = 0;
+                return -1;
+            }
+        }
+
+        transport_connection_t *connection = transport->ready[transport->ready_index++].data.ptr;
+        if (!connection) {
+            connections_accept(transport);
+            continue;
+        }
+
+        ssize_t length = recv(connection->fd, transport->message, transport->message_size, MSG_DONTWAIT);
+        if (length > 0) {
+            // The pid written by the client is replaced by the one the kernel vouches for
+            if (length >= (ssize_t) sizeof(proto_header_t))
+                memcpy(transport->message + offsetof(proto_header_t, pid), &connection->pid, sizeof(pid_t));
+            *peer = connection->fd;
+            return length;
+        }
+
+        // Closed by the client, replies still on their way hold their own duplicate
+        if (length == 0 || errno != EAGAIN) {
+            if (transport->closed)
+                transport->closed(connection->pid, transport->closed_arg);
+            connection_close(transport, connection);
+        }
+    }
+}
+
+// Opens the descriptor a reply to pid is sent on, it is closed with close()
+int transport_reply_open(transport_t *transport, pid_t pid, int peer) {
+    if (transport->type == TRANSPORT_SOCKET)
+        return fcntl(peer, F_DUPFD_CLOEXEC, 0);
+
+    char client_mq_name[CLIENT_MQ_NAME_LEN];
+    sprintf(client_mq_name, "%s%d", CLIENT_QUEUE_PREFIX, pid);
+    return (int) mq_open(client_mq_name, O_WRONLY | O_NONBLOCK);
+}
+
+// The request queue belongs to the caller, only socket descriptors are closed
+void transport_close(transport_t *transport) {
+    if (transport->type == TRANSPORT_SOCKET) {
+        while (transport->connections)
+            connection_close(transport, transport->connections);
+        if (transport->listen_fd != -1)
+            close(transport->listen_fd);
+        if (transport->fd != -1)
+            close(transport->fd);
+    }
+
+    free(transport->message);
+    transport->message = NULL;
+    transport->listen_fd = -1;
+    transport->fd = -1;
+}
+
+int transport_socket_connect(const char *name) {
+    struct sockaddr_un address;
+    socklen_t address_length = socket_address(&address, name);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *) &address, address_length) == -1) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Same contract as proto_send_from(). On a socket, header and payload are
+ * gathered straight from the caller's buffers and a part may be up to
+ * TRANSPORT_SOCKET_MAX_MSG long, so most replies are a single message.
+ */
+int transport_send_from(transport_type_t type, int fd, proto_header_t *header, const void *payload, size_t length,
+                        size_t *offset) {
+    if (type == TRANSPORT_MQ)
+        return proto_send_from((mqd_t) fd, header, payload, length, offset);
+
+    do {
+        size_t part = length - *offset;
+        if (part > TRANSPORT_SOCKET_MAX_MSG - sizeof(proto_header_t))
+            part = TRANSPORT_SOCKET_MAX_MSG - sizeof(proto_header_t);
+
+        header->length = (uint32_t) part;
+        header->flags = *offset + part < length ? PROTO_MORE : 0;
+
+        struct iovec parts[2] = {
+                {.iov_base = header, .iov_len = sizeof(proto_header_t)},
+                {.iov_base = (char *) payload + *offset, .iov_len = part}
+        };
+        struct msghdr message = {.msg_iov = parts, .msg_iovlen = part ? 2 : 1};
+
+        ssize_t sent;
+        while ((sent = sendmsg(fd, &message, MSG_NOSIGNAL)) == -1 && errno == EINTR);
+        if (sent == -1)
+            return errno == EAGAIN ? 1 : -1;
+        *offset += part;
+    } while (*offset < length);
+
+    return 0;
+}
+
+// Non-blocking receive on the client end, a closed connection is an error
+ssize_t transport_recv(transport_type_t type, int fd, char *message, size_t size) {
+    if (type == TRANSPORT_MQ)
+        return mq_receive((mqd_t) fd, message, size, NULL);
+
+    ssize_t length = recv(fd, message, size, MSG_DONTWAIT);
+    if (length == 0) {
+        errno = ECONNRESET;
+        return -1;
+    }
+    return length;
+}
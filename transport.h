@@ -0,0 +1,81 @@
+#ifndef CRON_TRANSPORT_H
+#define CRON_TRANSPORT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include "cron_utils.h"
+#include "protocol.h"
+
+// Defines
+#define TRANSPORT_SOCKET_MAX_MSG (64 * 1024)
+#define TRANSPORT_MAX_MSG TRANSPORT_SOCKET_MAX_MSG
+#define TRANSPORT_BACKLOG (128)
+#define TRANSPORT_MAX_EVENTS (64)
+
+// Enums
+typedef enum {
+    TRANSPORT_MQ,
+    TRANSPORT_SOCKET
+} transport_type_t;
+
+// Structures
+typedef void (*transport_closed_t)(pid_t pid, void *arg);
+
+typedef struct transport_connection {
+    struct transport_connection *prev;
+    struct transport_connection *next;
+    int fd;
+    pid_t pid;
+} transport_connection_t;
+
+/*
+ * Server end of a transport. The server loop only watches fd: for the
+ * message queue it is the request queue itself, for the socket an epoll set
+ * holding the listening socket and every connection, so any number of
+ * clients adds one descriptor to the loop. Socket clients are identified by
+ * SO_PEERCRED rather than by the pid they write in the header, and their
+ * messages may be up to TRANSPORT_SOCKET_MAX_MSG long instead of
+ * PROTO_MAX_MSG. Replies go to a descriptor a request holds from its
+ * arrival on: the client's queue or a duplicate of its connection.
+ * closed, when set, is called with the pid of every connection the client
+ * closes.
+ */
+typedef struct {
+    transport_type_t type;
+    int fd;
+    int listen_fd;
+    char *message;
+    size_t message_size;
+    transport_connection_t *connections;
+    struct epoll_event ready[TRANSPORT_MAX_EVENTS];
+    int ready_count;
+    int ready_index;
+    transport_closed_t closed;
+    void *closed_arg;
+} transport_t;
+
+// Transport methods
+transport_type_t transport_type_parse(const char *name);
+
+const char *transport_type_name(transport_type_t type);
+
+int transport_mq_init(transport_t *transport, mqd_t mqd);
+
+int transport_socket_listen(transport_t *transport, const char *name);
+
+ssize_t transport_receive(transport_t *transport, const char **message, int *peer);
+
+int transport_reply_open(transport_t *transport, pid_t pid, int peer);
+
+void transport_close(transport_t *transport);
+
+// Methods of both ends
+int transport_socket_connect(const char *name);
+
+int transport_send_from(transport_type_t type, int fd, proto_header_t *header, const void *payload, size_t length,
+                        size_t *offset);
+
+ssize_t transport_recv(transport_type_t type, int fd, char *message, size_t size);
+
+#endif //CRON_TRANSPORT_H